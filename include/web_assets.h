@@ -0,0 +1,135 @@
+// Generated by tools/embed_assets.py from web/ -- do not edit by hand.
+#pragma once
+
+#include <Arduino.h>
+
+struct WebAsset {
+  const char *path;
+  const char *contentType;
+  const char *etag;
+  const uint8_t *data;
+  size_t length;
+};
+
+// app.js: 4232 bytes, 1546 gzipped
+static const uint8_t ASSET_APP_JS[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0xbd, 0x57, 0x4b, 0x73, 0xdb, 0x36,
+  0x10, 0xbe, 0xfb, 0x57, 0x6c, 0x74, 0x08, 0xc9, 0xb1, 0x0c, 0xb9, 0x87, 0x5e, 0xa4, 0x28, 0x99,
+  0x4c, 0xd3, 0x24, 0xee, 0x24, 0x71, 0x26, 0x4e, 0xa6, 0x07, 0x8d, 0x0f, 0x10, 0x09, 0x8a, 0xa8,
+  0x49, 0x90, 0x01, 0x40, 0x29, 0x9e, 0xc4, 0xff, 0xbd, 0xbb, 0x00, 0x9f, 0xb2, 0x64, 0xa7, 0xed,
+  0x4c, 0x2f, 0x12, 0x09, 0xee, 0x7b, 0xbf, 0x7d, 0x60, 0x36, 0x83, 0x4f, 0x22, 0xd5, 0xc2, 0x64,
+  0xc2, 0x40, 0xc2, 0x4d, 0xb6, 0x2e, 0xb9, 0x4e, 0x20, 0x95, 0x22, 0x4f, 0x0c, 0x58, 0xbe, 0xd9,
+  0x88, 0x04, 0x76, 0xd2, 0x66, 0xf8, 0xd1, 0xf2, 0x33, 0x63, 0xb9, 0xad, 0xcd, 0x72, 0xf2, 0xec,
+  0x46, 0xdc, 0x3e, 0x9f, 0x30, 0x78, 0xdd, 0xd0, 0x65, 0xdc, 0x9e, 0xcc, 0x66, 0xc0, 0x73, 0x53,
+  0x42, 0xcc, 0xb5, 0xbe, 0xf5, 0xe4, 0x71, 0x86, 0xa4, 0xea, 0xf9, 0x04, 0xd6, 0x22, 0x2f, 0xd5,
+  0x06, 0x2c, 0x7e, 0xcd, 0xb8, 0x52, 0x22, 0x07, 0xc5, 0xe0, 0x4b, 0x85, 0x44, 0xa8, 0x16, 0xe9,
+  0xe5, 0x56, 0x40, 0x4e, 0x3f, 0xa9, 0x2e, 0x0b, 0x92, 0x34, 0xe3, 0x95, 0x9c, 0x89, 0xad, 0x50,
+  0xd6, 0x2c, 0xfc, 0x8b, 0x57, 0x0d, 0xd2, 0x40, 0x55, 0xe6, 0x39, 0x5a, 0x55, 0xaa, 0xfc, 0x16,
+  0x76, 0x99, 0xcc, 0x85, 0xd3, 0x0f, 0xc6, 0x6a, 0xc1, 0x0b, 0x22, 0x48, 0xca, 0x9d, 0x62, 0x27,
+  0x61, 0x5a, 0xab, 0xd8, 0xca, 0x52, 0x41, 0x18, 0xc1, 0xf7, 0x13, 0x80, 0x2d, 0xd7, 0xad, 0x63,
+  0x4b, 0xa4, 0x89, 0xeb, 0x02, 0xc5, 0xb3, 0xaf, 0xb5, 0xd0, 0xb7, 0x57, 0x22, 0x17, 0xb1, 0x2d,
+  0xf5, 0xcb, 0x3c, 0x0f, 0x83, 0xd5, 0xc0, 0xd5, 0xeb, 0x20, 0x5a, 0x20, 0xab, 0x4c, 0x21, 0x7c,
+  0xe2, 0x79, 0x59, 0x2e, 0xd4, 0xc6, 0x66, 0x11, 0x68, 0x61, 0x6b, 0xad, 0x16, 0xad, 0xe0, 0xc2,
+  0xa2, 0x54, 0x52, 0x83, 0xd4, 0xd5, 0x1c, 0x7a, 0xe5, 0x06, 0xb5, 0x37, 0xc4, 0x60, 0x98, 0xac,
+  0x16, 0x70, 0x37, 0x75, 0x64, 0xc5, 0x57, 0x6b, 0x7f, 0x2b, 0x31, 0x1a, 0xb1, 0x15, 0xc9, 0x71,
+  0x8e, 0x11, 0x19, 0xbc, 0x80, 0xa0, 0x7b, 0x09, 0x60, 0x0e, 0xc1, 0x2b, 0x69, 0xe2, 0xee, 0xa0,
+  0x93, 0x5d, 0x49, 0x35, 0x92, 0x38, 0x85, 0x78, 0x20, 0x34, 0x78, 0xf3, 0xf1, 0xe2, 0x32, 0x80,
+  0x53, 0x88, 0x19, 0x12, 0xe2, 0x7f, 0x00, 0x21, 0xbd, 0x86, 0x31, 0xe3, 0xc8, 0xb1, 0x15, 0x6f,
+  0xe5, 0x26, 0x23, 0x55, 0x2f, 0xdd, 0x1b, 0xbc, 0xbd, 0x78, 0xf3, 0xd6, 0x29, 0x6b, 0xde, 0xdf,
+  0x5d, 0xfe, 0x19, 0x44, 0xc4, 0x16, 0xf5, 0x1a, 0x93, 0x5a, 0x73, 0x52, 0xf6, 0xde, 0x3c, 0xa0,
+  0x38, 0x66, 0x3d, 0x99, 0x53, 0x5b, 0x98, 0x5e, 0x82, 0x57, 0xfd, 0x20, 0xb7, 0x27, 0x21, 0xcb,
+  0x2e, 0x95, 0x33, 0xe8, 0x22, 0xc9, 0xc5, 0xc0, 0xeb, 0x3a, 0x37, 0xe2, 0x61, 0xfd, 0x8e, 0x04,
+  0x9e, 0x3e, 0x6d, 0x1f, 0x59, 0x5c, 0xd6, 0xca, 0xa2, 0x04, 0x14, 0x70, 0xb7, 0x38, 0xc1, 0xdf,
+  0x8e, 0xd9, 0x08, 0x1b, 0x22, 0xce, 0x51, 0x42, 0x36, 0x05, 0x2b, 0xbe, 0xd9, 0xa8, 0xc9, 0x6f,
+  0x5a, 0x6a, 0x08, 0x29, 0xe9, 0x12, 0x53, 0x7e, 0xbe, 0xc0, 0xbf, 0x67, 0x30, 0x02, 0x07, 0x1e,
+  0x9d, 0x9e, 0xb6, 0xd4, 0x0d, 0x3e, 0x90, 0xd4, 0xd3, 0xac, 0xe4, 0xf5, 0xa2, 0xf9, 0x40, 0xb0,
+  0x4a, 0xd9, 0x46, 0xd8, 0x97, 0xd6, 0x6a, 0xb9, 0xae, 0xad, 0x08, 0x83, 0x01, 0xf8, 0x30, 0xc6,
+  0xcb, 0xe5, 0x12, 0xd0, 0x06, 0x32, 0xf8, 0x20, 0x61, 0x9c, 0x35, 0x44, 0x31, 0x22, 0x32, 0x65,
+  0x64, 0x25, 0xc2, 0xc3, 0x22, 0xb0, 0x51, 0x1f, 0xbd, 0x79, 0x55, 0xce, 0xbb, 0x91, 0x73, 0xda,
+  0x57, 0x7d, 0xd8, 0x5a, 0x49, 0xa6, 0x50, 0x05, 0x0e, 0x71, 0x8d, 0xe4, 0xc2, 0xc6, 0x59, 0x18,
+  0x0c, 0x0a, 0x30, 0x88, 0x1a, 0xdb, 0x99, 0xcd, 0x84, 0x1a, 0xd4, 0x98, 0x1e, 0x84, 0x59, 0xb3,
+  0xbf, 0x4c, 0xa9, 0xc2, 0x08, 0xc3, 0x7a, 0x8c, 0xdc, 0xf4, 0xe1, 0xf9, 0xe7, 0x01, 0x1d, 0x05,
+  0xb5, 0xb0, 0xab, 0x2e, 0xb0, 0x0f, 0xc5, 0xb2, 0x8b, 0x7a, 0xcb, 0x1d, 0x67, 0xc3, 0x9c, 0x1c,
+  0x8b, 0xee, 0x3d, 0x2e, 0x58, 0x3a, 0x4e, 0x8c, 0xb9, 0xaa, 0xf3, 0x1c, 0xb1, 0xe8, 0xfe, 0xe6,
+  0xe8, 0x12, 0x6b, 0x9a, 0x9b, 0x81, 0x1f, 0x3f, 0x60, 0x75, 0x1d, 0xad, 0x4e, 0xe3, 0xec, 0x9e,
+  0xd6, 0x2d, 0x29, 0xa5, 0x7c, 0x86, 0x43, 0x29, 0xc8, 0x80, 0x38, 0x7d, 0x01, 0x69, 0x83, 0xd8,
+  0x39, 0xd4, 0x2a, 0x11, 0xa9, 0x54, 0x22, 0x19, 0x0a, 0xa0, 0x2c, 0x6d, 0xe1, 0x09, 0x72, 0x75,
+  0x9f, 0xa3, 0x81, 0x0b, 0xe3, 0xf4, 0x6f, 0x7b, 0xce, 0xbb, 0xe6, 0xa9, 0x4f, 0x47, 0xcc, 0x29,
+  0xb3, 0xa3, 0x16, 0x79, 0xe7, 0x7c, 0x75, 0x30, 0xc1, 0x0e, 0x7c, 0x81, 0x62, 0xf4, 0x96, 0xe7,
+  0xe0, 0x0a, 0x84, 0x5a, 0xaa, 0x01, 0x5d, 0x2b, 0xc8, 0xcb, 0x98, 0xe7, 0xd8, 0x79, 0xa9, 0x53,
+  0x63, 0xe3, 0xc5, 0xbe, 0xcd, 0x8d, 0x85, 0x89, 0x6c, 0xc8, 0x27, 0xe0, 0xba, 0x76, 0xd3, 0x15,
+  0x93, 0x5a, 0x50, 0x57, 0xbc, 0x5b, 0x0c, 0xa1, 0x67, 0x65, 0x7c, 0xd3, 0xe1, 0x8e, 0xa8, 0x54,
+  0xb9, 0x43, 0xaa, 0x57, 0x38, 0x0c, 0x18, 0x3e, 0x86, 0x4d, 0xc8, 0x3b, 0x50, 0x60, 0x9c, 0xb0,
+  0x49, 0xa1, 0xa8, 0x71, 0x45, 0xe5, 0x22, 0x25, 0x2f, 0xf1, 0x7c, 0x85, 0x61, 0x3e, 0x90, 0x90,
+  0xf7, 0xdc, 0x66, 0xac, 0xe0, 0xdf, 0xc2, 0xf3, 0xa9, 0x7f, 0xd6, 0xe8, 0x49, 0x12, 0x86, 0x2d,
+  0xc7, 0x19, 0x29, 0x8e, 0x60, 0x06, 0xbf, 0x9c, 0x9f, 0x9f, 0x47, 0x5d, 0xa2, 0xa9, 0xec, 0x83,
+  0xd6, 0x9d, 0x0f, 0x18, 0xd1, 0xc0, 0x77, 0x00, 0xaf, 0xaf, 0xd7, 0x12, 0x94, 0x69, 0xea, 0x7a,
+  0x10, 0x1a, 0x47, 0xcd, 0xd3, 0x7d, 0xa7, 0x9e, 0x66, 0x5a, 0xd0, 0x74, 0x55, 0xe7, 0xcc, 0xa5,
+  0xc6, 0x85, 0xa9, 0xc7, 0x19, 0x29, 0xda, 0x91, 0xb2, 0x93, 0x0a, 0x03, 0xcb, 0x7e, 0xa7, 0x88,
+  0x5d, 0x95, 0xb5, 0x8e, 0xc5, 0x30, 0x2c, 0x82, 0xe6, 0x94, 0x12, 0x3b, 0x18, 0x7c, 0x6f, 0x6a,
+  0xd1, 0x4f, 0xc6, 0x56, 0x8f, 0x30, 0xac, 0x54, 0x65, 0x25, 0x14, 0xc9, 0x1f, 0x66, 0xb4, 0x55,
+  0x6a, 0x75, 0x2d, 0x16, 0x70, 0x37, 0xa0, 0x16, 0x5a, 0x63, 0x78, 0x8f, 0x90, 0x7b, 0x1b, 0x91,
+  0x9e, 0x70, 0x30, 0x50, 0x8e, 0xe5, 0xdd, 0x8c, 0x1a, 0x03, 0xeb, 0x5b, 0x90, 0xd6, 0x88, 0x3c,
+  0x6d, 0x65, 0xf2, 0x24, 0x71, 0xa4, 0xef, 0xa4, 0x41, 0xfc, 0x09, 0x1d, 0x06, 0xae, 0xbf, 0x62,
+  0xf0, 0x7a, 0x1d, 0x7b, 0x19, 0x4c, 0x50, 0xd7, 0x1f, 0x57, 0x97, 0x1f, 0x58, 0xc5, 0xb5, 0x11,
+  0xa1, 0x60, 0x54, 0x74, 0xe3, 0x3c, 0xf8, 0x86, 0x8f, 0x42, 0x02, 0x0a, 0x71, 0xc2, 0x28, 0x11,
+  0xc9, 0x91, 0x31, 0x30, 0xe6, 0xf4, 0xb3, 0x60, 0x9f, 0xd3, 0x9f, 0xb6, 0xf9, 0xe9, 0xe3, 0x77,
+  0xdf, 0xfa, 0x16, 0x01, 0xff, 0xde, 0x01, 0xc2, 0x19, 0xe9, 0xbd, 0x26, 0x94, 0x32, 0xa1, 0xf8,
+  0x9a, 0xd6, 0x16, 0xac, 0xfc, 0x84, 0x29, 0x84, 0x15, 0x4e, 0xc0, 0x27, 0x3d, 0x9a, 0x7a, 0xf4,
+  0x3b, 0x6b, 0x1b, 0x82, 0xb9, 0xfb, 0xdc, 0x0a, 0xf4, 0x85, 0xf3, 0x13, 0xb6, 0xe7, 0x52, 0xdd,
+  0xfc, 0xc7, 0xc0, 0xcb, 0x0a, 0x05, 0x90, 0x72, 0x8a, 0xda, 0x4e, 0xa6, 0x12, 0x6d, 0x4c, 0x70,
+  0x7b, 0xa1, 0x68, 0x7f, 0x28, 0x2d, 0xf4, 0x3b, 0xc7, 0x98, 0x6f, 0xb4, 0xad, 0x0c, 0x44, 0xd0,
+  0xf9, 0x23, 0xcb, 0xcb, 0x9e, 0x67, 0x28, 0xae, 0xed, 0x41, 0x21, 0x79, 0x3e, 0xf5, 0x75, 0x3a,
+  0xec, 0x51, 0xef, 0xb9, 0xaa, 0xb1, 0x43, 0x61, 0xd3, 0xc6, 0x3d, 0x55, 0x1b, 0xb7, 0xa8, 0x96,
+  0xb5, 0x45, 0x9c, 0xe6, 0x25, 0x4f, 0x24, 0x6d, 0x9c, 0xd8, 0xa0, 0x2a, 0xbe, 0x41, 0x34, 0xd3,
+  0x13, 0x8d, 0x02, 0x81, 0xa6, 0x17, 0x58, 0x5a, 0x6b, 0x1e, 0xdf, 0x00, 0x37, 0xbe, 0x5d, 0x99,
+  0x76, 0x8b, 0x2b, 0x75, 0xf1, 0xc8, 0x76, 0x48, 0x24, 0x2b, 0xee, 0xe2, 0xba, 0x9c, 0xb8, 0x62,
+  0x6c, 0xd4, 0x4f, 0x9a, 0x5d, 0xf1, 0xe0, 0x30, 0x23, 0xb9, 0x87, 0x66, 0x99, 0xfb, 0x40, 0xad,
+  0xfb, 0x7e, 0x12, 0x4d, 0xbd, 0x2e, 0xa4, 0x3d, 0x96, 0x46, 0xb7, 0x91, 0xde, 0x1f, 0xd8, 0x08,
+  0x08, 0x56, 0x69, 0xe7, 0xd3, 0x2b, 0x91, 0xf2, 0x3a, 0xb7, 0x61, 0x97, 0x9f, 0xe1, 0x30, 0x6f,
+  0x6c, 0x46, 0xe9, 0xdf, 0xa1, 0x10, 0x18, 0x35, 0x5c, 0x40, 0x83, 0x8f, 0x97, 0x57, 0x9f, 0xf1,
+  0x64, 0x5d, 0x26, 0xb7, 0x73, 0xd7, 0x78, 0xbe, 0x7c, 0x7a, 0x77, 0x25, 0xb8, 0x8e, 0xb3, 0x8f,
+  0x5c, 0xf3, 0xc2, 0x84, 0x74, 0xf6, 0x1a, 0x2d, 0x46, 0xb0, 0xf2, 0xd0, 0x66, 0xd2, 0x44, 0xd1,
+  0x14, 0xd5, 0x27, 0x12, 0x1b, 0x83, 0x45, 0x01, 0x85, 0xcb, 0x47, 0xd0, 0x8f, 0x99, 0x87, 0x06,
+  0x4d, 0x9b, 0x69, 0x97, 0xcc, 0x61, 0xb2, 0x9b, 0xd5, 0x64, 0x0a, 0xbf, 0xfa, 0x7c, 0xdf, 0x45,
+  0xe4, 0x03, 0xdd, 0x0a, 0x5e, 0x4b, 0x5d, 0xec, 0xb8, 0x16, 0x50, 0x57, 0x94, 0xe0, 0xb9, 0x4b,
+  0x6a, 0x4a, 0x37, 0x80, 0x4d, 0x49, 0x17, 0x09, 0xe3, 0x0e, 0x34, 0xdf, 0xa1, 0x51, 0x98, 0x39,
+  0x9c, 0x4b, 0xe4, 0xcb, 0x94, 0x6e, 0x09, 0x38, 0x44, 0xe8, 0x5b, 0x22, 0xb6, 0x32, 0x16, 0x24,
+  0x6b, 0xa7, 0x25, 0x5d, 0x3e, 0xf0, 0x4a, 0x92, 0xe2, 0x04, 0xcb, 0x88, 0x59, 0xda, 0xe6, 0x2e,
+  0x62, 0x8e, 0x5c, 0x1e, 0x7e, 0x12, 0x1d, 0x6e, 0x77, 0xf0, 0x26, 0xfe, 0xaf, 0x98, 0x38, 0x9e,
+  0xfa, 0xd6, 0x7a, 0x9a, 0x05, 0x98, 0xb6, 0xd1, 0x31, 0x85, 0x6f, 0xe9, 0xbe, 0x8e, 0xfd, 0xa1,
+  0x16, 0x58, 0xd5, 0x76, 0x65, 0x6f, 0x2b, 0xb1, 0x24, 0x2a, 0xf4, 0x85, 0xd1, 0xbf, 0x59, 0x9d,
+  0x5f, 0x0f, 0x25, 0x34, 0x37, 0xb3, 0xc3, 0x32, 0x86, 0xc1, 0x18, 0xdf, 0xa9, 0x3a, 0x14, 0x93,
+  0xcc, 0x7d, 0x14, 0x7b, 0xca, 0xbd, 0x85, 0x26, 0xf8, 0x52, 0x35, 0x75, 0xcd, 0x18, 0x0b, 0xc6,
+  0xb0, 0x76, 0xba, 0x0f, 0xac, 0x70, 0x5e, 0x73, 0x80, 0x38, 0xed, 0x97, 0xc7, 0x3d, 0xc0, 0x77,
+  0xe7, 0x1e, 0xf8, 0x64, 0x4e, 0x7f, 0x96, 0x09, 0x9e, 0x60, 0x6b, 0x99, 0x63, 0x9d, 0x04, 0x8d,
+  0x25, 0x67, 0x9f, 0x31, 0x22, 0x01, 0xb2, 0xf3, 0xaa, 0xca, 0x65, 0xec, 0xae, 0x33, 0xb3, 0x12,
+  0x5b, 0x98, 0x3d, 0xf3, 0x77, 0xd0, 0xe0, 0xfe, 0xbe, 0xf5, 0xd8, 0xbe, 0x4c, 0x8e, 0x86, 0xd1,
+  0x3e, 0x0d, 0xdd, 0x38, 0x0e, 0x87, 0x02, 0x6f, 0x2c, 0x1d, 0x6f, 0x79, 0x43, 0x7b, 0xf6, 0xe2,
+  0x21, 0x65, 0xe5, 0x0d, 0x49, 0xa2, 0x68, 0xd3, 0x13, 0x16, 0xdb, 0x67, 0x59, 0x08, 0xec, 0x94,
+  0xe1, 0xde, 0xfc, 0x2f, 0xbd, 0x37, 0xcc, 0x37, 0x50, 0xb7, 0xc0, 0x63, 0xdb, 0xf5, 0x75, 0xf8,
+  0x58, 0x55, 0x3f, 0x98, 0x33, 0xdc, 0x29, 0x30, 0xac, 0xee, 0x82, 0xba, 0x57, 0xfc, 0xbe, 0xba,
+  0xff, 0x06, 0xd5, 0x3e, 0x18, 0x0b, 0x88, 0x10, 0x00, 0x00,
+};
+
+// style.css: 300 bytes, 206 gzipped
+static const uint8_t ASSET_STYLE_CSS[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0x55, 0x8e, 0xdd, 0x0a, 0x83, 0x30,
+  0x0c, 0x85, 0xef, 0x7d, 0x0a, 0xc1, 0x5b, 0x05, 0x2b, 0xfb, 0xa3, 0x3e, 0x4d, 0x35, 0xad, 0x86,
+  0x69, 0x23, 0xfd, 0x61, 0x6e, 0xb2, 0x77, 0x5f, 0x83, 0x73, 0x30, 0x72, 0x93, 0x1c, 0x72, 0xbe,
+  0x73, 0x3a, 0x82, 0xe7, 0x66, 0xc8, 0x86, 0xca, 0xa8, 0x19, 0xa7, 0xa7, 0xf4, 0xca, 0xfa, 0xca,
+  0x6b, 0x87, 0xa6, 0x9d, 0xd5, 0x5a, 0x3d, 0x10, 0xc2, 0x28, 0xaf, 0x4d, 0xbd, 0xac, 0xe9, 0x76,
+  0x03, 0x5a, 0xc9, 0x7b, 0xae, 0x62, 0xa0, 0x76, 0x51, 0x00, 0x68, 0x07, 0x59, 0xe7, 0xa2, 0x59,
+  0xd6, 0x77, 0x86, 0x76, 0x89, 0xa1, 0xf4, 0x7a, 0xd2, 0x7d, 0x28, 0xbb, 0x18, 0x02, 0xd9, 0x9d,
+  0xed, 0xf1, 0xa5, 0xa5, 0x70, 0x7a, 0xfe, 0x59, 0x2e, 0xfc, 0x6f, 0xc8, 0xcd, 0xdb, 0x97, 0x2a,
+  0x98, 0x5a, 0xbf, 0x33, 0x9f, 0xbc, 0x98, 0x7c, 0x1d, 0x39, 0xd0, 0x4e, 0x8a, 0xa4, 0x7a, 0x9a,
+  0x10, 0xf2, 0x02, 0x00, 0xda, 0x5d, 0xad, 0x9c, 0x02, 0x8c, 0x5e, 0xde, 0x52, 0xa9, 0x03, 0xc8,
+  0x0d, 0x8e, 0x86, 0xbc, 0x33, 0x6b, 0x14, 0xe5, 0xd8, 0x1c, 0x01, 0xb7, 0x5d, 0xeb, 0x09, 0xf4,
+  0xd6, 0xa9, 0xfe, 0x3e, 0x38, 0x8a, 0x16, 0x64, 0x61, 0xce, 0x3c, 0x3f, 0x0e, 0x5b, 0x4f, 0x09,
+  0xf5, 0x9f, 0x74, 0xe2, 0xba, 0x1f, 0xa3, 0x15, 0xff, 0x3e, 0x2c, 0x01, 0x00, 0x00,
+};
+
+static const WebAsset WEB_ASSETS[] = {
+  {"/static/app.js", "application/javascript", "\"2b343c57dc084fba\"", ASSET_APP_JS, sizeof(ASSET_APP_JS)},
+  {"/static/style.css", "text/css", "\"5b3bbf84228c0a82\"", ASSET_STYLE_CSS, sizeof(ASSET_STYLE_CSS)},
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+// Time source for the scheduling core. The firmware implements it on top of
+// millis()/micros()/gettimeofday(); SimClock lets a host build run days of
+// schedule without waiting for them.
+class Clock {
+public:
+  virtual ~Clock() {}
+  virtual uint32_t millis() const = 0;
+  virtual uint32_t micros() const = 0;
+  // UTC wall time in ms since the epoch; small values mean "not synced yet"
+  virtual int64_t epochMs() const = 0;
+};
+
+// Manually advanced clock. millis()/micros() wrap like the real counters.
+class SimClock : public Clock {
+public:
+  explicit SimClock(int64_t epochMs = 0) : _epochUs(epochMs * 1000) {}
+
+  uint32_t millis() const override { return (uint32_t)(_monoUs / 1000); }
+  uint32_t micros() const override { return (uint32_t)_monoUs; }
+  int64_t epochMs() const override { return _epochUs / 1000; }
+
+  void advanceMs(uint64_t ms) { advanceUs(ms * 1000); }
+  void advanceUs(uint64_t us) {
+    _monoUs += us;
+    _epochUs += (int64_t)us;
+  }
+
+  // Steps wall time only, like an NTP correction
+  void setEpochMs(int64_t ms) { _epochUs = ms * 1000; }
+
+private:
+  uint64_t _monoUs = 0;
+  int64_t _epochUs;
+};
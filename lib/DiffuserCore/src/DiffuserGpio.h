@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "DiffuserClock.h"
+
+// Output pins as seen by the core. The firmware maps it to pinMode() and
+// digitalWrite(); the pulse ISR keeps its direct register writes.
+class Gpio {
+public:
+  virtual ~Gpio() {}
+  virtual void output(uint8_t pin) = 0;
+  virtual void write(uint8_t pin, bool high) = 0;
+};
+
+// Records every level change with the simulated time it happened at
+class SimGpio : public Gpio {
+public:
+  struct Edge {
+    uint32_t us;
+    uint8_t pin;
+    bool high;
+  };
+
+  explicit SimGpio(const Clock &clock) : _clock(clock) {}
+
+  void output(uint8_t pin) override {
+    if (pin < 32) _outputs |= 1UL << pin;
+  }
+
+  void write(uint8_t pin, bool high) override {
+    if (pin >= 32) return;
+    bool was = _levels & (1UL << pin);
+    if (high) _levels |= 1UL << pin; else _levels &= ~(1UL << pin);
+    if (was != high) edges.push_back({_clock.micros(), pin, high});
+  }
+
+  bool level(uint8_t pin) const { return pin < 32 && (_levels & (1UL << pin)); }
+  bool isOutput(uint8_t pin) const { return pin < 32 && (_outputs & (1UL << pin)); }
+
+  std::vector<Edge> edges;
+
+private:
+  const Clock &_clock;
+  uint32_t _levels = 0;
+  uint32_t _outputs = 0;
+};
@@ -0,0 +1,205 @@
+#include "MqttCommand.h"
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include "Schedule.h"
+#include "ScheduleJson.h"
+
+const char *const MQTT_OP_NAMES[OP_COUNT] = {
+  "trigger", "triggerAll", "pulse", "interval", "stopInterval", "schedule", "addSchedule", "clearSchedule",
+  "rules", "addRule", "clearRules", "groupTrigger", "update"
+};
+
+uint8_t mqttOpType(JsonObjectConst op) {
+  const char *name = op["op"] | "";
+  for (uint8_t i = 0; i < OP_COUNT; i++) {
+    if (strcmp(name, MQTT_OP_NAMES[i]) == 0) return i;
+  }
+  return OP_COUNT;
+}
+
+bool md5HexValid(const char *md5) {
+  if (strlen(md5) != 32) return false;
+  for (const char *p = md5; *p; p++) {
+    if (!isxdigit((unsigned char)*p)) return false;
+  }
+  return true;
+}
+
+const char *mqttValidateOp(JsonObjectConst op, const MqttLimits &limits, size_t *scheduleSizes,
+                           size_t *ruleSizes) {
+  uint8_t type = mqttOpType(op);
+  if (type == OP_COUNT) return "unknown op";
+  long ch = op["ch"] | 0L;
+  if (ch < 0 || ch >= limits.channelCount) return "invalid channel";
+  switch (type) {
+    case OP_PULSE: {
+      long ms = op["ms"] | 0L;
+      if (ms < 1 || ms > 600000) return "ms out of range";
+      break;
+    }
+    case OP_GROUP_TRIGGER: {
+      long group = op["group"] | 0L;
+      long mask = op["mask"] | 0L;
+      long ms = op["ms"] | 0L;
+      long lead = op["leadMs"] | (long)limits.groupDefaultLeadMs;
+      if (group < 1 || group > 65535) return "invalid group";
+      if (mask < 0 || mask > 0xFF) return "invalid mask";
+      if (ms < 0 || ms > 600000) return "ms out of range";
+      if (lead < 0 || lead > (long)limits.groupMaxLeadMs) return "leadMs out of range";
+      break;
+    }
+    case OP_UPDATE: {
+      const char *url = op["url"] | "";
+      long stagger = op["staggerSec"] | 0L;
+      if (strncmp(url, "http://", 7) != 0 || strlen(url) >= limits.urlSize) return "url must be http:// and short";
+      if (!md5HexValid(op["md5"] | "")) return "md5 must be 32 hex digits";
+      if (stagger < 0 || stagger > (long)limits.maxStaggerSec) return "staggerSec out of range";
+      break;
+    }
+    case OP_INTERVAL: {
+      long seconds = op["seconds"] | 0L;
+      if (seconds < 0 || seconds > (long)MAX_INTERVAL_SECONDS) return "seconds out of range";
+      if ((op["enabled"] | true) && seconds <= 0) return "seconds must be positive";
+      break;
+    }
+    case OP_SCHEDULE: {
+      JsonArrayConst times = op["times"].as<JsonArrayConst>();
+      if (times.isNull()) return "missing times";
+      if (times.size() > MAX_SCHEDULE_ENTRIES) return "schedule is full";
+      for (JsonVariantConst v : times) {
+        if (!v.is<const char *>() || parseTimeToMinutes(v.as<const char *>()) < 0) return "invalid time";
+      }
+      scheduleSizes[ch] = times.size();
+      break;
+    }
+    case OP_ADD_SCHEDULE:
+      if (parseTimeToMinutes(op["time"] | "") < 0) return "invalid time";
+      if (scheduleSizes[ch] >= MAX_SCHEDULE_ENTRIES) return "schedule is full";
+      scheduleSizes[ch]++;
+      break;
+    case OP_CLEAR_SCHEDULE:
+      scheduleSizes[ch] = 0;
+      break;
+    case OP_RULES: {
+      JsonArrayConst rules = op["rules"].as<JsonArrayConst>();
+      if (rules.isNull()) return "missing rules";
+      if (rules.size() > MAX_SCHEDULE_RULES) return "too many rules";
+      ScheduleRule r;
+      for (JsonVariantConst v : rules) {
+        const char *error = scheduleRuleFromJson(v, r);
+        if (error) return error;
+      }
+      ruleSizes[ch] = rules.size();
+      break;
+    }
+    case OP_ADD_RULE: {
+      ScheduleRule r;
+      const char *error = scheduleRuleFromJson(op["rule"], r);
+      if (error) return error;
+      if (ruleSizes[ch] >= MAX_SCHEDULE_RULES) return "too many rules";
+      ruleSizes[ch]++;
+      break;
+    }
+    case OP_CLEAR_RULES:
+      ruleSizes[ch] = 0;
+      break;
+  }
+  return nullptr;
+}
+
+const char *mqttValidateOps(JsonArrayConst ops, const MqttLimits &limits, size_t *scheduleSizes,
+                            size_t *ruleSizes, size_t &index) {
+  if (ops.isNull() || ops.size() == 0 || ops.size() > MQTT_MAX_OPS) {
+    index = ops.size();
+    return "ops must be an array of 1-16 ops";
+  }
+  index = 0;
+  for (JsonVariantConst op : ops) {
+    const char *error = op.is<JsonObjectConst>()
+                            ? mqttValidateOp(op.as<JsonObjectConst>(), limits, scheduleSizes, ruleSizes)
+                            : "op must be an object";
+    if (error) return error;
+    index++;
+  }
+  return nullptr;
+}
+
+// The text parser works on (pointer, length) views of the payload
+static void trimSpan(const char *&p, size_t &n) {
+  while (n && isspace((unsigned char)*p)) {
+    p++;
+    n--;
+  }
+  while (n && isspace((unsigned char)p[n - 1])) n--;
+}
+
+static bool spanIs(const char *p, size_t n, const char *word) {
+  return strlen(word) == n && strncasecmp(p, word, n) == 0;
+}
+
+// Case-sensitive: "INTERVAL:" and "ADD_SCHEDULE:" are upper case only
+static bool spanStrip(const char *&p, size_t &n, const char *prefix) {
+  size_t len = strlen(prefix);
+  if (n < len || strncmp(p, prefix, len) != 0) return false;
+  p += len;
+  n -= len;
+  return true;
+}
+
+// Up to 9 decimal digits and nothing else, -1 otherwise
+static long spanNumber(const char *p, size_t n) {
+  if (n == 0 || n > 9) return -1;
+  long v = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!isdigit((unsigned char)p[i])) return -1;
+    v = v * 10 + (p[i] - '0');
+  }
+  return v;
+}
+
+const char *mqttParseText(const char *msg, size_t length, uint8_t channelCount, MqttTextCommand &cmd) {
+  const char *p = msg;
+  size_t n = length;
+  trimSpan(p, n);
+  cmd = MqttTextCommand();
+  if (spanIs(p, n, "TRIGGER_ALL")) {
+    cmd.kind = MqttTextCommand::TRIGGER_ALL;
+    return nullptr;
+  }
+  if (n > 3 && strncasecmp(p, "CH", 2) == 0) {
+    const char *colon = (const char *)memchr(p, ':', n);
+    long ch = colon ? spanNumber(p + 2, colon - p - 2) : -1;
+    if (ch < 0 || ch >= channelCount) return "invalid channel";
+    cmd.ch = (uint8_t)ch;
+    n -= colon + 1 - p;
+    p = colon + 1;
+    trimSpan(p, n);
+  }
+  if (spanIs(p, n, "TRIGGER") || (n == 1 && *p == '1')) {
+    cmd.kind = MqttTextCommand::TRIGGER;
+  } else if (spanStrip(p, n, "INTERVAL:")) {
+    trimSpan(p, n);
+    long seconds = spanNumber(p, n);
+    if (seconds <= 0 || seconds > (long)MAX_INTERVAL_SECONDS) return "interval must be 1-2147483 seconds";
+    cmd.kind = MqttTextCommand::INTERVAL;
+    cmd.value = (uint32_t)seconds;
+  } else if (spanIs(p, n, "STOP_INTERVAL")) {
+    cmd.kind = MqttTextCommand::STOP_INTERVAL;
+  } else if (spanStrip(p, n, "ADD_SCHEDULE:")) {
+    trimSpan(p, n);
+    char time[6];
+    if (n >= sizeof(time)) return "invalid time";
+    memcpy(time, p, n);
+    time[n] = '\0';
+    int minute = parseTimeToMinutes(time);
+    if (minute < 0) return "invalid time";
+    cmd.kind = MqttTextCommand::ADD_SCHEDULE;
+    cmd.value = (uint32_t)minute;
+  } else if (spanIs(p, n, "CLEAR_SCHEDULE")) {
+    cmd.kind = MqttTextCommand::CLEAR_SCHEDULE;
+  } else {
+    return "unknown command";
+  }
+  return nullptr;
+}
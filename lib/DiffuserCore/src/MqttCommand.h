@@ -0,0 +1,77 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <ArduinoJson.h>
+
+// Parsing and validation of the MQTT commands, kept apart from the
+// handlers that apply them so both sides can be exercised on the host.
+// Batches are {"id":"...","ops":[{"op":"...","ch":0,...},...]}; text
+// commands are "TRIGGER", "INTERVAL:30" and so on.
+
+static const size_t MQTT_MAX_OPS = 16;
+
+enum MqttOpType : uint8_t {
+  OP_TRIGGER,        // {"op":"trigger","ch":n}
+  OP_TRIGGER_ALL,    // {"op":"triggerAll"}
+  OP_PULSE,          // {"op":"pulse","ch":n,"ms":500}
+  OP_INTERVAL,       // {"op":"interval","ch":n,"seconds":30,"enabled":true}
+  OP_STOP_INTERVAL,  // {"op":"stopInterval","ch":n}
+  OP_SCHEDULE,       // {"op":"schedule","ch":n,"times":["08:00",...]} replaces the list
+  OP_ADD_SCHEDULE,   // {"op":"addSchedule","ch":n,"time":"08:00"}
+  OP_CLEAR_SCHEDULE, // {"op":"clearSchedule","ch":n}
+  OP_RULES,          // {"op":"rules","ch":n,"rules":[{"start":"09:00",...},...]} replaces the list
+  OP_ADD_RULE,       // {"op":"addRule","ch":n,"rule":{"start":"09:00","end":"17:00","everyMin":30}}
+  OP_CLEAR_RULES,    // {"op":"clearRules","ch":n}
+  OP_GROUP_TRIGGER,  // {"op":"groupTrigger","group":g,"mask":0,"ms":0,"leadMs":250} fans out over the LAN
+  OP_UPDATE,         // {"op":"update","url":"http://...","md5":"...","staggerSec":600} pulls a firmware image
+  OP_COUNT
+};
+
+extern const char *const MQTT_OP_NAMES[OP_COUNT];
+
+// What the device accepts; the firmware fills it from its config and
+// section constants
+struct MqttLimits {
+  uint8_t channelCount = 1;
+  uint32_t groupDefaultLeadMs = 0;
+  uint32_t groupMaxLeadMs = 0;
+  size_t urlSize = 0;       // buffer for an update URL, NUL included
+  uint32_t maxStaggerSec = 0;
+};
+
+// OP_COUNT when "op" is missing or unknown
+uint8_t mqttOpType(JsonObjectConst op);
+
+// 32 hex digits, nothing else
+bool md5HexValid(const char *md5);
+
+// Checks one op against the limits and the ops before it; returns why it
+// is invalid, or nullptr. scheduleSizes and ruleSizes hold each channel's
+// current list lengths and are updated to what they will be after op.
+const char *mqttValidateOp(JsonObjectConst op, const MqttLimits &limits, size_t *scheduleSizes,
+                           size_t *ruleSizes);
+
+// Checks a whole batch's "ops" array, so nothing is applied unless every op
+// is valid. On failure index is the offending op, or ops.size() when the
+// array itself is wrong.
+const char *mqttValidateOps(JsonArrayConst ops, const MqttLimits &limits, size_t *scheduleSizes,
+                            size_t *ruleSizes, size_t &index);
+
+// A text command, optionally prefixed with "CH<n>:" to address channel n
+// (channel 0 otherwise):
+//   "TRIGGER" or "1"      trigger
+//   "TRIGGER_ALL"         trigger every channel at once
+//   "INTERVAL:x"          set the interval to x seconds and enable it
+//   "STOP_INTERVAL"       disable the interval
+//   "ADD_SCHEDULE:HH:MM"  add a daily time
+//   "CLEAR_SCHEDULE"      remove all daily times
+struct MqttTextCommand {
+  enum Kind : uint8_t { TRIGGER, TRIGGER_ALL, INTERVAL, STOP_INTERVAL, ADD_SCHEDULE, CLEAR_SCHEDULE };
+  Kind kind = TRIGGER;
+  uint8_t ch = 0;
+  uint32_t value = 0; // INTERVAL: seconds, ADD_SCHEDULE: minutes after midnight
+};
+
+// Parses length bytes of msg (not NUL-terminated, surrounding whitespace
+// ignored) into cmd; returns why it was rejected, or nullptr
+const char *mqttParseText(const char *msg, size_t length, uint8_t channelCount, MqttTextCommand &cmd);
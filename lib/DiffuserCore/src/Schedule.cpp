@@ -0,0 +1,230 @@
+#include "Schedule.h"
+#include <stdio.h>
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+int parseTimeToMinutes(const char *hhmm) {
+  // "H:MM" or "HH:MM", nothing else
+  const char *p = hhmm;
+  if (!isDigit(*p)) return -1;
+  int hh = *p++ - '0';
+  if (isDigit(*p)) hh = hh * 10 + (*p++ - '0');
+  if (*p++ != ':' || !isDigit(p[0]) || !isDigit(p[1]) || p[2] != '\0') return -1;
+  int mm = (p[0] - '0') * 10 + (p[1] - '0');
+  if (hh > 23 || mm > 59) return -1;
+  return hh * 60 + mm;
+}
+
+// H. Hinnant's algorithms, proleptic Gregorian
+int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  int32_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = (uint32_t)(y - era * 400);
+  uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+int32_t parseDate(const char *ymd) {
+  int y, m, d;
+  char tail;
+  if (sscanf(ymd, "%4d-%2d-%2d%c", &y, &m, &d, &tail) != 3) return -1;
+  if (y < 1970 || m < 1 || m > 12 || d < 1 || d > 31) return -1;
+  int32_t day = daysFromCivil(y, m, d);
+  if (day <= 0 || day > 0xFFFF) return -1;
+  // Reject dates like 02-30 by checking the round trip
+  int32_t cy;
+  uint32_t cm, cd;
+  civilFromDays(day, cy, cm, cd);
+  return cy == y && (int)cm == m && (int)cd == d ? day : -1;
+}
+
+void civilFromDays(int32_t day, int32_t &y, uint32_t &m, uint32_t &d) {
+  int32_t z = day + 719468;
+  int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  uint32_t doe = (uint32_t)(z - era * 146097);
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = (int32_t)yoe + era * 400 + (m <= 2);
+}
+
+// Writes the low n decimal digits of v, zero padded
+static void putDigits(char *out, uint32_t v, int n) {
+  while (n-- > 0) {
+    out[n] = (char)('0' + v % 10);
+    v /= 10;
+  }
+}
+
+void formatDate(uint16_t day, char *out) {
+  int32_t y;
+  uint32_t m, d;
+  civilFromDays(day, y, m, d);
+  putDigits(out, (uint32_t)y, 4); // 1970-2149 for a uint16_t day
+  out[4] = '-';
+  putDigits(out + 5, m, 2);
+  out[7] = '-';
+  putDigits(out + 8, d, 2);
+  out[10] = '\0';
+}
+
+int64_t localMsOfDay(int64_t epochMs, int32_t offsetMinutes) {
+  int64_t local = epochMs + (int64_t)offsetMinutes * 60000;
+  return ((local % 86400000) + 86400000) % 86400000;
+}
+
+int32_t localDay(int64_t epochMs, int32_t offsetMinutes) {
+  int64_t local = epochMs + (int64_t)offsetMinutes * 60000;
+  return (int32_t)((local - localMsOfDay(epochMs, offsetMinutes)) / 86400000);
+}
+
+uint8_t weekdayOfDay(int32_t day) {
+  return (uint8_t)(((day + 4) % 7 + 7) % 7); // 1970-01-01 was a Thursday
+}
+
+int ruleFirstFire(const ScheduleRule &r, int32_t day, int fromMin) {
+  if (!(r.weekdays & (1 << weekdayOfDay(day)))) return -1;
+  if ((r.fromDay && day < r.fromDay) || (r.toDay && day > r.toDay)) return -1;
+  if (fromMin <= r.startMin) return r.startMin;
+  if (r.periodMin == 0) return -1;
+  int k = (fromMin - r.startMin + r.periodMin - 1) / r.periodMin;
+  int m = r.startMin + k * r.periodMin;
+  return m <= r.endMin ? m : -1;
+}
+
+static bool ruleBefore(const CompiledSchedule &sc, uint8_t a, uint8_t b) {
+  return sc.rules[sc.heap[a]].next < sc.rules[sc.heap[b]].next;
+}
+
+static void heapSwap(CompiledSchedule &sc, uint8_t a, uint8_t b) {
+  uint8_t t = sc.heap[a];
+  sc.heap[a] = sc.heap[b];
+  sc.heap[b] = t;
+}
+
+static void heapSiftUp(CompiledSchedule &sc, uint8_t i) {
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if (!ruleBefore(sc, i, parent)) break;
+    heapSwap(sc, i, parent);
+    i = parent;
+  }
+}
+
+static void heapSiftDown(CompiledSchedule &sc, uint8_t i) {
+  for (;;) {
+    uint8_t l = 2 * i + 1, r = l + 1, m = i;
+    if (l < sc.ruleCount && ruleBefore(sc, l, m)) m = l;
+    if (r < sc.ruleCount && ruleBefore(sc, r, m)) m = r;
+    if (m == i) break;
+    heapSwap(sc, i, m);
+    i = m;
+  }
+}
+
+// Moves the rule at the top of the heap to its next fire at or after
+// fromMin, or removes it when it has none left today
+static void heapAdvanceTop(CompiledSchedule &sc, int fromMin) {
+  CompiledRule &r = sc.rules[sc.heap[0]];
+  int next = -1;
+  if (r.period > 0) {
+    int k = fromMin > r.next ? (fromMin - r.next + r.period - 1) / r.period : 1;
+    next = r.next + k * r.period;
+  }
+  if (next >= 0 && next <= r.end) {
+    r.next = (uint16_t)next;
+  } else {
+    sc.heap[0] = sc.heap[--sc.ruleCount];
+  }
+  heapSiftDown(sc, 0);
+}
+
+void scheduleClear(CompiledSchedule &sc) {
+  sc.count = 0;
+  sc.next = 0;
+  sc.ruleCount = 0;
+}
+
+bool scheduleInsert(CompiledSchedule &sc, uint16_t minute) {
+  if (sc.count >= MAX_SCHEDULE_ENTRIES) return false;
+  // insertion sort; the table is small and rebuilt rarely
+  int i = sc.count++;
+  while (i > 0 && sc.minutes[i - 1] > minute) {
+    sc.minutes[i] = sc.minutes[i - 1];
+    i--;
+  }
+  sc.minutes[i] = minute;
+  return true;
+}
+
+void scheduleStartDay(CompiledSchedule &sc, const ScheduleRule *rules, size_t ruleCount, int32_t day,
+                      int currentMin) {
+  sc.next = 0;
+  sc.ruleCount = 0;
+  for (size_t i = 0; i < ruleCount && i < MAX_SCHEDULE_RULES; i++) {
+    int first = ruleFirstFire(rules[i], day, 0);
+    if (first < 0) continue;
+    CompiledRule &c = sc.rules[i];
+    c.next = (uint16_t)first;
+    c.end = rules[i].periodMin ? rules[i].endMin : rules[i].startMin;
+    c.period = rules[i].periodMin;
+    c.durationMs = rules[i].durationMs;
+    sc.heap[sc.ruleCount] = (uint8_t)i;
+    heapSiftUp(sc, sc.ruleCount++);
+  }
+  scheduleSkipTo(sc, currentMin);
+}
+
+void scheduleSkipTo(CompiledSchedule &sc, int fromMin) {
+  while (sc.next < sc.count && sc.minutes[sc.next] < fromMin) {
+    sc.next++;
+  }
+  while (sc.ruleCount > 0 && sc.rules[sc.heap[0]].next < fromMin) {
+    heapAdvanceTop(sc, fromMin);
+  }
+}
+
+bool schedulePopDue(CompiledSchedule &sc, int fromMin, int currentMin, uint32_t &durationMs) {
+  scheduleSkipTo(sc, fromMin);
+  bool timeDue = sc.next < sc.count && sc.minutes[sc.next] <= currentMin;
+  bool ruleDue = sc.ruleCount > 0 && sc.rules[sc.heap[0]].next <= currentMin;
+  // Earliest first, so catch-up fires in order
+  if (timeDue && (!ruleDue || sc.minutes[sc.next] <= sc.rules[sc.heap[0]].next)) {
+    sc.next++;
+    durationMs = 0;
+    return true;
+  }
+  if (ruleDue) {
+    durationMs = sc.rules[sc.heap[0]].durationMs;
+    heapAdvanceTop(sc, currentMin + 1);
+    return true;
+  }
+  return false;
+}
+
+int scheduleNextMin(const CompiledSchedule &sc) {
+  int next = sc.next < sc.count ? sc.minutes[sc.next] : -1;
+  if (sc.ruleCount > 0 && (next < 0 || sc.rules[sc.heap[0]].next < next)) next = sc.rules[sc.heap[0]].next;
+  return next;
+}
+
+int scheduleFirstFireOfDay(const CompiledSchedule &sc, const ScheduleRule *rules, size_t ruleCount,
+                           int32_t day) {
+  int first = sc.count > 0 ? sc.minutes[0] : -1;
+  for (size_t i = 0; i < ruleCount && i < MAX_SCHEDULE_RULES; i++) {
+    int m = ruleFirstFire(rules[i], day, 0);
+    if (m >= 0 && (first < 0 || m < first)) first = m;
+  }
+  return first;
+}
+
+uint32_t intervalNextDeadline(uint32_t prev, uint32_t period, uint32_t now) {
+  uint32_t next = prev + period;
+  if ((int32_t)(next - now) <= 0) next = now + period;
+  return next;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Upper bound on daily schedule entries per channel; keeps the compiled
+// table fixed-size
+static const size_t MAX_SCHEDULE_ENTRIES = 64;
+
+// Upper bound on schedule rules per channel
+static const size_t MAX_SCHEDULE_RULES = 16;
+
+// Fires every periodMin minutes from startMin through endMin on the
+// weekdays in the mask, optionally only between two dates. A rule with
+// periodMin 0 fires once, at startMin.
+struct ScheduleRule {
+  uint16_t startMin = 0;   // minutes after local midnight
+  uint16_t endMin = 0;     // last minute a repeat may fall on, inclusive
+  uint16_t periodMin = 0;  // 0 = once
+  uint8_t weekdays = 0x7F; // bit 0 = Sunday ... bit 6 = Saturday
+  uint32_t durationMs = 0; // 0 = the channel's pulse duration
+  uint16_t fromDay = 0;    // first active date, days since 1970-01-01; 0 = no bound
+  uint16_t toDay = 0;      // last active date, inclusive; 0 = no bound
+};
+
+// A rule's fires left today
+struct CompiledRule {
+  uint16_t next;   // next fire, minutes after midnight
+  uint16_t end;
+  uint16_t period; // 0 = no more after next
+  uint32_t durationMs;
+};
+
+// One channel's schedule for the current local day: the plain daily times
+// as a sorted minute table with a cursor, and today's active rules in a
+// min-heap on their next fire. Rebuilt on every schedule mutation and at
+// midnight, so the check never parses and costs O(log rules) per fire.
+struct CompiledSchedule {
+  uint16_t minutes[MAX_SCHEDULE_ENTRIES];
+  uint8_t count = 0;
+  uint8_t next = 0; // first entry not yet due today
+  CompiledRule rules[MAX_SCHEDULE_RULES];
+  uint8_t heap[MAX_SCHEDULE_RULES]; // indices into rules, earliest next first
+  uint8_t ruleCount = 0;            // rules with fires left today
+};
+
+// "H:MM" or "HH:MM" to minutes since midnight, -1 when invalid or followed
+// by anything
+int parseTimeToMinutes(const char *hhmm);
+
+// Days since 1970-01-01 for a date, and back
+int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d);
+void civilFromDays(int32_t day, int32_t &y, uint32_t &m, uint32_t &d);
+
+// "YYYY-MM-DD" to days since 1970-01-01, -1 when invalid or out of range
+int32_t parseDate(const char *ymd);
+
+// Writes days since 1970-01-01 as "YYYY-MM-DD" (11 bytes with the NUL)
+void formatDate(uint16_t day, char *out);
+
+// Local wall-clock milliseconds since midnight for a UTC epoch time
+int64_t localMsOfDay(int64_t epochMs, int32_t offsetMinutes);
+
+// Local days since 1970-01-01 and weekday (0 = Sunday) for a UTC epoch time
+int32_t localDay(int64_t epochMs, int32_t offsetMinutes);
+uint8_t weekdayOfDay(int32_t day);
+
+// First fire of r at or after fromMin on the given local day, -1 when the
+// rule does not fire then
+int ruleFirstFire(const ScheduleRule &r, int32_t day, int fromMin);
+
+void scheduleClear(CompiledSchedule &sc);
+
+// Inserts one plain time in order; false when the table is full
+bool scheduleInsert(CompiledSchedule &sc, uint16_t minute);
+
+// Starts a day: positions the time cursor and loads the rules active on
+// day, each at its first fire at or after currentMin. Earlier fires are
+// skipped for the rest of the day.
+void scheduleStartDay(CompiledSchedule &sc, const ScheduleRule *rules, size_t ruleCount, int32_t day,
+                      int currentMin);
+
+// Drops every fire before fromMin, without firing it
+void scheduleSkipTo(CompiledSchedule &sc, int fromMin);
+
+// Takes one fire due from fromMin through currentMin; call until it returns
+// false. Fires before fromMin are dropped. A rule crossed several times in
+// the range fires once. durationMs is the rule's pulse duration, 0 for the
+// channel's.
+bool schedulePopDue(CompiledSchedule &sc, int fromMin, int currentMin, uint32_t &durationMs);
+
+// Minute of the next fire today, -1 when none is left
+int scheduleNextMin(const CompiledSchedule &sc);
+
+// Earliest fire of a whole day from its first minute, -1 when none;
+// used to look into tomorrow
+int scheduleFirstFireOfDay(const CompiledSchedule &sc, const ScheduleRule *rules, size_t ruleCount,
+                           int32_t day);
+
+// Longest interval period in seconds. Timer deadlines compare by signed
+// 32-bit millis() distance, so a period must stay below 2^31 ms (~24.8 days).
+static const uint32_t MAX_INTERVAL_SECONDS = INT32_MAX / 1000;
+
+// Next deadline of a periodic timer: advances from the previous deadline so
+// the period does not drift with dispatch latency, or restarts from now if
+// a whole period was missed
+uint32_t intervalNextDeadline(uint32_t prev, uint32_t period, uint32_t now);
@@ -0,0 +1,39 @@
+#include "ScheduleJson.h"
+
+// Days since 1970 for an optional "YYYY-MM-DD" value: 0 when absent, -1
+// when invalid
+static int32_t ruleDateFromJson(JsonVariantConst v) {
+  if (v.isNull()) return 0;
+  return v.is<const char *>() ? parseDate(v.as<const char *>()) : -1;
+}
+
+const char *scheduleRuleFromJson(JsonVariantConst v, ScheduleRule &r) {
+  if (!v.is<JsonObjectConst>()) return "rule must be an object";
+  JsonObjectConst obj = v.as<JsonObjectConst>();
+  int start = obj["start"].is<const char *>() ? parseTimeToMinutes(obj["start"].as<const char *>()) : -1;
+  if (start < 0) return "rule start must be HH:MM";
+  int end = start;
+  if (!obj["end"].isNull()) {
+    end = obj["end"].is<const char *>() ? parseTimeToMinutes(obj["end"].as<const char *>()) : -1;
+    if (end < start) return "rule end must be HH:MM, not before start";
+  }
+  long every = obj["everyMin"] | 0L;
+  if (every < 0 || every > 1439) return "rule everyMin out of range";
+  long weekdays = obj["weekdays"] | 0x7FL;
+  if (weekdays < 1 || weekdays > 0x7F) return "rule weekdays must be a mask of 1-127";
+  long duration = obj["durationMs"] | 0L;
+  if (duration < 0 || duration > 600000) return "rule durationMs out of range";
+  int32_t from = ruleDateFromJson(obj["from"]);
+  if (from < 0) return "rule from must be YYYY-MM-DD";
+  int32_t to = ruleDateFromJson(obj["to"]);
+  if (to < 0) return "rule to must be YYYY-MM-DD";
+  if (from && to && to < from) return "rule to is before from";
+  r.startMin = (uint16_t)start;
+  r.endMin = (uint16_t)end;
+  r.periodMin = (uint16_t)every;
+  r.weekdays = (uint8_t)weekdays;
+  r.durationMs = (uint32_t)duration;
+  r.fromDay = (uint16_t)from;
+  r.toDay = (uint16_t)to;
+  return nullptr;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <ArduinoJson.h>
+#include "Schedule.h"
+
+// Parses one rule object into r; returns why it is invalid, or nullptr.
+// "start" is required; "end" defaults to "start", "everyMin" to 0 (once),
+// "weekdays" to every day (bit 0 = Sunday) and "durationMs" to 0 (the
+// channel's duration). "from"/"to" are optional "YYYY-MM-DD" bounds.
+const char *scheduleRuleFromJson(JsonVariantConst v, ScheduleRule &r);
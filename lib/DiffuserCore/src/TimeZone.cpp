@@ -0,0 +1,193 @@
+#include "TimeZone.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include "Schedule.h"
+
+static const int64_t MS_PER_DAY = 86400000;
+
+// Zone name: three or more letters, or anything in <...>
+static bool parseName(const char *&p) {
+  const char *start = p;
+  if (*p == '<') {
+    while (*p && *p != '>') p++;
+    if (*p != '>') return false;
+    p++;
+    return p - start >= 5;
+  }
+  while (isalpha((unsigned char)*p)) p++;
+  return p - start >= 3;
+}
+
+// [+|-]hh[:mm[:ss]] in seconds
+static bool parseTime(const char *&p, int32_t &sec) {
+  int sign = 1;
+  if (*p == '+' || *p == '-') sign = *p++ == '-' ? -1 : 1;
+  if (!isdigit((unsigned char)*p)) return false;
+  char *end;
+  long hh = strtol(p, &end, 10);
+  p = end;
+  long mm = 0, ss = 0;
+  if (*p == ':') {
+    mm = strtol(p + 1, &end, 10);
+    p = end;
+    if (*p == ':') {
+      ss = strtol(p + 1, &end, 10);
+      p = end;
+    }
+  }
+  if (hh > 167 || mm > 59 || ss > 59) return false;
+  sec = sign * (int32_t)(hh * 3600 + mm * 60 + ss);
+  return true;
+}
+
+static bool parseNumber(const char *&p, long lo, long hi, long &out) {
+  if (!isdigit((unsigned char)*p)) return false;
+  char *end;
+  out = strtol(p, &end, 10);
+  p = end;
+  return out >= lo && out <= hi;
+}
+
+// Mm.w.d, Jn or n, then an optional /time
+static bool parseRule(const char *&p, TzRule &r) {
+  long a, b, c;
+  if (*p == 'M') {
+    p++;
+    if (!parseNumber(p, 1, 12, a) || *p++ != '.' || !parseNumber(p, 1, 5, b) || *p++ != '.' ||
+        !parseNumber(p, 0, 6, c)) {
+      return false;
+    }
+    r.kind = TzRule::MONTH_WEEK_DAY;
+    r.month = (uint8_t)a;
+    r.week = (uint8_t)b;
+    r.weekday = (uint8_t)c;
+  } else if (*p == 'J') {
+    p++;
+    if (!parseNumber(p, 1, 365, a)) return false;
+    r.kind = TzRule::JULIAN_NO_LEAP;
+    r.day = (uint16_t)a;
+  } else {
+    if (!parseNumber(p, 0, 365, a)) return false;
+    r.kind = TzRule::DAY_OF_YEAR;
+    r.day = (uint16_t)a;
+  }
+  r.timeSec = 7200;
+  if (*p == '/') {
+    p++;
+    return parseTime(p, r.timeSec);
+  }
+  return true;
+}
+
+bool parsePosixTz(const char *tz, PosixTz &out) {
+  PosixTz z;
+  const char *p = tz;
+  int32_t sec;
+  if (!parseName(p) || !parseTime(p, sec)) return false;
+  z.stdOffsetMin = -sec / 60;
+  if (*p) {
+    if (!parseName(p)) return false;
+    z.hasDst = true;
+    z.dstOffsetMin = z.stdOffsetMin + 60;
+    if (*p && *p != ',') {
+      if (!parseTime(p, sec)) return false;
+      z.dstOffsetMin = -sec / 60;
+    }
+    if (*p == ',') {
+      p++;
+      if (!parseRule(p, z.dstStart) || *p++ != ',' || !parseRule(p, z.dstEnd)) return false;
+    } else {
+      // US rules: second Sunday of March to first Sunday of November
+      z.dstStart.month = 3;
+      z.dstStart.week = 2;
+      z.dstEnd.month = 11;
+      z.dstEnd.week = 1;
+    }
+  }
+  if (*p) return false;
+  out = z;
+  return true;
+}
+
+static bool isLeap(int32_t y) {
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+// Local day (days since 1970) the rule falls on in year
+static int32_t ruleDay(const TzRule &r, int32_t year) {
+  int32_t jan1 = daysFromCivil(year, 1, 1);
+  switch (r.kind) {
+    case TzRule::JULIAN_NO_LEAP:
+      return jan1 + r.day - 1 + (isLeap(year) && r.day >= 60 ? 1 : 0);
+    case TzRule::DAY_OF_YEAR:
+      return jan1 + r.day;
+    default: {
+      int32_t first = daysFromCivil(year, r.month, 1);
+      int32_t day = first + (r.weekday - weekdayOfDay(first) + 7) % 7 + (r.week - 1) * 7;
+      int32_t nextMonth = r.month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, r.month + 1, 1);
+      while (day >= nextMonth) day -= 7; // week 5 = last
+      return day;
+    }
+  }
+}
+
+// UTC instant of a transition: the rule's time is local time in the offset
+// in force before it
+static int64_t ruleInstant(const TzRule &r, int32_t year, int32_t offsetBeforeMin) {
+  return ruleDay(r, year) * MS_PER_DAY + (int64_t)r.timeSec * 1000 - (int64_t)offsetBeforeMin * 60000;
+}
+
+void tzTableBuild(TzTable &t, const PosixTz &tz, int32_t year) {
+  t.tz = tz;
+  t.fromMs = daysFromCivil(year, 1, 1) * MS_PER_DAY;
+  t.untilMs = daysFromCivil(year + 2, 1, 1) * MS_PER_DAY;
+  t.initialOffsetMin = tz.stdOffsetMin;
+  t.count = 0;
+  if (!tz.hasDst) return;
+  for (int32_t y = year; y <= year + 1; y++) {
+    int64_t start = ruleInstant(tz.dstStart, y, tz.stdOffsetMin);
+    int64_t end = ruleInstant(tz.dstEnd, y, tz.dstOffsetMin);
+    // Southern zones end DST before they start it within a year
+    bool startFirst = start < end;
+    t.atMs[t.count] = startFirst ? start : end;
+    t.offsetMin[t.count++] = startFirst ? tz.dstOffsetMin : tz.stdOffsetMin;
+    t.atMs[t.count] = startFirst ? end : start;
+    t.offsetMin[t.count++] = startFirst ? tz.stdOffsetMin : tz.dstOffsetMin;
+  }
+  // Before the year's first transition the opposite offset is in force
+  t.initialOffsetMin = t.offsetMin[0] == tz.dstOffsetMin ? tz.stdOffsetMin : tz.dstOffsetMin;
+}
+
+void tzTableLoad(TzTable &t, const PosixTz &tz) {
+  t.tz = tz;
+  t.fromMs = t.untilMs = 0;
+  t.count = 0;
+}
+
+static void tzTableCover(TzTable &t, int64_t epochMs) {
+  if (epochMs >= t.fromMs && epochMs < t.untilMs) return;
+  int32_t y;
+  uint32_t m, d;
+  int64_t day = epochMs >= 0 ? epochMs / MS_PER_DAY : (epochMs - MS_PER_DAY + 1) / MS_PER_DAY;
+  civilFromDays((int32_t)day, y, m, d);
+  tzTableBuild(t, t.tz, y);
+}
+
+int32_t tzOffsetMinutes(TzTable &t, int64_t epochMs) {
+  tzTableCover(t, epochMs);
+  int32_t offset = t.initialOffsetMin;
+  for (uint8_t i = 0; i < t.count && t.atMs[i] <= epochMs; i++) offset = t.offsetMin[i];
+  return offset;
+}
+
+int64_t tzNextTransition(TzTable &t, int64_t epochMs) {
+  if (!t.tz.hasDst) return INT64_MAX;
+  tzTableCover(t, epochMs);
+  for (uint8_t i = 0; i < t.count; i++) {
+    if (t.atMs[i] > epochMs) return t.atMs[i];
+  }
+  // Past the last one in the span: the first of the following year
+  TzTable next = t;
+  tzTableCover(next, t.untilMs);
+  return next.atMs[0];
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+// When a DST change happens: the local wall-clock time (seconds after
+// midnight, may be negative or past 24 h) on a day given by one of the
+// POSIX forms
+struct TzRule {
+  enum Kind : uint8_t { MONTH_WEEK_DAY, JULIAN_NO_LEAP, DAY_OF_YEAR };
+  Kind kind = MONTH_WEEK_DAY;
+  uint8_t month = 0;   // Mm.w.d: 1-12
+  uint8_t week = 0;    // 1-5, 5 = last
+  uint8_t weekday = 0; // 0 = Sunday
+  uint16_t day = 0;    // Jn: 1-365, Feb 29 never counted; n: 0-365
+  int32_t timeSec = 7200;
+};
+
+// A POSIX TZ string such as "CET-1CEST,M3.5.0,M10.5.0/3". Offsets are
+// stored east-positive (local = UTC + offset), the opposite of the string.
+struct PosixTz {
+  int32_t stdOffsetMin = 0;
+  int32_t dstOffsetMin = 0;
+  bool hasDst = false;
+  TzRule dstStart;
+  TzRule dstEnd;
+};
+
+// False when tz is not a POSIX TZ string; out is then unchanged. A DST
+// name without rules gets the US rules, like glibc.
+bool parsePosixTz(const char *tz, PosixTz &out);
+
+// The offset a zone has at a time; UTC instants for the transitions of
+// two calendar years are worked out once, so converting a time is a scan
+// of at most four entries
+struct TzTable {
+  static const uint8_t MAX_TRANSITIONS = 4;
+  PosixTz tz;
+  int64_t fromMs = 0;  // covered span, UTC; rebuilt when a time falls outside
+  int64_t untilMs = 0;
+  int32_t initialOffsetMin = 0; // in force at fromMs
+  uint8_t count = 0;
+  int64_t atMs[MAX_TRANSITIONS];         // ascending
+  int32_t offsetMin[MAX_TRANSITIONS];    // in force from atMs[i]
+};
+
+// Loads tz; the transitions are worked out on the first lookup
+void tzTableLoad(TzTable &t, const PosixTz &tz);
+
+// Loads tz and computes the transitions of year and year + 1
+void tzTableBuild(TzTable &t, const PosixTz &tz, int32_t year);
+
+// Offset from UTC in minutes at epochMs; rebuilds the table for the
+// year of epochMs when it is outside the covered span
+int32_t tzOffsetMinutes(TzTable &t, int64_t epochMs);
+
+// First transition after epochMs, INT64_MAX when the zone has none
+int64_t tzNextTransition(TzTable &t, int64_t epochMs);
@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include "DiffuserClock.h"
+
+// Deadlines for up to N events in a min-heap keyed on Clock::millis().
+// Events are small integers; each one is either armed once or not at all.
+// millis() wraps every ~49 days, so deadlines compare by signed distance.
+template <uint8_t N>
+class TimerHeap {
+public:
+  static const uint8_t NONE = N; // returned by popDue() when nothing is due
+
+  explicit TimerHeap(const Clock &clock) : _clock(clock) {
+    for (uint8_t i = 0; i < N; i++) {
+      _pos[i] = -1;
+      _maxLateMs[i] = 0;
+    }
+  }
+
+  void cancel(uint8_t evt) {
+    int8_t i = _pos[evt];
+    if (i < 0) return;
+    _size--;
+    if (i != _size) {
+      swap(i, _size);
+      siftDown(i);
+      siftUp(i);
+    }
+    _pos[evt] = -1;
+  }
+
+  // Arm (or re-arm) an event at an absolute millis() deadline
+  void arm(uint8_t evt, uint32_t at) {
+    cancel(evt);
+    _deadline[evt] = at;
+    uint8_t i = _size++;
+    _heap[i] = evt;
+    _pos[evt] = i;
+    siftUp(i);
+  }
+
+  void armIn(uint8_t evt, uint32_t ms) { arm(evt, _clock.millis() + ms); }
+
+  bool armed(uint8_t evt) const { return _pos[evt] >= 0; }
+  uint32_t deadline(uint8_t evt) const { return _deadline[evt]; }
+  uint32_t maxLateMs(uint8_t evt) const { return _maxLateMs[evt]; } // worst dispatch lateness seen
+  uint32_t lateUpdates() const { return _lateUpdates; }              // times any maxLateMs grew
+  uint8_t size() const { return _size; }
+
+  // Pops the earliest event if it is due, NONE otherwise
+  uint8_t popDue(uint32_t now) {
+    if (_size == 0) return NONE;
+    uint8_t evt = _heap[0];
+    int32_t late = (int32_t)(now - _deadline[evt]);
+    if (late < 0) return NONE;
+    if ((uint32_t)late > _maxLateMs[evt]) {
+      _maxLateMs[evt] = late;
+      _lateUpdates++;
+    }
+    cancel(evt);
+    return evt;
+  }
+
+  // Milliseconds until the earliest deadline, bounded by cap
+  uint32_t msUntilNext(uint32_t now, uint32_t cap) const {
+    if (_size == 0) return cap;
+    int32_t wait = (int32_t)(_deadline[_heap[0]] - now);
+    if (wait <= 0) return 0;
+    return (uint32_t)wait < cap ? (uint32_t)wait : cap;
+  }
+
+private:
+  bool before(uint8_t a, uint8_t b) const { return (int32_t)(_deadline[a] - _deadline[b]) < 0; }
+
+  void swap(uint8_t i, uint8_t j) {
+    uint8_t t = _heap[i];
+    _heap[i] = _heap[j];
+    _heap[j] = t;
+    _pos[_heap[i]] = i;
+    _pos[_heap[j]] = j;
+  }
+
+  void siftUp(uint8_t i) {
+    while (i > 0) {
+      uint8_t parent = (i - 1) / 2;
+      if (!before(_heap[i], _heap[parent])) break;
+      swap(i, parent);
+      i = parent;
+    }
+  }
+
+  void siftDown(uint8_t i) {
+    for (;;) {
+      uint8_t l = 2 * i + 1, r = l + 1, m = i;
+      if (l < _size && before(_heap[l], _heap[m])) m = l;
+      if (r < _size && before(_heap[r], _heap[m])) m = r;
+      if (m == i) break;
+      swap(i, m);
+      i = m;
+    }
+  }
+
+  const Clock &_clock;
+  uint32_t _deadline[N];
+  int8_t _pos[N];   // slot in _heap, -1 when not armed
+  uint8_t _heap[N];
+  uint8_t _size = 0;
+  uint32_t _maxLateMs[N];
+  uint32_t _lateUpdates = 0;
+};
@@ -1,654 +1,5649 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
+#include <ESP8266mDNS.h>
+#include <ESP8266httpUpdate.h>
+#include <ArduinoOTA.h>
+#include <Updater.h>
+#include <WiFiUdp.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <WiFiManager.h>
 #include <PubSubClient.h>
 #include <time.h>
+#include <coredecls.h>
+#include <lwip/dns.h>
+#include <new>
 #include <vector>
 
+#include <DiffuserClock.h>
+#include <DiffuserGpio.h>
+#include <MqttCommand.h>
+#include <Schedule.h>
+#include <ScheduleJson.h>
+#include <TimeZone.h>
+#include <TimerHeap.h>
+
+#include "web_assets.h"
+
 // ================== Configuration model ==================
-struct AppConfig {
-  int triggerPin = 5; // GPIO5 (D1) default
-  bool triggerActiveHigh = true;
-  uint32_t triggerDurationMs = 1000;
+// One controller drives up to MAX_CHANNELS diffusers. Each channel has its
+// own output pin, pulse, interval and daily schedule; everything else is
+// shared.
+static const uint8_t MAX_CHANNELS = 8;
 
-  String mqttHost = "";
-  uint16_t mqttPort = 1883;
-  String mqttUser = "";
-  String mqttPass = "";
-  String mqttTopic = "diffuser/trigger";
+// Pins a new channel starts on: D1, D2, D5, D6, D7, D0, D3, D4
+static const int CHANNEL_DEFAULT_PINS[MAX_CHANNELS] = {5, 4, 14, 12, 13, 16, 0, 2};
+
+// What happens to a trigger for a channel that is already pulsing, see
+// triggerQueueService()
+enum TriggerPolicy : uint8_t {
+  TRIGGER_POLICY_DROP,
+  TRIGGER_POLICY_COALESCE,
+  TRIGGER_POLICY_QUEUE,
+  TRIGGER_POLICY_COUNT
+};
+
+static const char *const TRIGGER_POLICY_NAMES[TRIGGER_POLICY_COUNT] = {"drop", "coalesce", "queue"};
+
+// Multicast trigger groups a device can belong to, see groupAccept()
+static const uint8_t MAX_GROUPS = 8;
+
+// Capacity of the config's string fields, NUL included. Inline arrays, so
+// editing the config never touches the heap.
+static const size_t MQTT_HOST_SIZE = 64;
+static const size_t MQTT_CRED_SIZE = 64; // user and password
+static const size_t MQTT_TOPIC_SIZE = 64;
+static const size_t TIMEZONE_SIZE = 64;
+
+struct ChannelConfig {
+  int pin = 5;
+  bool activeHigh = true;
+  uint32_t durationMs = 1000;
 
   uint32_t intervalSeconds = 0;
   bool intervalEnabled = false;
 
-  int timezoneOffsetMinutes = 0; // offset from UTC in minutes
+  // Daily times as minutes after midnight, in the order they were added;
+  // exported as ["08:00","12:30","18:45"]
+  uint16_t scheduleMinutes[MAX_SCHEDULE_ENTRIES];
+  uint8_t scheduleCount = 0;
+
+  // Weekday/date-bounded repeat windows, on top of the plain times
+  std::vector<ScheduleRule> scheduleRules;
+};
+
+struct AppConfig {
+  uint8_t channelCount = 1;
+  ChannelConfig channels[MAX_CHANNELS];
+
+  char mqttHost[MQTT_HOST_SIZE] = "";
+  uint16_t mqttPort = 1883;
+  char mqttUser[MQTT_CRED_SIZE] = "";
+  char mqttPass[MQTT_CRED_SIZE] = "";
+  char mqttTopic[MQTT_TOPIC_SIZE] = "diffuser/trigger";
+  uint16_t metricsPublishSec = 0; // publish /api/metrics JSON to <topic>/metrics this often; 0 = off
+
+  uint8_t triggerPolicy = TRIGGER_POLICY_DROP;
+
+  std::vector<uint16_t> groups; // LAN trigger groups this device fires for, 1-65535
+  bool groupLeader = false;     // sends the clock beacon the other members follow
+
+  uint16_t scheduleCatchUpSec = 120; // entries missed by up to this long still fire; 0 = current minute only
+
+  int timezoneOffsetMinutes = 0; // offset from UTC in minutes, used when timezone is empty
+  char timezone[TIMEZONE_SIZE] = ""; // POSIX TZ with DST rules, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+
+  // WiFi power saving, see applyPowerMode()
+  uint8_t powerMode = 0;          // 0 = always on, 1 = modem sleep, 2 = light sleep
+  uint8_t listenInterval = 3;     // DTIM periods between wakeups in modem/light sleep
+  uint32_t deepSleepMinGapSec = 0; // deep sleep when the next event is this far away; 0 = never
+
+  // Heap watchdog, see heapWatchService(): a planned restart when the heap degrades
+  uint16_t heapMinBlock = 4096; // restart when the largest free block stays below this; 0 = off
+  uint8_t heapMaxFrag = 0;      // or when fragmentation stays above this percent; 0 = off
+
+  bool wifiFastReconnect = true; // rejoin the cached BSSID/channel/IP before falling back to WiFiManager
+
+  char otaPassword[MQTT_CRED_SIZE] = ""; // ArduinoOTA and /api/update; both are off while empty
+
+  AppConfig() {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) channels[i].pin = CHANNEL_DEFAULT_PINS[i];
+    groups.reserve(MAX_GROUPS);
+  }
+};
+
+AppConfig config;
+
+// Back to the defaults in place; a temporary AppConfig is large for the
+// 4 KB loop stack
+static void resetConfig(AppConfig &cfg) {
+  cfg.~AppConfig();
+  new (&cfg) AppConfig();
+}
+
+// Appends a daily time; false when the schedule is full
+static bool scheduleAddMinute(ChannelConfig &c, uint16_t minute) {
+  if (c.scheduleCount >= MAX_SCHEDULE_ENTRIES) return false;
+  c.scheduleMinutes[c.scheduleCount++] = minute;
+  return true;
+}
+
+static void scheduleRemoveAt(ChannelConfig &c, uint8_t idx) {
+  if (idx >= c.scheduleCount) return;
+  memmove(&c.scheduleMinutes[idx], &c.scheduleMinutes[idx + 1], (c.scheduleCount - idx - 1) * sizeof(uint16_t));
+  c.scheduleCount--;
+}
+
+// ================== Globals ==================
+ESP8266WebServer server(80);
+WiFiClient wifiClient;
+PubSubClient mqttClient(wifiClient);
+bool safeMode = false; // crashed boots in a row; outputs stay off, see the OTA section
+
+// NTP sync health. Each SNTP update is noted by the settimeofday callback
+// and folded in by timeSyncService(); between updates wall time is the
+// last synced epoch plus the millis() elapsed, corrected for the drift
+// measured between the last two syncs.
+struct TimeSync {
+  bool valid = false;       // at least one sync since boot
+  bool pending = false;     // callback ran, not folded in yet
+  int64_t pendingEpochMs = 0;
+  uint32_t pendingMillis = 0;
+  int64_t baseEpochMs = 0;  // UTC at baseMillis
+  uint32_t baseMillis = 0;
+  int64_t lastSyncEpochMs = 0;
+  uint32_t lastSyncMillis = 0;
+  int32_t lastStepMs = 0;   // NTP minus our extrapolation at the last sync
+  int32_t driftPpm = 0;     // millis() rate error, positive = running slow
+  uint32_t syncs = 0;
+  uint32_t requests = 0;    // configTime() calls
+  uint32_t missed = 0;      // resyncs that found no update since the previous one
+  uint32_t syncsAtRequest = 0;
+};
+TimeSync timeSync;
+
+static const int32_t TIME_DRIFT_MAX_PPM = 500;             // beyond this the measurement is an NTP step
+static const uint32_t TIME_DRIFT_MIN_SPAN_MS = 10UL * 60000UL; // shorter spans are too noisy to measure drift
+static const uint32_t TIME_STEP_RECHECK_MS = 1000;         // steps larger than this re-run the schedule check
+
+static int64_t timeSyncExtrapolate(uint32_t nowMillis) {
+  uint32_t elapsed = nowMillis - timeSync.baseMillis;
+  return timeSync.baseEpochMs + elapsed + (int64_t)elapsed * timeSync.driftPpm / 1000000;
+}
+
+// The scheduling core (lib/DiffuserCore) reads time and drives pins only
+// through these, so it also builds and runs on the host
+class ArduinoClock : public Clock {
+public:
+  uint32_t millis() const override { return ::millis(); }
+  uint32_t micros() const override { return ::micros(); }
+  // 0 until the first NTP sync
+  int64_t epochMs() const override { return timeSync.valid ? timeSyncExtrapolate(::millis()) : 0; }
+};
+ArduinoClock systemClock;
+
+class ArduinoGpio : public Gpio {
+public:
+  void output(uint8_t pin) override { pinMode(pin, OUTPUT); }
+  void write(uint8_t pin, bool high) override { digitalWrite(pin, high ? HIGH : LOW); }
+};
+ArduinoGpio gpio;
+
+// Local day and the latest local minute the compiled schedules have been
+// checked for, and the UTC offset at that check; see onScheduleTimer()
+int32_t scheduleDay = -1;
+int scheduleHighMin = -1;
+int32_t scheduleOffsetMin = 0;
+int64_t scheduleLastEvalMs = 0;
+int32_t scheduleLoadedDay = -1; // local day the compiled tables hold, -1 = none yet
+uint32_t scheduleCaughtUp = 0; // fires that ran late, for an earlier minute
+
+// Compiled per-channel tables, see Schedule.h
+CompiledSchedule schedules[MAX_CHANNELS];
+
+// ================== Event timers ==================
+// Every timed action in loop() is a deadline in one small min-heap keyed on
+// millis(). loop() dispatches what is due and then idles until the next one.
+enum TimerEvent : uint8_t {
+  EVT_PULSE_OFF,
+  EVT_SCHEDULE,       // shared by all channels
+  EVT_MQTT_RECONNECT,
+  EVT_NTP_RESYNC,
+  EVT_CONFIG_SAVE,
+  EVT_MQTT_STATE,     // rate-limited publish of changed state topics
+  EVT_METRICS_PUBLISH,
+  EVT_SSE_PING,       // keep-alive for /api/events streams
+  EVT_GROUP_START,    // earliest pending group trigger
+  EVT_GROUP_BEACON,   // leader clock beacon
+  EVT_HEAP_SAMPLE,    // heap watchdog sample
+  EVT_OTA_CHECK,      // OTA window, pending pull and boot health
+  EVT_EVENT_LOG_FLUSH, // writes the batched trigger event records
+  EVT_INTERVAL,       // one per channel: EVT_INTERVAL + ch
+  EVT_COUNT = EVT_INTERVAL + MAX_CHANNELS
+};
+
+static const char *const TIMER_EVENT_NAMES[EVT_COUNT] = {
+  "pulseOff", "schedule", "mqttReconnect", "ntpResync", "configSave", "mqttState", "metricsPublish", "ssePing",
+  "groupStart", "groupBeacon", "heapSample", "otaCheck", "eventLogFlush",
+  "interval0", "interval1", "interval2", "interval3",
+  "interval4", "interval5", "interval6", "interval7"
+};
+static_assert(MAX_CHANNELS == 8, "update TIMER_EVENT_NAMES");
+
+static const uint32_t LOOP_IDLE_MAX_MS = 20;           // keeps HTTP/MQTT responsive
+static const uint32_t SCHEDULE_MAX_WAIT_MS = 60000;     // re-check at least once a minute
+static const uint32_t NTP_RETRY_MS = 30000;             // until the first sync succeeds
+static const uint32_t NTP_RESYNC_MS = 6UL * 3600UL * 1000UL;
+static const time_t MIN_VALID_EPOCH = 1600000000;       // anything earlier means NTP has not synced
+
+// Min-heap in lib/DiffuserCore; popDue() returns EVT_COUNT when nothing is due
+TimerHeap<EVT_COUNT> timers(systemClock);
+
+// Bumped on every change /api/status reports, so its cached body and ETag
+// stay valid until then. Seeded randomly at boot so an ETag from before a
+// reboot never matches.
+uint32_t statusGeneration = 0;
+
+void statusChanged() {
+  statusGeneration++;
+}
+
+// Anything MQTT subscribers see changed: pull the next state publish
+// forward, but not closer than MQTT_STATE_MIN_INTERVAL_MS to the last one.
+// Periodic values (RSSI, heap) are sampled by the same timer.
+static const uint32_t MQTT_STATE_MIN_INTERVAL_MS = 1000;
+uint32_t mqttStateLastFlushAt = 0;
+
+void mqttStateChanged() {
+  statusChanged();
+  uint32_t at = mqttStateLastFlushAt + MQTT_STATE_MIN_INTERVAL_MS;
+  if ((int32_t)(at - millis()) < 0) at = millis();
+  if (timers.armed(EVT_MQTT_STATE) && (int32_t)(timers.deadline(EVT_MQTT_STATE) - at) <= 0) return;
+  timers.arm(EVT_MQTT_STATE, at);
+}
+
+// Changes pushed to /api/events subscribers; sseService() sends them once
+// per loop pass
+struct SsePending {
+  uint8_t pulseMask = 0;    // channels that started or ended a pulse
+  uint8_t intervalMask = 0; // channels whose interval was re-armed or stopped
+};
+SsePending ssePending;
+
+// ================== Boot timing ==================
+// millis() at the end of each setup() phase, so slow phases show up on
+// serial and in /api/status
+enum BootPhase : uint8_t {
+  BOOT_CONFIG,
+  BOOT_WIFI,
+  BOOT_TIME,
+  BOOT_WEB,
+  BOOT_MQTT,
+  BOOT_SETUP,
+  BOOT_MQTT_READY, // first successful connect + subscribe, may be after setup()
+  BOOT_PHASE_COUNT
+};
+
+static const char *const BOOT_PHASE_NAMES[BOOT_PHASE_COUNT] = {
+  "config", "wifi", "time", "web", "mqtt", "setup", "mqttReady"
+};
+
+uint32_t bootPhaseMs[BOOT_PHASE_COUNT];
+bool bootWifiFastPath = false;
+
+void bootMark(BootPhase phase) {
+  if (bootPhaseMs[phase] != 0) return;
+  bootPhaseMs[phase] = millis();
+  statusChanged();
+  Serial.printf("Boot: %s at %lu ms\n", BOOT_PHASE_NAMES[phase], (unsigned long)bootPhaseMs[phase]);
+}
+
+// ================== Metrics ==================
+// Cheap enough to leave on: a loop pass costs two micros() reads and a
+// short bucket scan; a request one more pair.
+static const uint32_t LOOP_BUCKET_US[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000};
+static const uint8_t LOOP_BUCKET_COUNT = sizeof(LOOP_BUCKET_US) / sizeof(LOOP_BUCKET_US[0]);
+static const uint8_t MAX_ROUTE_METRICS = 24;
+
+struct LoopMetrics {
+  uint32_t buckets[LOOP_BUCKET_COUNT + 1]; // last one is +Inf; not cumulative
+  uint64_t sumUs = 0;
+  uint32_t count = 0;
+  uint32_t maxUs = 0;                      // longest pass since boot
+};
+LoopMetrics loopMetrics;
+
+struct RouteMetric {
+  const char *path;
+  HTTPMethod method;
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+};
+RouteMetric routeMetrics[MAX_ROUTE_METRICS];
+uint8_t routeMetricCount = 0;
+
+// Busy time of one loop pass, excluding the idle delay
+void metricsLoopDone(uint32_t us) {
+  uint8_t b = 0;
+  while (b < LOOP_BUCKET_COUNT && us > LOOP_BUCKET_US[b]) b++;
+  loopMetrics.buckets[b]++;
+  loopMetrics.sumUs += us;
+  loopMetrics.count++;
+  if (us > loopMetrics.maxUs) loopMetrics.maxUs = us;
+}
+
+// Returns the slot for a route, or MAX_ROUTE_METRICS when the table is full
+uint8_t metricsAddRoute(const char *path, HTTPMethod method) {
+  if (routeMetricCount >= MAX_ROUTE_METRICS) return MAX_ROUTE_METRICS;
+  RouteMetric &m = routeMetrics[routeMetricCount];
+  m.path = path;
+  m.method = method;
+  m.count = 0;
+  m.sumUs = 0;
+  m.maxUs = 0;
+  return routeMetricCount++;
+}
+
+void metricsRouteDone(uint8_t idx, uint32_t us) {
+  if (idx >= routeMetricCount) return;
+  RouteMetric &m = routeMetrics[idx];
+  m.count++;
+  m.sumUs += us;
+  if (us > m.maxUs) m.maxUs = us;
+}
+
+static const char *httpMethodName(HTTPMethod method) {
+  switch (method) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    case HTTP_PUT: return "PUT";
+    case HTTP_PATCH: return "PATCH";
+    case HTTP_DELETE: return "DELETE";
+    default: return "ANY";
+  }
+}
+
+// ================== Utility ==================
+// Copies src into a fixed char array; false when it had to be cut short
+template <size_t N>
+static bool copyString(char (&dst)[N], const char *src) {
+  if (src == dst) return true;
+  size_t len = strnlen(src, N - 1);
+  bool fits = src[len] == '\0';
+  memmove(dst, src, len);
+  dst[len] = '\0';
+  return fits;
+}
+
+// CRC-32 (IEEE 802.3), used to validate the config file and RTC state.
+// crc32Update takes and returns the raw register (start with 0xFFFFFFFF and
+// invert at the end); crc32Bytes does both for a single buffer.
+static uint32_t crc32Update(uint32_t crc, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return crc;
+}
+
+static uint32_t crc32Bytes(const void *data, size_t len) {
+  return ~crc32Update(0xFFFFFFFF, data, len);
+}
+
+static void printEscaped(Print &out, const char *in) {
+  for (; *in; in++) {
+    switch (*in) {
+      case '&': out.print("&amp;"); break;
+      case '<': out.print("&lt;"); break;
+      case '>': out.print("&gt;"); break;
+      case '"': out.print("&quot;"); break;
+      case '\'': out.print("&#39;"); break;
+      default: out.write((uint8_t)*in); break;
+    }
+  }
+}
+
+static void printEscaped(Print &out, const String &in) {
+  printEscaped(out, in.c_str());
+}
+
+// A password input that never echoes the stored value, plus a checkbox
+// named clearName to remove it; read back with passwordArgCopy()
+static void printPasswordField(Print &out, const char *label, const char *name, const char *clearName,
+                               const char *stored) {
+  out.print("<label>");
+  out.print(label);
+  out.print(": <input type='password' name='");
+  out.print(name);
+  out.print("' autocomplete='new-password' placeholder='");
+  out.print(stored[0] ? "set, empty keeps it" : "not set");
+  out.print("'></label> <label><input type='checkbox' name='");
+  out.print(clearName);
+  out.print("' value='1'> Clear</label><br/>");
+}
+
+// ================== RTC state ==================
+// Survives deep sleep and warm resets (not power loss). Lets the device pick
+// up how far today's schedule was evaluated, and after a deep sleep or a
+// planned restart the interval phase, where it left off. Writing it costs
+// no flash wear, so the schedule record is refreshed on every schedule check.
+static const uint32_t RTC_STATE_MAGIC = 0x44465357; // "DFSW"; bumped when the layout changes
+
+struct RtcState {
+  uint32_t magic;
+  uint32_t crc;                // over everything after this field
+  int32_t scheduleDay;         // local day (since 1970) of the last schedule check, -1 = none
+  int16_t scheduleHighMin;     // latest local minute evaluated that day
+  int16_t scheduleOffsetMin;   // UTC offset at that check
+  int64_t scheduleLastEvalMs;  // epoch of that check
+  uint32_t sleptMs;            // requested deep sleep duration
+  uint32_t intervalRemainingMs[MAX_CHANNELS]; // time left in each interval phase at sleep, 0 = not armed
+  uint16_t heapRestarts;       // planned restarts by the heap watchdog since power-on
+  uint8_t plannedRestart;      // set just before one; the interval fields are then valid too
+  uint8_t bootFailures;        // crashed boots in a row, cleared once a boot stays up
+};
+
+RtcState rtcState;
+bool rtcStateValid = false;     // restored at boot
+bool rtcWokeFromSleep = false;  // the interval fields are only meaningful after a deep sleep
+bool rtcPlannedRestart = false; // or after a heap watchdog restart
+
+static uint32_t rtcStateCrc(const RtcState &st) {
+  return crc32Bytes((const uint8_t *)&st + offsetof(RtcState, scheduleDay),
+                    sizeof(RtcState) - offsetof(RtcState, scheduleDay));
+}
+
+void rtcSave() {
+  rtcState.magic = RTC_STATE_MAGIC;
+  rtcState.crc = rtcStateCrc(rtcState);
+  ESP.rtcUserMemoryWrite(0, (uint32_t *)&rtcState, sizeof(rtcState));
+}
+
+// After power-on the memory holds noise, which the CRC rejects
+void rtcLoad() {
+  rtcStateValid = false;
+  uint32_t reason = ESP.getResetInfoPtr()->reason;
+  rtcWokeFromSleep = reason == REASON_DEEP_SLEEP_AWAKE;
+  bool crashed = reason == REASON_EXCEPTION_RST || reason == REASON_WDT_RST || reason == REASON_SOFT_WDT_RST;
+  if (!ESP.rtcUserMemoryRead(0, (uint32_t *)&rtcState, sizeof(rtcState)) || rtcState.magic != RTC_STATE_MAGIC ||
+      rtcState.crc != rtcStateCrc(rtcState)) {
+    memset(&rtcState, 0, sizeof(rtcState));
+    rtcState.scheduleDay = -1;
+    if (crashed) {
+      // Counted even when the crash came before anything was saved
+      rtcState.bootFailures = 1;
+      rtcSave();
+    }
+    return;
+  }
+  rtcStateValid = true;
+  rtcPlannedRestart = rtcState.plannedRestart && reason == REASON_SOFT_RESTART;
+  if (rtcState.plannedRestart || crashed) {
+    // Consumed; a later unplanned reset must not restore the intervals
+    rtcState.plannedRestart = 0;
+    if (crashed && rtcState.bootFailures < UINT8_MAX) rtcState.bootFailures++;
+    rtcSave();
+  }
+  if (!rtcWokeFromSleep && !rtcPlannedRestart) {
+    // Left over from an earlier sleep or restart
+    rtcState.sleptMs = 0;
+    memset(rtcState.intervalRemainingMs, 0, sizeof(rtcState.intervalRemainingMs));
+  }
+}
+
+// Last good WiFi association, kept in RTC memory after RtcState. Valid across
+// any warm reset; tagged with the SSID so a reconfigured network is ignored.
+static const uint32_t RTC_WIFI_MAGIC = 0x44465749; // "DFWI"
+static const uint32_t RTC_WIFI_OFFSET = 32;        // in 4-byte blocks, past RtcState
+static_assert(sizeof(RtcState) <= RTC_WIFI_OFFSET * 4, "RtcState overlaps the WiFi cache");
+
+struct RtcWifiCache {
+  uint32_t magic;
+  uint32_t crc;       // over everything after this field
+  uint32_t ssidCrc;
+  uint32_t ip, gateway, subnet, dns;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t pad;
+};
+
+static uint32_t rtcWifiCrc(const RtcWifiCache &c) {
+  return crc32Bytes((const uint8_t *)&c + offsetof(RtcWifiCache, ssidCrc),
+                    sizeof(RtcWifiCache) - offsetof(RtcWifiCache, ssidCrc));
+}
+
+bool rtcLoadWifiCache(RtcWifiCache &c) {
+  if (!ESP.rtcUserMemoryRead(RTC_WIFI_OFFSET, (uint32_t *)&c, sizeof(c))) return false;
+  return c.magic == RTC_WIFI_MAGIC && c.crc == rtcWifiCrc(c);
+}
+
+void rtcSaveWifiCache() {
+  RtcWifiCache c;
+  memset(&c, 0, sizeof(c));
+  c.magic = RTC_WIFI_MAGIC;
+  String ssid = WiFi.SSID();
+  c.ssidCrc = crc32Bytes(ssid.c_str(), ssid.length());
+  c.ip = (uint32_t)WiFi.localIP();
+  c.gateway = (uint32_t)WiFi.gatewayIP();
+  c.subnet = (uint32_t)WiFi.subnetMask();
+  c.dns = (uint32_t)WiFi.dnsIP(0);
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = (uint8_t)WiFi.channel();
+  c.crc = rtcWifiCrc(c);
+  ESP.rtcUserMemoryWrite(RTC_WIFI_OFFSET, (uint32_t *)&c, sizeof(c));
+}
+
+// ================== Persistence ==================
+// The config lives in /config.bin: a small header, a fixed block of numeric
+// fields, a length-prefixed string table and the schedule as minute values,
+// followed by a CRC-32. Booting reads it without a JSON parser. JSON is only
+// used for import/export through the API and to migrate a legacy
+// /config.json.
+//
+// Mutations only mark the config dirty; the write happens once the changes
+// have settled, so bursts of commands cost a single flash write.
+static const uint32_t CONFIG_SAVE_DEBOUNCE_MS = 2000;  // quiet time before writing
+static const uint32_t CONFIG_SAVE_MAX_DELAY_MS = 10000; // upper bound under constant churn
+
+static const uint32_t CONFIG_BIN_MAGIC = 0x42434644; // "DFCB"
+static const uint16_t CONFIG_BIN_VERSION = 5;        // 1 = single channel, 2 = no rules, 3 = no timezone,
+                                                     // 4 = no OTA password; all readable
 
-  // e.g., ["08:00","12:30","18:45"]
-  std::vector<String> scheduleTimes;
+struct ConfigBinHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t fixedSize;  // sizeof(ConfigBinFixed) when written; may be smaller in older files
+  uint32_t payloadLen; // bytes between the header and the trailing CRC
 };
 
-AppConfig config;
+// Versions 2 to 5: shared fields, the string table (plus the timezone
+// from version 4 and the OTA password from version 5), then channelCount
+// channel records, each followed by its schedule minutes and (from
+// version 3) its rules
+struct ConfigBinFixed {
+  int32_t timezoneOffsetMinutes;
+  uint32_t deepSleepMinGapSec;
+  uint16_t mqttPort;
+  uint8_t powerMode;
+  uint8_t listenInterval;
+  uint8_t flags;        // CONFIG_FLAG_*
+  uint8_t channelCount;
+  uint8_t triggerPolicy;
+  uint8_t reserved;
+  // Fields below were appended within version 2; shorter files read them as 0
+  uint16_t metricsPublishSec;
+  uint16_t reserved2;
+  uint16_t scheduleCatchUpSec; // older files keep the default
+  uint8_t groupCount;
+  uint8_t reserved3;
+  uint16_t groups[MAX_GROUPS];
+  uint16_t heapMinBlock; // older files keep the defaults
+  uint8_t heapMaxFrag;
+  uint8_t reserved4;
+};
+
+// Size of the version 2 fixed block before any appended field
+static const uint16_t CONFIG_BIN_FIXED_V2_MIN = offsetof(ConfigBinFixed, metricsPublishSec);
+
+struct ConfigBinChannel {
+  int32_t pin;
+  uint32_t durationMs;
+  uint32_t intervalSeconds;
+  uint8_t activeHigh;
+  uint8_t intervalEnabled;
+  uint8_t scheduleCount;
+  uint8_t ruleCount; // always 0 in version 2
+};
+
+struct ConfigBinRule {
+  uint32_t durationMs;
+  uint16_t startMin;
+  uint16_t endMin;
+  uint16_t periodMin;
+  uint16_t fromDay;
+  uint16_t toDay;
+  uint8_t weekdays;
+  uint8_t reserved;
+};
+
+// Version 1 fixed block; its pin, pulse, interval and schedule are channel 0
+struct ConfigBinFixedV1 {
+  int32_t triggerPin;
+  uint32_t triggerDurationMs;
+  uint32_t intervalSeconds;
+  int32_t timezoneOffsetMinutes;
+  uint32_t deepSleepMinGapSec;
+  uint16_t mqttPort;
+  uint8_t triggerActiveHigh;
+  uint8_t intervalEnabled;
+  uint8_t powerMode;
+  uint8_t listenInterval;
+  uint8_t scheduleCount;
+  uint8_t flags;
+};
+
+// Flags are chosen so that 0 means the default
+static const uint8_t CONFIG_FLAG_NO_FAST_RECONNECT = 0x01;
+static const uint8_t CONFIG_FLAG_GROUP_LEADER = 0x02;
+
+// Top-level keys (including the single-channel ones older exports used),
+// "mqtt", "power", "wifi", "heapWatchdog" and the channels array. Strings are
+// added as const char* so ArduinoJson stores pointers rather than copies.
+static const size_t CONFIG_JSON_FIXED_CAPACITY =
+    JSON_OBJECT_SIZE(18) + JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(2) +
+    JSON_ARRAY_SIZE(MAX_CHANNELS) + JSON_ARRAY_SIZE(MAX_GROUPS);
+static const size_t CONFIG_JSON_CHANNEL_CAPACITY = JSON_OBJECT_SIZE(7);
+
+// One exported rule; its times and dates are formatted, so they are copied
+static const size_t SCHEDULE_RULE_JSON_CAPACITY =
+    JSON_OBJECT_SIZE(7) + 2 * JSON_STRING_SIZE(5) + 2 * JSON_STRING_SIZE(10);
+
+bool fsMounted = false;
+bool configDirty = false;
+unsigned long configDirtySince = 0;
+
+bool mountFs() {
+  if (fsMounted) return true;
+  if (!LittleFS.begin()) {
+    LittleFS.format();
+    if (!LittleFS.begin()) {
+      Serial.println("LittleFS mount failed");
+      return false;
+    }
+  }
+  fsMounted = true;
+  return true;
+}
+
+void markConfigDirty() {
+  unsigned long now = millis();
+  if (!configDirty) {
+    configDirty = true;
+    configDirtySince = now;
+  }
+  uint32_t at = now + CONFIG_SAVE_DEBOUNCE_MS;
+  uint32_t latest = configDirtySince + CONFIG_SAVE_MAX_DELAY_MS;
+  if ((int32_t)(at - latest) > 0) at = latest;
+  timers.arm(EVT_CONFIG_SAVE, at);
+  mqttStateChanged();
+}
+
+// Exact capacity for exporting cfg
+size_t configJsonCapacity(const AppConfig &cfg) {
+  size_t cap = CONFIG_JSON_FIXED_CAPACITY;
+  for (uint8_t i = 0; i < cfg.channelCount; i++) {
+    const ChannelConfig &c = cfg.channels[i];
+    cap += CONFIG_JSON_CHANNEL_CAPACITY + JSON_ARRAY_SIZE(c.scheduleCount) + c.scheduleCount * JSON_STRING_SIZE(5) +
+           JSON_ARRAY_SIZE(c.scheduleRules.size()) + c.scheduleRules.size() * SCHEDULE_RULE_JSON_CAPACITY;
+  }
+  return cap;
+}
+
+// Capacity for parsing inputLen bytes of config JSON in place (strings
+// point into the input). Every schedule entry ("HH:MM" plus a separator)
+// and every rule member ("to":1 plus a separator) takes at least 7
+// characters, so the input length bounds the slots.
+size_t configJsonInPlaceCapacity(size_t inputLen) {
+  return CONFIG_JSON_FIXED_CAPACITY + MAX_CHANNELS * CONFIG_JSON_CHANNEL_CAPACITY +
+         JSON_ARRAY_SIZE(inputLen / 7) + JSON_OBJECT_SIZE(inputLen / 7);
+}
+
+// Same for read-only input, whose strings are copied into the document
+size_t configJsonParseCapacity(size_t inputLen) {
+  return configJsonInPlaceCapacity(inputLen) + inputLen;
+}
+
+static void formatMinutes(uint16_t minutes, char *out) {
+  snprintf(out, 6, "%02u:%02u", minutes / 60, minutes % 60);
+}
+
+// Writes r as {"start","end","everyMin","weekdays","durationMs"} plus
+// "from"/"to" when bounded
+void scheduleRuleToJson(const ScheduleRule &r, JsonObject obj) {
+  char buf[11];
+  formatMinutes(r.startMin, buf);
+  obj["start"] = (char *)buf; // char* is copied into the document
+  formatMinutes(r.endMin, buf);
+  obj["end"] = (char *)buf;
+  obj["everyMin"] = r.periodMin;
+  obj["weekdays"] = r.weekdays;
+  obj["durationMs"] = r.durationMs;
+  if (r.fromDay) {
+    formatDate(r.fromDay, buf);
+    obj["from"] = (char *)buf;
+  }
+  if (r.toDay) {
+    formatDate(r.toDay, buf);
+    obj["to"] = (char *)buf;
+  }
+}
+
+// Fills doc with the export representation of cfg. Strings are borrowed,
+// so cfg must outlive the document.
+void configToJson(const AppConfig &cfg, JsonDocument &doc) {
+  JsonArray channels = doc.createNestedArray("channels");
+  for (uint8_t i = 0; i < cfg.channelCount; i++) {
+    const ChannelConfig &c = cfg.channels[i];
+    JsonObject ch = channels.createNestedObject();
+    ch["pin"] = c.pin;
+    ch["activeHigh"] = c.activeHigh;
+    ch["durationMs"] = c.durationMs;
+    ch["intervalSeconds"] = c.intervalSeconds;
+    ch["intervalEnabled"] = c.intervalEnabled;
+    JsonArray sched = ch.createNestedArray("scheduleTimes");
+    for (uint8_t n = 0; n < c.scheduleCount; n++) {
+      char buf[6];
+      formatMinutes(c.scheduleMinutes[n], buf);
+      sched.add(buf); // char array: copied
+    }
+    JsonArray rules = ch.createNestedArray("scheduleRules");
+    for (auto &r : c.scheduleRules) {
+      scheduleRuleToJson(r, rules.createNestedObject());
+    }
+  }
+
+  doc["triggerPolicy"] = cfg.triggerPolicy;
+
+  JsonObject mqtt = doc.createNestedObject("mqtt");
+  mqtt["host"] = (const char *)cfg.mqttHost;
+  mqtt["port"] = cfg.mqttPort;
+  mqtt["user"] = (const char *)cfg.mqttUser;
+  mqtt["passSet"] = cfg.mqttPass[0] != 0; // the password itself is never exported
+  mqtt["topic"] = (const char *)cfg.mqttTopic;
+  mqtt["metricsSec"] = cfg.metricsPublishSec;
+
+  doc["timezoneOffsetMinutes"] = cfg.timezoneOffsetMinutes;
+  doc["timezone"] = (const char *)cfg.timezone;
+  doc["scheduleCatchUpSec"] = cfg.scheduleCatchUpSec;
+  JsonArray groups = doc.createNestedArray("groups");
+  for (uint16_t g : cfg.groups) groups.add(g);
+  doc["groupLeader"] = cfg.groupLeader;
+
+  JsonObject power = doc.createNestedObject("power");
+  power["mode"] = cfg.powerMode;
+  power["listenInterval"] = cfg.listenInterval;
+  power["deepSleepMinGapSec"] = cfg.deepSleepMinGapSec;
+
+  JsonObject wifi = doc.createNestedObject("wifi");
+  wifi["fastReconnect"] = cfg.wifiFastReconnect;
+
+  JsonObject heapWd = doc.createNestedObject("heapWatchdog");
+  heapWd["minBlock"] = cfg.heapMinBlock;
+  heapWd["maxFragmentation"] = cfg.heapMaxFrag;
+
+  // Never exported: GET /api/config is open to the LAN and this password
+  // is what guards firmware updates
+  doc["otaPasswordSet"] = cfg.otaPassword[0] != 0;
+}
+
+static void scheduleTimesFromJson(JsonArrayConst arr, ChannelConfig &c) {
+  c.scheduleCount = 0;
+  for (JsonVariantConst v : arr) {
+    int m = v.is<const char *>() ? parseTimeToMinutes(v.as<const char *>()) : -1;
+    if (m >= 0) scheduleAddMinute(c, (uint16_t)m);
+  }
+}
+
+static void scheduleRulesFromJson(JsonArrayConst arr, std::vector<ScheduleRule> &out) {
+  out.clear();
+  for (JsonVariantConst v : arr) {
+    ScheduleRule r;
+    if (!scheduleRuleFromJson(v, r) && out.size() < MAX_SCHEDULE_RULES) {
+      out.push_back(r);
+    }
+  }
+}
+
+static void channelFromJson(JsonObjectConst obj, ChannelConfig &c) {
+  c.pin = obj["pin"] | c.pin;
+  c.activeHigh = obj["activeHigh"] | c.activeHigh;
+  c.durationMs = obj["durationMs"] | c.durationMs;
+  c.intervalSeconds = obj["intervalSeconds"] | c.intervalSeconds;
+  c.intervalEnabled = obj["intervalEnabled"] | c.intervalEnabled;
+  if (obj["scheduleTimes"].is<JsonArrayConst>()) {
+    scheduleTimesFromJson(obj["scheduleTimes"].as<JsonArrayConst>(), c);
+  }
+  if (obj["scheduleRules"].is<JsonArrayConst>()) {
+    scheduleRulesFromJson(obj["scheduleRules"].as<JsonArrayConst>(), c.scheduleRules);
+  }
+}
+
+// Applies the keys present in doc on top of cfg. The number of entries in
+// "channels" sets the channel count.
+void configFromJson(const JsonDocument &doc, AppConfig &cfg) {
+  // Single-channel documents from older firmware describe channel 0
+  ChannelConfig &ch0 = cfg.channels[0];
+  ch0.pin = doc["triggerPin"] | ch0.pin;
+  ch0.activeHigh = doc["triggerActiveHigh"] | ch0.activeHigh;
+  ch0.durationMs = doc["triggerDurationMs"] | ch0.durationMs;
+  ch0.intervalSeconds = doc["intervalSeconds"] | ch0.intervalSeconds;
+  ch0.intervalEnabled = doc["intervalEnabled"] | ch0.intervalEnabled;
+  if (doc["scheduleTimes"].is<JsonArrayConst>()) {
+    scheduleTimesFromJson(doc["scheduleTimes"].as<JsonArrayConst>(), ch0);
+  }
+
+  if (doc["channels"].is<JsonArrayConst>()) {
+    uint8_t n = 0;
+    for (JsonVariantConst v : doc["channels"].as<JsonArrayConst>()) {
+      if (n >= MAX_CHANNELS) break;
+      channelFromJson(v.as<JsonObjectConst>(), cfg.channels[n++]);
+    }
+    if (n > 0) cfg.channelCount = n;
+  }
+  cfg.triggerPolicy = doc["triggerPolicy"] | cfg.triggerPolicy;
+  if (cfg.triggerPolicy >= TRIGGER_POLICY_COUNT) cfg.triggerPolicy = TRIGGER_POLICY_DROP;
+
+  if (doc.containsKey("mqtt")) {
+    JsonObjectConst mqtt = doc["mqtt"];
+    copyString(cfg.mqttHost, mqtt["host"] | (const char *)cfg.mqttHost);
+    cfg.mqttPort = mqtt["port"] | cfg.mqttPort;
+    copyString(cfg.mqttUser, mqtt["user"] | (const char *)cfg.mqttUser);
+    copyString(cfg.mqttPass, mqtt["pass"] | (const char *)cfg.mqttPass);
+    copyString(cfg.mqttTopic, mqtt["topic"] | (const char *)cfg.mqttTopic);
+    cfg.metricsPublishSec = mqtt["metricsSec"] | cfg.metricsPublishSec;
+  }
+
+  cfg.timezoneOffsetMinutes = doc["timezoneOffsetMinutes"] | cfg.timezoneOffsetMinutes;
+  copyString(cfg.timezone, doc["timezone"] | (const char *)cfg.timezone);
+  cfg.scheduleCatchUpSec = doc["scheduleCatchUpSec"] | cfg.scheduleCatchUpSec;
+  if (doc.containsKey("groups")) {
+    cfg.groups.clear();
+    for (JsonVariantConst g : doc["groups"].as<JsonArrayConst>()) cfg.groups.push_back(g.as<uint16_t>());
+  }
+  cfg.groupLeader = doc["groupLeader"] | cfg.groupLeader;
+
+  if (doc.containsKey("power")) {
+    JsonObjectConst power = doc["power"];
+    cfg.powerMode = power["mode"] | cfg.powerMode;
+    cfg.listenInterval = power["listenInterval"] | cfg.listenInterval;
+    cfg.deepSleepMinGapSec = power["deepSleepMinGapSec"] | cfg.deepSleepMinGapSec;
+  }
+
+  if (doc.containsKey("wifi")) {
+    JsonObjectConst wifi = doc["wifi"];
+    cfg.wifiFastReconnect = wifi["fastReconnect"] | cfg.wifiFastReconnect;
+  }
+
+  if (doc.containsKey("heapWatchdog")) {
+    JsonObjectConst heapWd = doc["heapWatchdog"];
+    cfg.heapMinBlock = heapWd["minBlock"] | cfg.heapMinBlock;
+    cfg.heapMaxFrag = heapWd["maxFragmentation"] | cfg.heapMaxFrag;
+  }
+  copyString(cfg.otaPassword, doc["otaPassword"] | (const char *)cfg.otaPassword);
+}
+
+static const size_t CONFIG_JSON_FILTER_CAPACITY =
+    JSON_OBJECT_SIZE(18) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(6) +
+    JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(2);
+
+// Keys configFromJson reads; everything else is skipped while parsing, so it
+// costs no document memory
+void configJsonFilter(JsonDocument &filter) {
+  JsonObject ch = filter["channels"].createNestedObject();
+  for (const char *key : {"pin", "activeHigh", "durationMs", "intervalSeconds", "intervalEnabled", "scheduleTimes",
+                          "scheduleRules"}) {
+    ch[key] = true;
+  }
+  for (const char *key : {"triggerPin", "triggerActiveHigh", "triggerDurationMs", "intervalSeconds",
+                          "intervalEnabled", "scheduleTimes", "triggerPolicy", "timezoneOffsetMinutes", "timezone",
+                          "scheduleCatchUpSec", "groups", "groupLeader", "otaPassword"}) {
+    filter[key] = true;
+  }
+  for (const char *key : {"host", "port", "user", "pass", "topic", "metricsSec"}) {
+    filter["mqtt"][key] = true;
+  }
+  for (const char *key : {"mode", "listenInterval", "deepSleepMinGapSec"}) {
+    filter["power"][key] = true;
+  }
+  filter["wifi"]["fastReconnect"] = true;
+  filter["heapWatchdog"]["minBlock"] = true;
+  filter["heapWatchdog"]["maxFragmentation"] = true;
+}
+
+static const char *scheduleTimesJsonError(JsonVariantConst v) {
+  if (v.isNull()) return nullptr;
+  if (!v.is<JsonArrayConst>()) return "scheduleTimes must be an array";
+  JsonArrayConst times = v.as<JsonArrayConst>();
+  if (times.size() > MAX_SCHEDULE_ENTRIES) return "too many schedule times";
+  for (JsonVariantConst t : times) {
+    if (!t.is<const char *>() || parseTimeToMinutes(t.as<const char *>()) < 0) return "invalid schedule time";
+  }
+  return nullptr;
+}
+
+// Strings longer than their fixed config field are rejected, not cut short
+static bool jsonStringFits(JsonVariantConst v, size_t size) {
+  return !v.is<const char *>() || strlen(v.as<const char *>()) < size;
+}
+
+static const char *groupsJsonError(JsonVariantConst v) {
+  if (v.isNull()) return nullptr;
+  if (!v.is<JsonArrayConst>()) return "groups must be an array";
+  JsonArrayConst groups = v.as<JsonArrayConst>();
+  if (groups.size() > MAX_GROUPS) return "too many groups";
+  for (JsonVariantConst g : groups) {
+    if (!g.is<long>() || g.as<long>() < 1 || g.as<long>() > 65535) return "invalid group";
+  }
+  return nullptr;
+}
+
+static const char *scheduleRulesJsonError(JsonVariantConst v) {
+  if (v.isNull()) return nullptr;
+  if (!v.is<JsonArrayConst>()) return "scheduleRules must be an array";
+  JsonArrayConst rules = v.as<JsonArrayConst>();
+  if (rules.size() > MAX_SCHEDULE_RULES) return "too many schedule rules";
+  for (JsonVariantConst r : rules) {
+    ScheduleRule rule;
+    const char *error = scheduleRuleFromJson(r, rule);
+    if (error) return error;
+  }
+  return nullptr;
+}
+
+static bool intervalJsonValid(JsonVariantConst v) {
+  return v.isNull() || (v >= 0 && v <= (long)MAX_INTERVAL_SECONDS);
+}
+
+static const char *channelJsonError(JsonVariantConst v) {
+  if (!v.is<JsonObjectConst>()) return "must be an object";
+  JsonObjectConst ch = v.as<JsonObjectConst>();
+  if (!ch["pin"].isNull() && !(ch["pin"].is<int>() && ch["pin"] >= 0 && ch["pin"] <= 16)) return "invalid pin";
+  if (!ch["durationMs"].isNull() && !(ch["durationMs"] >= 1 && ch["durationMs"] <= 600000)) {
+    return "durationMs out of range";
+  }
+  if (!intervalJsonValid(ch["intervalSeconds"])) return "intervalSeconds out of range";
+  const char *error = scheduleTimesJsonError(ch["scheduleTimes"]);
+  return error ? error : scheduleRulesJsonError(ch["scheduleRules"]);
+}
+
+// Rejects values configFromJson would clamp or drop, so a bulk update is
+// applied completely or not at all. Writes the reason to msg on failure.
+bool configJsonValid(const JsonDocument &doc, char *msg, size_t msgLen) {
+  const char *error = nullptr;
+  JsonVariantConst channels = doc["channels"];
+  if (!channels.isNull()) {
+    if (!channels.is<JsonArrayConst>() || channels.size() == 0 || channels.size() > MAX_CHANNELS) {
+      snprintf(msg, msgLen, "channels must be an array of 1-%u objects", (unsigned)MAX_CHANNELS);
+      return false;
+    }
+    size_t index = 0;
+    for (JsonVariantConst ch : channels.as<JsonArrayConst>()) {
+      error = channelJsonError(ch);
+      if (error) {
+        snprintf(msg, msgLen, "channels[%u]: %s", (unsigned)index, error);
+        return false;
+      }
+      index++;
+    }
+  }
+  if (!error) error = scheduleTimesJsonError(doc["scheduleTimes"]);
+  if (!error && !intervalJsonValid(doc["intervalSeconds"])) error = "intervalSeconds out of range";
+  if (!error && !doc["triggerPolicy"].isNull() &&
+      !(doc["triggerPolicy"] >= 0 && doc["triggerPolicy"] < (int)TRIGGER_POLICY_COUNT)) {
+    error = "invalid triggerPolicy";
+  }
+  JsonVariantConst mqtt = doc["mqtt"];
+  if (!error && !(jsonStringFits(mqtt["host"], MQTT_HOST_SIZE) && jsonStringFits(mqtt["user"], MQTT_CRED_SIZE) &&
+                  jsonStringFits(mqtt["pass"], MQTT_CRED_SIZE) && jsonStringFits(mqtt["topic"], MQTT_TOPIC_SIZE) &&
+                  jsonStringFits(doc["timezone"], TIMEZONE_SIZE) &&
+                  jsonStringFits(doc["otaPassword"], MQTT_CRED_SIZE))) {
+    error = "string too long";
+  }
+  PosixTz tz;
+  if (!error && !doc["timezone"].isNull() &&
+      !(doc["timezone"].is<const char *>() &&
+        (*doc["timezone"].as<const char *>() == '\0' || parsePosixTz(doc["timezone"].as<const char *>(), tz)))) {
+    error = "invalid timezone";
+  }
+  if (!error && !doc["scheduleCatchUpSec"].isNull() &&
+      !(doc["scheduleCatchUpSec"] >= 0 && doc["scheduleCatchUpSec"] <= 3600)) {
+    error = "invalid scheduleCatchUpSec";
+  }
+  if (!error) error = groupsJsonError(doc["groups"]);
+  if (!error && !doc["power"]["mode"].isNull() && !(doc["power"]["mode"] >= 0 && doc["power"]["mode"] <= 2)) {
+    error = "invalid power.mode";
+  }
+  JsonVariantConst heapWd = doc["heapWatchdog"];
+  if (!error && !heapWd["minBlock"].isNull() && !(heapWd["minBlock"] >= 0 && heapWd["minBlock"] <= 65535)) {
+    error = "invalid heapWatchdog.minBlock";
+  }
+  if (!error && !heapWd["maxFragmentation"].isNull() &&
+      !(heapWd["maxFragmentation"] >= 0 && heapWd["maxFragmentation"] <= 100)) {
+    error = "invalid heapWatchdog.maxFragmentation";
+  }
+  if (error) {
+    snprintf(msg, msgLen, "%s", error);
+    return false;
+  }
+  return true;
+}
+
+// File writer that keeps a running CRC of everything written
+struct CrcFileWriter {
+  File &f;
+  uint32_t crc;
+  bool ok;
+
+  explicit CrcFileWriter(File &file) : f(file), crc(0xFFFFFFFF), ok(true) {}
+
+  void write(const void *data, size_t len) {
+    crc = crc32Update(crc, data, len);
+    if (f.write((const uint8_t *)data, len) != len) ok = false;
+  }
+
+  void writeString(const char *str) {
+    size_t n = strlen(str);
+    uint8_t len = n > 255 ? 255 : (uint8_t)n;
+    write(&len, 1);
+    write(str, len);
+  }
+};
+
+struct CrcFileReader {
+  File &f;
+  uint32_t crc;
+  bool ok;
+
+  explicit CrcFileReader(File &file) : f(file), crc(0xFFFFFFFF), ok(true) {}
+
+  void read(void *data, size_t len) {
+    if (f.read((uint8_t *)data, len) != len) {
+      ok = false;
+      return;
+    }
+    crc = crc32Update(crc, data, len);
+  }
+
+  // Longer strings than out holds are cut short
+  template <size_t N>
+  void readString(char (&out)[N]) {
+    uint8_t len = 0;
+    read(&len, 1);
+    char buf[256];
+    read(buf, len);
+    buf[ok ? len : 0] = '\0';
+    copyString(out, buf);
+  }
+};
+
+// Loads a stored minute list, skipping values no day has
+static void scheduleFromMinutes(const uint16_t *minutes, size_t count, ChannelConfig &c) {
+  c.scheduleCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (minutes[i] < 1440) scheduleAddMinute(c, minutes[i]);
+  }
+}
+
+static void ruleToBin(const ScheduleRule &r, ConfigBinRule &rec) {
+  memset(&rec, 0, sizeof(rec));
+  rec.durationMs = r.durationMs;
+  rec.startMin = r.startMin;
+  rec.endMin = r.endMin;
+  rec.periodMin = r.periodMin;
+  rec.fromDay = r.fromDay;
+  rec.toDay = r.toDay;
+  rec.weekdays = r.weekdays;
+}
+
+// False when rec does not describe a rule the JSON parser would accept
+static bool ruleFromBin(const ConfigBinRule &rec, ScheduleRule &r) {
+  if (rec.startMin >= 1440 || rec.endMin >= 1440 || rec.endMin < rec.startMin || rec.periodMin >= 1440 ||
+      rec.weekdays == 0 || rec.weekdays > 0x7F) {
+    return false;
+  }
+  r.durationMs = rec.durationMs;
+  r.startMin = rec.startMin;
+  r.endMin = rec.endMin;
+  r.periodMin = rec.periodMin;
+  r.fromDay = rec.fromDay;
+  r.toDay = rec.toDay;
+  r.weekdays = rec.weekdays;
+  return true;
+}
+
+static size_t configBinPayloadLen(const AppConfig &cfg) {
+  size_t len = sizeof(ConfigBinFixed);
+  const char *strs[] = {cfg.mqttHost, cfg.mqttUser, cfg.mqttPass, cfg.mqttTopic, cfg.timezone, cfg.otaPassword};
+  for (const char *str : strs) len += 1 + strlen(str); // every field is shorter than 255
+  for (uint8_t i = 0; i < cfg.channelCount; i++) {
+    len += sizeof(ConfigBinChannel) + cfg.channels[i].scheduleCount * sizeof(uint16_t) +
+           cfg.channels[i].scheduleRules.size() * sizeof(ConfigBinRule);
+  }
+  return len;
+}
+
+// Writes cfg in the binary format; false if any write failed
+bool writeConfigBin(File &f, const AppConfig &cfg) {
+  ConfigBinFixed fixed;
+  memset(&fixed, 0, sizeof(fixed));
+  fixed.timezoneOffsetMinutes = cfg.timezoneOffsetMinutes;
+  fixed.deepSleepMinGapSec = cfg.deepSleepMinGapSec;
+  fixed.mqttPort = cfg.mqttPort;
+  fixed.powerMode = cfg.powerMode;
+  fixed.listenInterval = cfg.listenInterval;
+  fixed.flags = (cfg.wifiFastReconnect ? 0 : CONFIG_FLAG_NO_FAST_RECONNECT) |
+                (cfg.groupLeader ? CONFIG_FLAG_GROUP_LEADER : 0);
+  fixed.channelCount = cfg.channelCount;
+  fixed.triggerPolicy = cfg.triggerPolicy;
+  fixed.metricsPublishSec = cfg.metricsPublishSec;
+  fixed.scheduleCatchUpSec = cfg.scheduleCatchUpSec;
+  fixed.groupCount = (uint8_t)cfg.groups.size();
+  for (uint8_t i = 0; i < fixed.groupCount && i < MAX_GROUPS; i++) fixed.groups[i] = cfg.groups[i];
+  fixed.heapMinBlock = cfg.heapMinBlock;
+  fixed.heapMaxFrag = cfg.heapMaxFrag;
+
+  ConfigBinHeader hdr = {CONFIG_BIN_MAGIC, CONFIG_BIN_VERSION, (uint16_t)sizeof(ConfigBinFixed),
+                         (uint32_t)configBinPayloadLen(cfg)};
+  CrcFileWriter w(f);
+  w.write(&hdr, sizeof(hdr));
+  w.write(&fixed, sizeof(fixed));
+  w.writeString(cfg.mqttHost);
+  w.writeString(cfg.mqttUser);
+  w.writeString(cfg.mqttPass);
+  w.writeString(cfg.mqttTopic);
+  w.writeString(cfg.timezone);
+  w.writeString(cfg.otaPassword);
+  for (uint8_t i = 0; i < cfg.channelCount; i++) {
+    const ChannelConfig &c = cfg.channels[i];
+    ConfigBinChannel rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.pin = c.pin;
+    rec.durationMs = c.durationMs;
+    rec.intervalSeconds = c.intervalSeconds;
+    rec.activeHigh = c.activeHigh;
+    rec.intervalEnabled = c.intervalEnabled;
+    rec.scheduleCount = c.scheduleCount;
+    rec.ruleCount = (uint8_t)c.scheduleRules.size();
+    w.write(&rec, sizeof(rec));
+    w.write(c.scheduleMinutes, rec.scheduleCount * sizeof(uint16_t));
+    for (auto &r : c.scheduleRules) {
+      ConfigBinRule ruleRec;
+      ruleToBin(r, ruleRec);
+      w.write(&ruleRec, sizeof(ruleRec));
+    }
+  }
+  uint32_t crc = ~w.crc;
+  return w.ok && f.write((const uint8_t *)&crc, sizeof(crc)) == sizeof(crc);
+}
+
+static void readConfigBinV1(CrcFileReader &r, AppConfig &loaded) {
+  ConfigBinFixedV1 fixed;
+  r.read(&fixed, sizeof(fixed));
+  r.readString(loaded.mqttHost);
+  r.readString(loaded.mqttUser);
+  r.readString(loaded.mqttPass);
+  r.readString(loaded.mqttTopic);
+  uint16_t minutes[MAX_SCHEDULE_ENTRIES];
+  size_t count = fixed.scheduleCount <= MAX_SCHEDULE_ENTRIES ? fixed.scheduleCount : 0;
+  r.read(minutes, count * sizeof(uint16_t));
+  if (!r.ok) return;
+
+  ChannelConfig &c = loaded.channels[0];
+  c.pin = fixed.triggerPin;
+  c.durationMs = fixed.triggerDurationMs;
+  // Older firmware took any value
+  c.intervalSeconds = fixed.intervalSeconds > MAX_INTERVAL_SECONDS ? MAX_INTERVAL_SECONDS : fixed.intervalSeconds;
+  c.activeHigh = fixed.triggerActiveHigh != 0;
+  c.intervalEnabled = fixed.intervalEnabled != 0;
+  scheduleFromMinutes(minutes, count, c);
+  loaded.channelCount = 1;
+  loaded.timezoneOffsetMinutes = fixed.timezoneOffsetMinutes;
+  loaded.deepSleepMinGapSec = fixed.deepSleepMinGapSec;
+  loaded.mqttPort = fixed.mqttPort;
+  loaded.powerMode = fixed.powerMode;
+  loaded.listenInterval = fixed.listenInterval;
+  loaded.wifiFastReconnect = !(fixed.flags & CONFIG_FLAG_NO_FAST_RECONNECT);
+}
+
+static void readConfigBinV2(CrcFileReader &r, uint16_t version, uint16_t fixedSize, AppConfig &loaded) {
+  ConfigBinFixed fixed;
+  memset(&fixed, 0, sizeof(fixed));
+  r.read(&fixed, fixedSize);
+  r.readString(loaded.mqttHost);
+  r.readString(loaded.mqttUser);
+  r.readString(loaded.mqttPass);
+  r.readString(loaded.mqttTopic);
+  if (version >= 4) r.readString(loaded.timezone);
+  if (version >= 5) r.readString(loaded.otaPassword);
+  if (!r.ok || fixed.channelCount < 1 || fixed.channelCount > MAX_CHANNELS) {
+    r.ok = false;
+    return;
+  }
+  for (uint8_t i = 0; i < fixed.channelCount && r.ok; i++) {
+    ConfigBinChannel rec;
+    r.read(&rec, sizeof(rec));
+    uint16_t minutes[MAX_SCHEDULE_ENTRIES];
+    size_t count = rec.scheduleCount <= MAX_SCHEDULE_ENTRIES ? rec.scheduleCount : 0;
+    r.read(minutes, count * sizeof(uint16_t));
+    ChannelConfig &c = loaded.channels[i];
+    c.scheduleRules.clear();
+    size_t ruleCount = version >= 3 && rec.ruleCount <= MAX_SCHEDULE_RULES ? rec.ruleCount : 0;
+    for (size_t n = 0; n < ruleCount && r.ok; n++) {
+      ConfigBinRule ruleRec;
+      ScheduleRule rule;
+      r.read(&ruleRec, sizeof(ruleRec));
+      if (ruleFromBin(ruleRec, rule)) c.scheduleRules.push_back(rule);
+    }
+    c.pin = rec.pin;
+    c.durationMs = rec.durationMs;
+    c.intervalSeconds = rec.intervalSeconds > MAX_INTERVAL_SECONDS ? MAX_INTERVAL_SECONDS : rec.intervalSeconds;
+    c.activeHigh = rec.activeHigh != 0;
+    c.intervalEnabled = rec.intervalEnabled != 0;
+    scheduleFromMinutes(minutes, count, c);
+  }
+  loaded.channelCount = fixed.channelCount;
+  loaded.triggerPolicy = fixed.triggerPolicy < TRIGGER_POLICY_COUNT ? fixed.triggerPolicy : (uint8_t)TRIGGER_POLICY_DROP;
+  loaded.metricsPublishSec = fixed.metricsPublishSec;
+  if (fixedSize >= offsetof(ConfigBinFixed, scheduleCatchUpSec) + sizeof(fixed.scheduleCatchUpSec)) {
+    loaded.scheduleCatchUpSec = fixed.scheduleCatchUpSec;
+  }
+  loaded.groups.clear();
+  for (uint8_t i = 0; i < fixed.groupCount && i < MAX_GROUPS; i++) {
+    if (fixed.groups[i]) loaded.groups.push_back(fixed.groups[i]);
+  }
+  if (fixedSize >= offsetof(ConfigBinFixed, heapMaxFrag) + sizeof(fixed.heapMaxFrag)) {
+    loaded.heapMinBlock = fixed.heapMinBlock;
+    loaded.heapMaxFrag = fixed.heapMaxFrag;
+  }
+  loaded.timezoneOffsetMinutes = fixed.timezoneOffsetMinutes;
+  loaded.deepSleepMinGapSec = fixed.deepSleepMinGapSec;
+  loaded.mqttPort = fixed.mqttPort;
+  loaded.powerMode = fixed.powerMode;
+  loaded.listenInterval = fixed.listenInterval;
+  loaded.wifiFastReconnect = !(fixed.flags & CONFIG_FLAG_NO_FAST_RECONNECT);
+  loaded.groupLeader = (fixed.flags & CONFIG_FLAG_GROUP_LEADER) != 0;
+}
+
+// Reads the binary format into cfg; cfg is untouched unless the file is
+// complete and its CRC matches
+bool readConfigBin(File &f, AppConfig &cfg) {
+  ConfigBinHeader hdr;
+  CrcFileReader r(f);
+  r.read(&hdr, sizeof(hdr));
+  if (!r.ok || hdr.magic != CONFIG_BIN_MAGIC ||
+      f.size() != sizeof(hdr) + hdr.payloadLen + sizeof(uint32_t)) {
+    return false;
+  }
+
+  // Static: an AppConfig is large for the loop stack
+  static AppConfig loaded;
+  resetConfig(loaded);
+  if (hdr.version == 1 && hdr.fixedSize == sizeof(ConfigBinFixedV1)) {
+    readConfigBinV1(r, loaded);
+  } else if (hdr.version >= 2 && hdr.version <= CONFIG_BIN_VERSION && hdr.fixedSize >= CONFIG_BIN_FIXED_V2_MIN &&
+             hdr.fixedSize <= sizeof(ConfigBinFixed)) {
+    readConfigBinV2(r, hdr.version, hdr.fixedSize, loaded);
+  } else {
+    return false;
+  }
+  uint32_t crc = 0;
+  if (!r.ok || f.read((uint8_t *)&crc, sizeof(crc)) != sizeof(crc) || crc != ~r.crc) {
+    return false;
+  }
+  cfg = loaded;
+  return true;
+}
+
+void saveConfig() {
+  configDirty = false;
+  timers.cancel(EVT_CONFIG_SAVE);
+  if (!mountFs()) return;
+
+  // Write a temp file and rename it over the old one, so a brown-out mid
+  // write leaves the previous config intact
+  File f = LittleFS.open("/config.tmp", "w");
+  if (!f) {
+    Serial.println("Failed to open config file for writing");
+    return;
+  }
+  bool ok = writeConfigBin(f, config);
+  f.close();
+  if (!ok || !LittleFS.rename("/config.tmp", "/config.bin")) {
+    Serial.println("Failed to write config file");
+    LittleFS.remove("/config.tmp");
+    return;
+  }
+  if (LittleFS.exists("/config.json")) {
+    LittleFS.remove("/config.json"); // migrated to /config.bin
+  }
+  Serial.println("Config saved");
+}
+
+// Write now if anything is pending; called before restarts and sleeps
+void flushConfig() {
+  if (configDirty) saveConfig();
+}
+
+// One-time migration path for configs written by older firmware
+static bool loadLegacyJsonConfig() {
+  File f = LittleFS.open("/config.json", "r");
+  if (!f) {
+    Serial.println("Failed to open config.json");
+    return false;
+  }
+  DynamicJsonDocument doc(configJsonParseCapacity(f.size()));
+  auto err = deserializeJson(doc, f);
+  f.close();
+  if (err) {
+    Serial.printf("Failed to parse config.json: %s\n", err.c_str());
+    return false;
+  }
+  configFromJson(doc, config);
+  return true;
+}
+
+void loadConfig() {
+  if (!mountFs()) return;
+  if (LittleFS.exists("/config.tmp")) {
+    LittleFS.remove("/config.tmp"); // leftover from an interrupted save
+  }
+  if (LittleFS.exists("/config.bin")) {
+    File f = LittleFS.open("/config.bin", "r");
+    bool ok = f && readConfigBin(f, config);
+    if (f) f.close();
+    if (ok) {
+      Serial.println("Config loaded");
+      return;
+    }
+    Serial.println("config.bin invalid, trying config.json");
+  }
+  if (!LittleFS.exists("/config.json")) {
+    Serial.println("No config, using defaults");
+    return;
+  }
+  if (loadLegacyJsonConfig()) {
+    Serial.println("Config loaded from config.json, migrating");
+    markConfigDirty();
+  }
+}
+
+void applyChannelPin(uint8_t ch) {
+  const ChannelConfig &c = config.channels[ch];
+  gpio.output(c.pin);
+  // Set the pin to inactive level initially
+  gpio.write(c.pin, !c.activeHigh);
+}
+
+void applyChannelPins() {
+  for (uint8_t i = 0; i < config.channelCount; i++) applyChannelPin(i);
+}
+
+// ================== Event log ==================
+// Every trigger outcome is one fixed-size record in /events.log: a small
+// header, then a ring of EVENT_LOG_CAPACITY slots. Record seq n lives in
+// slot n % capacity, so the newest record is found by one scan at boot and
+// reading any record is a seek. Records collect in RAM and are written
+// EVENT_LOG_BATCH at a time, at most EVENT_LOG_FLUSH_MS after the first
+// one, and before restarts and sleeps; a power cut loses at most the
+// unwritten batch. LittleFS wear-levels the rewritten slots.
+static const uint16_t EVENT_LOG_CAPACITY = 2048;    // 56 KB of flash
+static const uint8_t EVENT_LOG_BATCH = 16;
+static const uint32_t EVENT_LOG_FLUSH_MS = 60000;
+static const uint32_t EVENT_LOG_MAGIC = 0x4C454644; // "DFEL"
+static const uint8_t EVENT_LOG_VERSION = 1;
+static const char *const EVENT_LOG_PATH = "/events.log";
+
+// EventRecord.flags
+static const uint8_t EVENT_FLAG_DROPPED = 0x01;   // channel busy under the drop policy; no pulse
+static const uint8_t EVENT_FLAG_OVERFLOW = 0x02;  // trigger queue full; no pulse
+static const uint8_t EVENT_FLAG_COALESCED = 0x04; // later requests extended this pulse
+static const uint8_t EVENT_FLAG_QUEUED = 0x08;    // waited for the channel to go idle
+static const uint8_t EVENT_FLAG_ABORTED = 0x10;   // ended by the pulse watchdog or a config change
+static const uint8_t EVENT_FLAG_COUNT = 5;
+static const char *const EVENT_FLAG_NAMES[EVENT_FLAG_COUNT] = {"dropped", "overflow", "coalesced", "queued",
+                                                               "aborted"};
+
+struct EventRecord {
+  uint32_t seq;
+  uint32_t epochSec;    // start, UTC; 0 when the clock was not synced before the write
+  uint32_t uptimeMs;    // millis() at the start
+  uint32_t requestedMs;
+  uint32_t actualMs;    // measured width; 0 when no pulse ran
+  uint8_t channel;
+  uint8_t source;       // TriggerSource
+  uint8_t flags;        // EVENT_FLAG_*
+  uint8_t reserved;
+  uint32_t crc;         // over everything before this field; catches a torn slot
+};
+static_assert(sizeof(EventRecord) == 28, "EventRecord is stored on flash");
+
+struct EventLogHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t recordSize;
+  uint16_t capacity;
+};
+
+struct EventLog {
+  bool ready = false;     // file opened and scanned
+  uint32_t firstSeq = 0;  // oldest record held, on flash or in RAM
+  uint32_t nextSeq = 0;   // seq of the next record
+  EventRecord batch[EVENT_LOG_BATCH]; // not written yet, seqs nextSeq - pending on
+  uint8_t pending = 0;
+  uint32_t flushes = 0;
+  uint32_t lost = 0;      // records a failed write discarded
+};
+EventLog eventLog;
+
+static uint32_t eventRecordCrc(const EventRecord &r) {
+  return crc32Bytes(&r, offsetof(EventRecord, crc));
+}
+
+static size_t eventLogOffset(uint32_t seq) {
+  return sizeof(EventLogHeader) + (size_t)(seq % EVENT_LOG_CAPACITY) * sizeof(EventRecord);
+}
+
+// UTC seconds at a past millis(), 0 while the clock is not synced
+static uint32_t eventEpochSec(uint32_t atMillis) {
+  if (!timeSync.valid) return 0;
+  uint32_t now = millis();
+  return (uint32_t)((timeSyncExtrapolate(now) - (int64_t)(now - atMillis)) / 1000);
+}
+
+// Finds the newest record, or starts a new log when the file is missing or
+// from another layout
+void eventLogBegin() {
+  if (!mountFs()) return;
+  EventLogHeader h;
+  File f = LittleFS.open(EVENT_LOG_PATH, "r");
+  bool ok = f && f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == EVENT_LOG_MAGIC &&
+            h.version == EVENT_LOG_VERSION && h.recordSize == sizeof(EventRecord) && h.capacity == EVENT_LOG_CAPACITY;
+  bool any = false;
+  uint32_t oldest = 0, newest = 0;
+  if (ok) {
+    EventRecord buf[8];
+    size_t n;
+    while ((n = f.read((uint8_t *)buf, sizeof(buf)) / sizeof(EventRecord)) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        if (buf[i].crc != eventRecordCrc(buf[i])) continue;
+        if (!any || buf[i].seq < oldest) oldest = buf[i].seq;
+        if (!any || buf[i].seq > newest) newest = buf[i].seq;
+        any = true;
+      }
+      yield();
+    }
+  }
+  if (f) f.close();
+  if (!ok) {
+    h.magic = EVENT_LOG_MAGIC;
+    h.version = EVENT_LOG_VERSION;
+    h.recordSize = sizeof(EventRecord);
+    h.capacity = EVENT_LOG_CAPACITY;
+    f = LittleFS.open(EVENT_LOG_PATH, "w");
+    ok = f && f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+    if (f) f.close();
+    if (!ok) {
+      Serial.println("Event log: failed to create");
+      return;
+    }
+  }
+  eventLog.firstSeq = any ? oldest : 0;
+  eventLog.nextSeq = any ? newest + 1 : 0;
+  eventLog.ready = true;
+  Serial.printf("Event log: %lu records\n", (unsigned long)(eventLog.nextSeq - eventLog.firstSeq));
+}
+
+// Writes the RAM batch; called by EVT_EVENT_LOG_FLUSH, when the batch is
+// full and before restarts and sleeps
+void eventLogFlush() {
+  timers.cancel(EVT_EVENT_LOG_FLUSH);
+  uint8_t n = eventLog.pending;
+  if (!n) return;
+  eventLog.pending = 0;
+  File f;
+  if (eventLog.ready) f = LittleFS.open(EVENT_LOG_PATH, "r+");
+  bool ok = f;
+  // Times of records taken before the first NTP sync are filled in late
+  for (uint8_t i = 0; i < n; i++) {
+    EventRecord &r = eventLog.batch[i];
+    if (r.epochSec) continue;
+    r.epochSec = eventEpochSec(r.uptimeMs);
+    r.crc = eventRecordCrc(r);
+  }
+  // One write per contiguous run of slots; two when the ring wraps
+  for (uint8_t i = 0; ok && i < n;) {
+    uint32_t slot = eventLog.batch[i].seq % EVENT_LOG_CAPACITY;
+    uint8_t run = n - i;
+    if (run > EVENT_LOG_CAPACITY - slot) run = EVENT_LOG_CAPACITY - slot;
+    size_t len = run * sizeof(EventRecord);
+    ok = f.seek(eventLogOffset(eventLog.batch[i].seq)) &&
+         f.write((const uint8_t *)&eventLog.batch[i], len) == len;
+    i += run;
+  }
+  if (f) f.close();
+  if (ok) {
+    eventLog.flushes++;
+  } else {
+    eventLog.lost += n;
+    Serial.printf("Event log: write failed, %u records lost\n", n);
+  }
+}
+
+// Appends one trigger outcome. startMs is millis() when the pulse started,
+// or when the request was turned away.
+static void eventLogAdd(uint8_t ch, uint8_t source, uint8_t flags, uint32_t startMs, uint32_t requestedMs,
+                        uint32_t actualMs) {
+  if (eventLog.pending == EVENT_LOG_BATCH) eventLogFlush(); // the timer has not run yet
+  if (eventLog.pending == 0) timers.armIn(EVT_EVENT_LOG_FLUSH, EVENT_LOG_FLUSH_MS);
+  EventRecord &r = eventLog.batch[eventLog.pending++];
+  r.seq = eventLog.nextSeq++;
+  r.epochSec = eventEpochSec(startMs);
+  r.uptimeMs = startMs;
+  r.requestedMs = requestedMs;
+  r.actualMs = actualMs;
+  r.channel = ch;
+  r.source = source;
+  r.flags = flags;
+  r.reserved = 0;
+  r.crc = eventRecordCrc(r);
+  if (eventLog.nextSeq - eventLog.firstSeq > EVENT_LOG_CAPACITY) eventLog.firstSeq = eventLog.nextSeq - EVENT_LOG_CAPACITY;
+  // Written from the timer queue rather than in the middle of trigger handling
+  if (eventLog.pending == EVENT_LOG_BATCH) timers.armIn(EVT_EVENT_LOG_FLUSH, 0);
+}
+
+// Record seq from the RAM batch or from f; false when it is gone or torn
+static bool eventLogRead(File &f, uint32_t seq, EventRecord &r) {
+  uint32_t batchFirst = eventLog.nextSeq - eventLog.pending;
+  if (seq >= batchFirst) {
+    if (seq >= eventLog.nextSeq) return false;
+    r = eventLog.batch[seq - batchFirst];
+    return true;
+  }
+  return f && f.seek(eventLogOffset(seq)) && f.read((uint8_t *)&r, sizeof(r)) == sizeof(r) && r.seq == seq &&
+         r.crc == eventRecordCrc(r);
+}
+
+// ================== Pulse engine ==================
+// Pulse ends are driven by a timer1 interrupt, so their width does not
+// depend on how long loop() is busy. Starts requested during a loop pass are
+// collected and committed together by pulseCommit(), so all channels due in
+// the same tick switch in one GPOS/GPOC write. The ISR likewise ends every
+// due channel with one write and re-arms for the next end; loop() only
+// reports the result.
+static const uint32_t TIMER1_TICKS_PER_US = 5;         // TIM_DIV16: 80 MHz / 16
+static const uint32_t TIMER1_MAX_TICKS = 0x7FFFFF;     // 23-bit counter, ~1.68 s per shot
+static const uint32_t PULSE_WATCHDOG_MS = 50;          // loop-side backstop after the deadline
+
+struct ChannelPulse {
+  volatile uint32_t startUs = 0;
+  volatile uint32_t endUs = 0;   // target end
+  volatile uint32_t endedAtUs = 0;
+  uint8_t pin = 0;               // captured at start, so a config change ends the right pin
+  bool activeHigh = true;
+  uint32_t requestedMs = 0;
+  uint32_t startMs = 0;          // millis() at the start, for the event log
+  uint8_t source = 0;            // TriggerSource of the request that started it
+  uint8_t flags = 0;             // EVENT_FLAG_* gathered while it runs
+
+  // reporting
+  uint32_t lastWidthUs = 0;
+  uint32_t lastRequestedMs = 0;
+  uint32_t maxErrorUs = 0;       // worst |achieved - requested|
+  uint32_t overruns = 0;         // pulses the watchdog had to end
+  uint32_t pulses = 0;           // started since boot
+};
+
+struct PulseEngine {
+  volatile uint8_t activeMask = 0;
+  volatile uint8_t endedMask = 0;  // set by the ISR, cleared by pulseService()
+  uint8_t pendingMask = 0;         // accepted this loop pass, started by pulseCommit()
+  ChannelPulse ch[MAX_CHANNELS];
+};
+PulseEngine pulse;
+
+// Pin levels collected into one write per GPIO register
+struct PinWrite {
+  uint32_t set = 0;
+  uint32_t clr = 0;
+  int8_t gpio16 = -1; // GPIO16 lives in its own register
+};
+
+static void IRAM_ATTR pinWriteAdd(PinWrite &w, uint8_t pin, bool high) {
+  if (pin < 16) {
+    if (high) w.set |= (1UL << pin); else w.clr |= (1UL << pin);
+  } else if (pin == 16) {
+    w.gpio16 = high ? 1 : 0;
+  }
+}
+
+static void IRAM_ATTR pinWriteApply(const PinWrite &w) {
+  if (w.set) GPOS = w.set;
+  if (w.clr) GPOC = w.clr;
+  if (w.gpio16 == 1) GP16O |= 1; else if (w.gpio16 == 0) GP16O &= ~1;
+}
+
+// Arms timer1 for the earliest end among active channels, or stops it.
+// Called from the ISR or with interrupts disabled.
+static void IRAM_ATTR pulseArmNext(uint32_t nowUs) {
+  uint8_t active = pulse.activeMask;
+  if (!active) {
+    timer1_disable();
+    return;
+  }
+  uint32_t soonest = UINT32_MAX;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(active & (1 << i))) continue;
+    int32_t remaining = (int32_t)(pulse.ch[i].endUs - nowUs);
+    uint32_t r = remaining > 0 ? (uint32_t)remaining : 0;
+    if (r < soonest) soonest = r;
+  }
+  // Long pulses span several timer shots
+  uint32_t ticks = soonest > TIMER1_MAX_TICKS / TIMER1_TICKS_PER_US ? TIMER1_MAX_TICKS : soonest * TIMER1_TICKS_PER_US;
+  if (ticks < 10) ticks = 10;
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+  timer1_write(ticks);
+}
+
+static void IRAM_ATTR pulseTimerIsr() {
+  uint32_t now = micros();
+  uint8_t active = pulse.activeMask;
+  uint8_t due = 0;
+  PinWrite w;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(active & (1 << i)) || (int32_t)(pulse.ch[i].endUs - now) > 2) continue;
+    pinWriteAdd(w, pulse.ch[i].pin, !pulse.ch[i].activeHigh);
+    due |= 1 << i;
+  }
+  if (due) {
+    pinWriteApply(w);
+    uint32_t at = micros();
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+      if (due & (1 << i)) pulse.ch[i].endedAtUs = at;
+    }
+    pulse.activeMask = active & ~due;
+    pulse.endedMask |= due;
+  }
+  pulseArmNext(now);
+}
+
+bool pulseBusy() {
+  return (pulse.activeMask | pulse.pendingMask) != 0;
+}
+
+void pulseInit() {
+  timer1_attachInterrupt(pulseTimerIsr);
+}
+
+// EVT_PULSE_OFF backs up the ISR: armed PULSE_WATCHDOG_MS past the earliest
+// active end
+static void pulseArmWatchdog() {
+  uint8_t active = pulse.activeMask;
+  if (!active) {
+    timers.cancel(EVT_PULSE_OFF);
+    return;
+  }
+  uint32_t nowUs = micros();
+  uint32_t soonest = UINT32_MAX;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(active & (1 << i))) continue;
+    int32_t remaining = (int32_t)(pulse.ch[i].endUs - nowUs);
+    uint32_t r = remaining > 0 ? (uint32_t)remaining : 0;
+    if (r < soonest) soonest = r;
+  }
+  timers.armIn(EVT_PULSE_OFF, soonest / 1000 + PULSE_WATCHDOG_MS);
+}
+
+// Marks an idle channel to start in pulseCommit() at the end of this loop
+// pass, together with every other channel due now
+static void pulseRequest(uint8_t ch, uint32_t durationMs, uint8_t source, uint8_t flags) {
+  pulse.pendingMask |= 1 << ch;
+  ChannelPulse &p = pulse.ch[ch];
+  p.requestedMs = durationMs;
+  p.source = source;
+  p.flags = flags;
+}
+
+// Makes a pending or running pulse last until at least durationMs from now
+static void pulseExtend(uint8_t ch, uint32_t durationMs, uint8_t source) {
+  uint8_t bit = 1 << ch;
+  ChannelPulse &p = pulse.ch[ch];
+  if (pulse.pendingMask & bit) {
+    if (durationMs > p.requestedMs) p.requestedMs = durationMs;
+    p.flags |= EVENT_FLAG_COALESCED;
+    return;
+  }
+  noInterrupts();
+  bool active = pulse.activeMask & bit;
+  if (active) {
+    uint32_t end = micros() + durationMs * 1000UL;
+    if ((int32_t)(end - p.endUs) > 0) {
+      // the ISR re-arms when it wakes for the old end
+      p.endUs = end;
+      p.requestedMs = (end - p.startUs) / 1000;
+    }
+  }
+  interrupts();
+  if (active) {
+    p.flags |= EVENT_FLAG_COALESCED;
+    pulseArmWatchdog();
+  } else {
+    pulseRequest(ch, durationMs, source, 0); // ended in the meantime
+  }
+}
+
+// Starts all pending channels with a single register write per level
+void pulseCommit() {
+  uint8_t start = pulse.pendingMask;
+  if (!start) return;
+  pulse.pendingMask = 0;
+  PinWrite w;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(start & (1 << i))) continue;
+    const ChannelConfig &c = config.channels[i];
+    ChannelPulse &p = pulse.ch[i];
+    p.pin = (uint8_t)c.pin;
+    p.activeHigh = c.activeHigh;
+    p.startMs = millis();
+    p.pulses++;
+    pinWriteAdd(w, p.pin, p.activeHigh);
+  }
+  noInterrupts();
+  pinWriteApply(w);
+  uint32_t now = micros();
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(start & (1 << i))) continue;
+    pulse.ch[i].startUs = now;
+    pulse.ch[i].endUs = now + pulse.ch[i].requestedMs * 1000UL;
+  }
+  pulse.activeMask |= start;
+  pulseArmNext(now);
+  interrupts();
+  pulseArmWatchdog();
+  mqttStateChanged();
+  ssePending.pulseMask |= start;
+  Serial.printf("Trigger: ON (mask 0x%02x)\n", start);
+}
+
+// Ends a running or pending pulse immediately (pin change, watchdog)
+void pulseAbort(uint8_t ch) {
+  uint8_t bit = 1 << ch;
+  ChannelPulse &p = pulse.ch[ch];
+  if (pulse.pendingMask & bit) {
+    pulse.pendingMask &= ~bit;
+    eventLogAdd(ch, p.source, p.flags | EVENT_FLAG_ABORTED, millis(), p.requestedMs, 0);
+  }
+  noInterrupts();
+  if (pulse.activeMask & bit) {
+    p.flags |= EVENT_FLAG_ABORTED;
+    PinWrite w;
+    pinWriteAdd(w, p.pin, !p.activeHigh);
+    pinWriteApply(w);
+    p.endedAtUs = micros();
+    pulse.activeMask &= ~bit;
+    pulse.endedMask |= bit;
+    pulseArmNext(p.endedAtUs);
+  }
+  interrupts();
+}
+
+// Called every loop pass: picks up pulses the ISR has ended
+void pulseService() {
+  if (!pulse.endedMask) return;
+  noInterrupts();
+  uint8_t ended = pulse.endedMask;
+  pulse.endedMask = 0;
+  interrupts();
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(ended & (1 << i))) continue;
+    ChannelPulse &p = pulse.ch[i];
+    p.lastWidthUs = p.endedAtUs - p.startUs;
+    p.lastRequestedMs = p.requestedMs;
+    int32_t err = (int32_t)(p.lastWidthUs - p.requestedMs * 1000UL);
+    uint32_t absErr = err < 0 ? (uint32_t)(-err) : (uint32_t)err;
+    if (absErr > p.maxErrorUs) p.maxErrorUs = absErr;
+    eventLogAdd(i, p.source, p.flags, p.startMs, p.requestedMs, (p.lastWidthUs + 500) / 1000);
+    Serial.printf("Trigger %u: OFF (%lu us)\n", i, (unsigned long)p.lastWidthUs);
+  }
+  pulseArmWatchdog();
+  mqttStateChanged();
+  ssePending.pulseMask |= ended;
+}
+
+// EVT_PULSE_OFF fires only if the ISR did not end a pulse in time
+void onPulseWatchdog() {
+  uint32_t now = micros();
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (!(pulse.activeMask & (1 << i)) || (int32_t)(now - pulse.ch[i].endUs) < 0) continue;
+    pulse.ch[i].overruns++;
+    Serial.printf("Trigger %u: watchdog ended pulse\n", i);
+    pulseAbort(i);
+  }
+  pulseService();
+  pulseArmWatchdog();
+}
+
+// ================== Trigger queue ==================
+// Every trigger (web, MQTT, interval, schedule) is a request in a small ring
+// buffer. triggerQueueService() drains it once per loop pass, just before
+// pulseCommit(). Requests for an idle channel start it. For a channel that is
+// already pulsing, config.triggerPolicy decides:
+//   drop     - discard the request (counted)
+//   coalesce - extend the running pulse to end durationMs from now
+//   queue    - keep the request and start it once the channel is idle
+// Producers and the consumer all run in loop context, so the free-running
+// head/tail indices need no locking.
+enum TriggerSource : uint8_t {
+  TRIG_SRC_WEB,
+  TRIG_SRC_MQTT,
+  TRIG_SRC_INTERVAL,
+  TRIG_SRC_SCHEDULE,
+  TRIG_SRC_GROUP,
+  TRIG_SRC_COUNT
+};
+
+static const char *const TRIGGER_SOURCE_NAMES[TRIG_SRC_COUNT] = {"web", "mqtt", "interval", "schedule", "group"};
+
+static const uint8_t TRIGGER_QUEUE_SIZE = 16; // power of two
+static_assert((TRIGGER_QUEUE_SIZE & (TRIGGER_QUEUE_SIZE - 1)) == 0, "TRIGGER_QUEUE_SIZE must be a power of two");
+
+struct TriggerRequest {
+  uint32_t at;          // millis() when requested
+  uint32_t durationMs;
+  uint8_t channel;
+  uint8_t source;       // TriggerSource
+  uint8_t flags;        // EVENT_FLAG_QUEUED once it had to wait
+};
+
+struct TriggerQueue {
+  TriggerRequest buf[TRIGGER_QUEUE_SIZE];
+  uint8_t head = 0;     // next to pop; head == tail means empty
+  uint8_t tail = 0;
+  uint8_t maxDepth = 0;
+
+  uint32_t requests = 0;   // accepted into the queue
+  uint32_t dropped = 0;    // discarded by the drop policy or a removed channel
+  uint32_t coalesced = 0;  // merged into a running pulse
+  uint32_t overflows = 0;  // rejected because the queue was full
+  uint32_t maxWaitMs = 0;  // longest a request waited for its channel
+};
+TriggerQueue triggerQueue;
+
+static uint8_t triggerQueueDepth() {
+  return (uint8_t)(triggerQueue.tail - triggerQueue.head);
+}
+
+static void triggerQueuePush(const TriggerRequest &r) {
+  triggerQueue.buf[triggerQueue.tail++ & (TRIGGER_QUEUE_SIZE - 1)] = r;
+  uint8_t depth = triggerQueueDepth();
+  if (depth > triggerQueue.maxDepth) triggerQueue.maxDepth = depth;
+}
+
+// Request a pulse on ch, at its configured duration unless durationMs is
+// given. Returns false when the queue is full and the request was lost, or
+// in safe mode.
+bool triggerPulse(uint8_t ch, TriggerSource src, uint32_t durationMs = 0) {
+  if (ch >= config.channelCount || safeMode) return false;
+  if (!durationMs) durationMs = config.channels[ch].durationMs;
+  if (triggerQueueDepth() >= TRIGGER_QUEUE_SIZE) {
+    triggerQueue.overflows++;
+    eventLogAdd(ch, src, EVENT_FLAG_OVERFLOW, millis(), durationMs, 0);
+    statusChanged();
+    Serial.printf("Trigger %u: queue full, %s request lost\n", ch, TRIGGER_SOURCE_NAMES[src]);
+    return false;
+  }
+  TriggerRequest r;
+  r.at = millis();
+  r.durationMs = durationMs;
+  r.channel = ch;
+  r.source = src;
+  r.flags = 0;
+  triggerQueuePush(r);
+  triggerQueue.requests++;
+  statusChanged();
+  return true;
+}
+
+// Called every loop pass before pulseCommit()
+void triggerQueueService() {
+  if (triggerQueueDepth() == 0) return;
+  // Report pulses that just ended first, so their channels count as idle
+  // and a queued request follows back-to-back
+  pulseService();
+
+  uint8_t held = 0; // channels with a request put back this pass, keeps their order
+  for (uint8_t n = triggerQueueDepth(); n > 0; n--) {
+    TriggerRequest r = triggerQueue.buf[triggerQueue.head++ & (TRIGGER_QUEUE_SIZE - 1)];
+    if (r.channel >= config.channelCount) {
+      triggerQueue.dropped++;
+      eventLogAdd(r.channel, r.source, EVENT_FLAG_DROPPED, millis(), r.durationMs, 0);
+      statusChanged();
+      continue;
+    }
+    uint8_t bit = 1 << r.channel;
+    // endedMask: ended after pulseService() above, not yet reported
+    bool busy = (pulse.activeMask | pulse.endedMask | pulse.pendingMask | held) & bit;
+    if (!busy) {
+      uint32_t waited = millis() - r.at;
+      if (waited > triggerQueue.maxWaitMs) triggerQueue.maxWaitMs = waited;
+      pulseRequest(r.channel, r.durationMs, r.source, r.flags);
+      statusChanged(); // depth changed
+      continue;
+    }
+    switch (config.triggerPolicy) {
+      case TRIGGER_POLICY_COALESCE:
+        pulseExtend(r.channel, r.durationMs, r.source);
+        triggerQueue.coalesced++;
+        statusChanged();
+        break;
+      case TRIGGER_POLICY_QUEUE:
+        held |= bit;
+        r.flags |= EVENT_FLAG_QUEUED;
+        triggerQueuePush(r);
+        break;
+      default:
+        triggerQueue.dropped++;
+        eventLogAdd(r.channel, r.source, EVENT_FLAG_DROPPED, millis(), r.durationMs, 0);
+        statusChanged();
+        Serial.printf("Trigger %u: busy, %s request dropped\n", r.channel, TRIGGER_SOURCE_NAMES[r.source]);
+        break;
+    }
+  }
+}
+
+// ================== Interval ==================
+// (Re)start a channel's interval phase from now, or stop it when disabled
+void armInterval(uint8_t ch) {
+  const ChannelConfig &c = config.channels[ch];
+  if (ch < config.channelCount && c.intervalEnabled && c.intervalSeconds > 0) {
+    timers.armIn(EVT_INTERVAL + ch, c.intervalSeconds * 1000UL);
+  } else {
+    timers.cancel(EVT_INTERVAL + ch);
+  }
+  ssePending.intervalMask |= 1 << ch;
+}
+
+void armIntervals() {
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) armInterval(i);
+}
+
+void onIntervalTimer(uint8_t ch) {
+  const ChannelConfig &c = config.channels[ch];
+  if (ch >= config.channelCount || !c.intervalEnabled || c.intervalSeconds == 0) return;
+  triggerPulse(ch, TRIG_SRC_INTERVAL);
+  uint8_t evt = EVT_INTERVAL + ch;
+  timers.arm(evt, intervalNextDeadline(timers.deadline(evt), c.intervalSeconds * 1000UL, millis()));
+  ssePending.intervalMask |= 1 << ch;
+}
+
+// Offsets come from a table of the DST transitions of this year and the
+// next, so a conversion is a short scan instead of a calendar computation
+TzTable tzTable;
+
+// Loads config.timezone, or the fixed offset when it is empty or invalid
+void applyTimezone() {
+  PosixTz tz;
+  if (!config.timezone[0] || !parsePosixTz(config.timezone, tz)) {
+    if (config.timezone[0]) Serial.printf("Timezone '%s' is invalid, using the fixed offset\n", config.timezone);
+    tz = PosixTz();
+    tz.stdOffsetMin = config.timezoneOffsetMinutes;
+  }
+  tzTableLoad(tzTable, tz);
+}
+
+struct LocalNow {
+  int64_t epochMs;
+  int32_t offsetMin; // UTC offset in force
+  int32_t day;       // local days since 1970
+  int64_t msOfDay;
+  int minute;        // local minutes after midnight
+};
+
+static LocalNow localNow() {
+  LocalNow now;
+  now.epochMs = systemClock.epochMs();
+  now.offsetMin = tzOffsetMinutes(tzTable, now.epochMs);
+  now.day = localDay(now.epochMs, now.offsetMin);
+  now.msOfDay = localMsOfDay(now.epochMs, now.offsetMin);
+  now.minute = (int)(now.msOfDay / 60000);
+  return now;
+}
+
+// Milliseconds until the next fire on any channel (or local midnight, to
+// start the next day, or a DST change), bounded so clock steps are noticed
+// within a minute
+static uint32_t msUntilScheduleCheck() {
+  LocalNow now = localNow();
+  int64_t targetMin = 1440;
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    int m = scheduleNextMin(schedules[i]);
+    if (m >= 0 && m < targetMin) targetMin = m;
+  }
+  int64_t wait = targetMin * 60000 - now.msOfDay;
+  int64_t toTransition = tzNextTransition(tzTable, now.epochMs) - now.epochMs;
+  if (toTransition < wait) wait = toTransition;
+  if (wait < 0) wait = 0;
+  return wait < SCHEDULE_MAX_WAIT_MS ? (uint32_t)wait : SCHEDULE_MAX_WAIT_MS;
+}
+
+// Milliseconds until the next fire on any channel, looking into tomorrow
+// once a channel is done for today. Rules idle tomorrow as well count as
+// the end of tomorrow, when they are looked at again. UINT32_MAX when every
+// schedule is empty.
+static uint32_t msUntilNextScheduledFire() {
+  LocalNow now = localNow();
+  int64_t targetMin = INT64_MAX;
+  int32_t tomorrow = now.day + 1;
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    const std::vector<ScheduleRule> &rules = config.channels[i].scheduleRules;
+    int64_t m = scheduleNextMin(schedules[i]);
+    if (m < 0) {
+      m = scheduleFirstFireOfDay(schedules[i], rules.data(), rules.size(), tomorrow);
+      if (m < 0 && rules.empty()) continue;
+      m = m < 0 ? 2 * 1440 : m + 1440;
+    }
+    if (m < targetMin) targetMin = m;
+  }
+  if (targetMin == INT64_MAX) return UINT32_MAX;
+  int64_t wait = targetMin * 60000 - now.msOfDay;
+  // Wall-clock to elapsed time, across a DST change before the fire
+  wait -= (int64_t)(tzOffsetMinutes(tzTable, now.epochMs + wait) - now.offsetMin) * 60000;
+  return wait < 0 ? 0 : (uint32_t)wait;
+}
+
+// First local minute a check at now may fire: the one after the last
+// minute evaluated today, but no further back than the catch-up window.
+// Without any record (first check after a cold boot) only the current
+// minute fires, since what ran before the reset is unknown.
+static int scheduleFromMin(const LocalNow &now) {
+  if (scheduleDay < 0) return now.minute;
+  int64_t windowMs = now.msOfDay - (int64_t)config.scheduleCatchUpSec * 1000;
+  int from = windowMs <= 0 ? 0 : (int)((windowMs + 59999) / 60000);
+  if (from > now.minute) from = now.minute;
+  if (now.day == scheduleDay && from <= scheduleHighMin) from = scheduleHighMin + 1;
+  return from;
+}
+
+// Loads the fires of now's day for every channel from fromMin on
+static void startScheduleDay(const LocalNow &now, int fromMin) {
+  for (uint8_t ch = 0; ch < config.channelCount; ch++) {
+    const std::vector<ScheduleRule> &rules = config.channels[ch].scheduleRules;
+    scheduleStartDay(schedules[ch], rules.data(), rules.size(), now.day, fromMin);
+  }
+  scheduleLoadedDay = now.day;
+}
+
+// Rebuild the compiled tables from each channel's scheduleMinutes and
+// scheduleRules. Minutes already evaluated today stay skipped, so nothing
+// fires twice.
+void compileSchedule() {
+  for (uint8_t ch = 0; ch < MAX_CHANNELS; ch++) {
+    CompiledSchedule &sc = schedules[ch];
+    scheduleClear(sc);
+    if (ch >= config.channelCount) continue;
+    const ChannelConfig &c = config.channels[ch];
+    for (uint8_t i = 0; i < c.scheduleCount; i++) scheduleInsert(sc, c.scheduleMinutes[i]);
+  }
+  if (timeSync.valid) {
+    LocalNow now = localNow();
+    startScheduleDay(now, scheduleFromMin(now));
+  } else {
+    scheduleLoadedDay = -1; // the first check with real time loads the day
+  }
+  timers.armIn(EVT_SCHEDULE, msUntilScheduleCheck());
+}
+
+// Folds channel ch's compiled times and its rules into crc
+static uint32_t scheduleCrcUpdate(uint32_t crc, uint8_t ch) {
+  const CompiledSchedule &sc = schedules[ch];
+  crc = crc32Update(crc, &sc.count, 1);
+  crc = crc32Update(crc, sc.minutes, sc.count * sizeof(sc.minutes[0]));
+  for (auto &r : config.channels[ch].scheduleRules) {
+    ConfigBinRule rec;
+    ruleToBin(r, rec);
+    crc = crc32Update(crc, &rec, sizeof(rec));
+  }
+  return crc;
+}
+
+// Picks up how far the schedule was evaluated before a warm reset or deep
+// sleep
+void restoreScheduleFromRtc() {
+  if (!rtcStateValid || rtcState.scheduleDay < 0) return;
+  scheduleDay = rtcState.scheduleDay;
+  scheduleHighMin = rtcState.scheduleHighMin;
+  scheduleOffsetMin = rtcState.scheduleOffsetMin;
+  scheduleLastEvalMs = rtcState.scheduleLastEvalMs;
+  Serial.printf("Schedule: evaluated through %02d:%02d on day %ld before the reset\n", scheduleHighMin / 60,
+                scheduleHighMin % 60, (long)scheduleDay);
+}
+
+static void rtcSaveSchedule() {
+  rtcState.scheduleDay = scheduleDay;
+  rtcState.scheduleHighMin = (int16_t)scheduleHighMin;
+  rtcState.scheduleOffsetMin = (int16_t)scheduleOffsetMin;
+  rtcState.scheduleLastEvalMs = scheduleLastEvalMs;
+  rtcSave();
+}
+
+// Fire everything due from fromMin through currentMin on every channel.
+// Only the head of each channel's time table and rule heap is inspected,
+// so a check is O(channels) and each fire O(log rules), regardless of the
+// table sizes. All channels that fire here start in the same commit.
+void checkSchedule(int fromMin, int currentMin) {
+  for (uint8_t ch = 0; ch < config.channelCount; ch++) {
+    CompiledSchedule &sc = schedules[ch];
+    uint32_t durationMs;
+    int next;
+    scheduleSkipTo(sc, fromMin);
+    while ((next = scheduleNextMin(sc)) >= 0 && schedulePopDue(sc, fromMin, currentMin, durationMs)) {
+      triggerPulse(ch, TRIG_SRC_SCHEDULE, durationMs);
+      if (next < currentMin) scheduleCaughtUp++;
+      Serial.printf("Scheduled trigger on channel %u for %02d:%02d%s\n", ch, next / 60, next % 60,
+                    next < currentMin ? " (catch-up)" : "");
+    }
+  }
+}
+
+// Local minutes are evaluated in order, each once: every check fires what
+// lies between the last minute evaluated and now, within the catch-up
+// window, so a loop stall, a forward clock step or a reboot over an entry
+// still fires it. When clocks go forward for DST, the whole skipped hour
+// fires at the change, whatever the window. When clocks go back, the
+// repeated minutes were already evaluated, so everything fires once, on
+// the first pass.
+void onScheduleTimer() {
+  if (!timeSync.valid) {
+    // No time before NTP; timeSyncService() re-runs this on the first sync
+    timers.armIn(EVT_SCHEDULE, SCHEDULE_MAX_WAIT_MS);
+    return;
+  }
+  LocalNow now = localNow();
+  if (now.offsetMin != scheduleOffsetMin) statusChanged(); // utcOffsetMinutes in /api/status
+
+  int fromMin = scheduleFromMin(now);
+  // Weekday and date bounds change with the day, so every rule is re-evaluated
+  if (now.day != scheduleLoadedDay) startScheduleDay(now, fromMin);
+  if (now.day != scheduleDay) {
+    scheduleHighMin = -1;
+    Serial.println("New day: reset schedule flags");
+  } else if (now.offsetMin > scheduleOffsetMin && scheduleHighMin + 1 < fromMin) {
+    fromMin = scheduleHighMin + 1;
+    Serial.printf("DST: clocks went forward, firing entries from %02d:%02d\n", fromMin / 60, fromMin % 60);
+  }
+  checkSchedule(fromMin, now.minute);
+  scheduleDay = now.day;
+  if (now.minute > scheduleHighMin) scheduleHighMin = now.minute;
+  scheduleOffsetMin = now.offsetMin;
+  scheduleLastEvalMs = now.epochMs;
+  rtcSaveSchedule();
+  timers.armIn(EVT_SCHEDULE, msUntilScheduleCheck());
+}
+
+// ================== Group triggers ==================
+// Devices join one LAN multicast group and fire for trigger packets
+// addressed to one of config.groups. A packet carries the time the pulse
+// should start, a little in the future, so members fire together whatever
+// the network delay.
+//
+// Start times are on the group clock. A member set as leader broadcasts a
+// beacon with its clock every 2 s. The others measure the offset of that
+// clock from their own, keeping the least delayed of the last 8 beacons,
+// so WiFi jitter drops out and a member needs no NTP of its own. Without
+// a leader the group clock is NTP time. A member with neither fires on
+// receipt. The last stretch of the wait is a busy-wait on micros(), and
+// the achieved start is compared to the target for `startErrorUs`.
+//
+// Each trigger packet is sent several times to cover loss; the sender id
+// and sequence number make the copies fire once.
+static const uint16_t GROUP_PORT = 4210;
+static const uint32_t GROUP_MAGIC = 0x54474644;          // "DFGT"
+static const uint32_t GROUP_BEACON_MAGIC = 0x42474644;   // "DFGB"
+static const uint8_t GROUP_PROTO_VERSION = 1;
+static const uint32_t GROUP_DEFAULT_LEAD_MS = 250;       // start delay when the sender gives none
+static const uint32_t GROUP_MAX_LEAD_MS = 60000;         // later starts are rejected
+static const uint32_t GROUP_MAX_LATE_MS = 1000;          // packets for older starts are stale
+static const uint32_t GROUP_JOIN_RETRY_MS = 5000;
+static const uint32_t GROUP_BEACON_MS = 2000;
+static const uint32_t GROUP_BEACON_TIMEOUT_MS = 10000;   // then another leader may be followed
+static const uint8_t GROUP_BEACON_WINDOW = 8;
+static const uint32_t GROUP_SPIN_MS = 3;                 // final wait before a start, on micros()
+static const uint8_t GROUP_SEND_COPIES = 3;
+static const uint8_t GROUP_PENDING_MAX = 4;
+static const uint8_t GROUP_SEEN_MAX = 8;
+
+const IPAddress GROUP_MULTICAST_ADDR(239, 255, 68, 70);
+
+// Wire format, little-endian. Beacons use the same layout with
+// GROUP_BEACON_MAGIC: startEpochMs is the leader's clock when sent, and
+// one round for several groups shares its seq.
+struct __attribute__((packed)) GroupPacket {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t channelMask;  // bit n = channel n, 0 = every channel
+  uint16_t group;
+  uint32_t sender;      // chip id; with seq identifies one trigger
+  uint32_t seq;
+  uint32_t durationMs;  // 0 = each channel's pulse
+  int64_t startEpochMs; // group clock; 0 = on receipt
+};
+static_assert(sizeof(GroupPacket) == 28, "GroupPacket is a wire format");
+
+struct GroupPending {
+  int64_t startMs;      // on groupLocalMs()
+  uint32_t durationMs;
+  uint8_t channelMask;
+};
+
+struct GroupSeen {
+  uint32_t sender;
+  uint32_t seq;
+};
+
+// The followed leader's clock relative to ours
+struct GroupBeacon {
+  uint32_t leader = 0;      // chip id, 0 = none
+  uint32_t lastMillis = 0;  // last beacon from it
+  uint32_t lastSeq = 0;
+  uint32_t syncs = 0;       // timeSync.syncs the samples were taken against
+  int64_t samples[GROUP_BEACON_WINDOW]; // leader minus local at receipt
+  uint8_t sampleCount = 0;
+  uint8_t sampleNext = 0;
+  int64_t offsetMs = 0;     // largest sample: the least delayed beacon
+  int32_t jitterMs = 0;     // spread of the samples
+  uint32_t received = 0;
+};
+
+struct GroupLink {
+  WiFiUDP udp;
+  uint32_t joinedIp = 0;  // interface address of the membership, 0 = not joined
+  uint32_t joinRetryAt = 0;
+  uint32_t seq = 0;       // seeded randomly at boot
+  GroupSeen seen[GROUP_SEEN_MAX];
+  uint8_t seenNext = 0;
+  GroupPending pending[GROUP_PENDING_MAX];
+  uint8_t pendingCount = 0;
+  GroupBeacon beacon;
+
+  uint32_t sent = 0;       // triggers sent, not counting copies
+  uint32_t received = 0;   // accepted for one of our groups
+  uint32_t fired = 0;
+  uint32_t duplicates = 0; // copies of a trigger already accepted
+  uint32_t stale = 0;      // start too far in the past or future
+  uint32_t unsynced = 0;   // fired on receipt for lack of a clock
+  uint32_t overflows = 0;  // dropped, every pending slot taken
+
+  // Achieved start minus target, pulses started from a timed trigger
+  uint32_t timedStarts = 0;
+  int32_t lastStartErrorUs = 0;
+  uint32_t maxStartErrorUs = 0; // worst |error|
+};
+GroupLink groupLink;
+
+static bool groupIsMember(uint16_t group) {
+  for (uint16_t g : config.groups) {
+    if (g == group) return true;
+  }
+  return false;
+}
+
+// Our clock for group timing: NTP time once synced, millis() before
+static int64_t groupLocalMs() {
+  return timeSync.valid ? systemClock.epochMs() : (int64_t)millis();
+}
+
+// True while a leader's beacons are fresh and measured against the
+// current local clock
+static bool groupFollowing() {
+  const GroupBeacon &b = groupLink.beacon;
+  return !config.groupLeader && b.leader && b.sampleCount && b.syncs == timeSync.syncs &&
+         millis() - b.lastMillis < GROUP_BEACON_TIMEOUT_MS;
+}
+
+// Local start for a group-clock time; false when there is no group clock
+static bool groupToLocal(int64_t groupMs, int64_t &localMs) {
+  if (groupFollowing()) {
+    localMs = groupMs - groupLink.beacon.offsetMs;
+    return true;
+  }
+  if (timeSync.valid) {
+    localMs = groupMs;
+    return true;
+  }
+  return false;
+}
+
+// Triggers the channels in mask. A timed fire starts the pulses right away
+// rather than at the end of the loop pass, and measures the achieved start
+// against targetUs (micros()).
+static void groupFire(uint8_t channelMask, uint32_t durationMs, bool timed = false, uint32_t targetUs = 0) {
+  uint32_t before[MAX_CHANNELS];
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    before[i] = pulse.ch[i].pulses;
+    if (!channelMask || (channelMask & (1 << i))) triggerPulse(i, TRIG_SRC_GROUP, durationMs);
+  }
+  groupLink.fired++;
+  statusChanged();
+  if (!timed) return;
+  triggerQueueService();
+  pulseCommit();
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    if (pulse.ch[i].pulses == before[i]) continue; // busy, the policy held or dropped it
+    int32_t err = (int32_t)(pulse.ch[i].startUs - targetUs);
+    uint32_t absErr = err < 0 ? (uint32_t)(-err) : (uint32_t)err;
+    groupLink.timedStarts++;
+    groupLink.lastStartErrorUs = err;
+    if (absErr > groupLink.maxStartErrorUs) groupLink.maxStartErrorUs = absErr;
+    Serial.printf("Group: started %ld us from target\n", (long)err);
+    break; // one commit, so every channel shares the error
+  }
+}
+
+static void groupArmStart() {
+  if (groupLink.pendingCount == 0) {
+    timers.cancel(EVT_GROUP_START);
+    return;
+  }
+  int64_t soonest = groupLink.pending[0].startMs;
+  for (uint8_t i = 1; i < groupLink.pendingCount; i++) {
+    if (groupLink.pending[i].startMs < soonest) soonest = groupLink.pending[i].startMs;
+  }
+  int64_t wait = soonest - GROUP_SPIN_MS - groupLocalMs();
+  timers.armIn(EVT_GROUP_START, wait > 0 ? (uint32_t)wait : 0);
+}
+
+// EVT_GROUP_START, GROUP_SPIN_MS ahead of the earliest start: waits out
+// the rest on micros() and fires, then the next if it is as close
+void onGroupStartTimer() {
+  for (;;) {
+    uint8_t first = GROUP_PENDING_MAX;
+    for (uint8_t i = 0; i < groupLink.pendingCount; i++) {
+      if (first == GROUP_PENDING_MAX || groupLink.pending[i].startMs < groupLink.pending[first].startMs) first = i;
+    }
+    if (first == GROUP_PENDING_MAX) break;
+    GroupPending p = groupLink.pending[first];
+    int64_t wait = p.startMs - groupLocalMs();
+    if (wait > (int64_t)GROUP_SPIN_MS) break;
+    uint32_t target = micros() + (int32_t)(wait * 1000); // in the past when we are late
+    while ((int32_t)(micros() - target) < 0) {
+    }
+    groupLink.pending[first] = groupLink.pending[--groupLink.pendingCount];
+    groupFire(p.channelMask, p.durationMs, true, target);
+  }
+  groupArmStart();
+}
+
+// Fires or schedules one trigger packet, from the network or our own send
+static void groupAccept(const GroupPacket &p) {
+  if (p.magic != GROUP_MAGIC || p.version != GROUP_PROTO_VERSION || !groupIsMember(p.group)) return;
+  for (const GroupSeen &s : groupLink.seen) {
+    if (s.sender == p.sender && s.seq == p.seq) {
+      groupLink.duplicates++;
+      return;
+    }
+  }
+  groupLink.seen[groupLink.seenNext] = {p.sender, p.seq};
+  groupLink.seenNext = (groupLink.seenNext + 1) % GROUP_SEEN_MAX;
+  groupLink.received++;
+  statusChanged();
+
+  int64_t startMs;
+  if (p.startEpochMs == 0 || !groupToLocal(p.startEpochMs, startMs)) {
+    if (p.startEpochMs != 0) groupLink.unsynced++;
+    groupFire(p.channelMask, p.durationMs);
+    return;
+  }
+  int64_t wait = startMs - groupLocalMs();
+  if (wait < -(int64_t)GROUP_MAX_LATE_MS || wait > (int64_t)GROUP_MAX_LEAD_MS) {
+    groupLink.stale++;
+    Serial.printf("Group %u: start %ld ms off, ignored\n", p.group, (long)wait);
+    return;
+  }
+  if (groupLink.pendingCount >= GROUP_PENDING_MAX) {
+    groupLink.overflows++;
+    Serial.printf("Group %u: too many pending triggers, dropped\n", p.group);
+    return;
+  }
+  // Late ones too, so they start at once and report how late
+  groupLink.pending[groupLink.pendingCount++] = {startMs, p.durationMs, p.channelMask};
+  groupArmStart();
+  Serial.printf("Group %u: firing in %ld ms\n", p.group, (long)wait);
+}
+
+// One beacon sample of the leader's clock. The first member group a
+// leader beacons for is followed until it falls silent.
+static void groupBeaconReceived(const GroupPacket &p) {
+  GroupBeacon &b = groupLink.beacon;
+  if (config.groupLeader || p.version != GROUP_PROTO_VERSION || !groupIsMember(p.group)) return;
+  bool silent = millis() - b.lastMillis >= GROUP_BEACON_TIMEOUT_MS;
+  if (p.sender != b.leader) {
+    if (b.leader && !silent) return;
+    b.leader = p.sender;
+    b.sampleCount = 0;
+    statusChanged();
+    Serial.printf("Group: following leader %08lx\n", (unsigned long)p.sender);
+  } else if (b.sampleCount && p.seq == b.lastSeq) {
+    return; // same round, for another of our groups
+  }
+  if (b.syncs != timeSync.syncs || silent) b.sampleCount = 0; // our clock stepped or the samples are old
+  b.syncs = timeSync.syncs;
+  b.lastMillis = millis();
+  b.lastSeq = p.seq;
+  b.received++;
+  b.samples[b.sampleNext] = p.startEpochMs - groupLocalMs();
+  b.sampleNext = (b.sampleNext + 1) % GROUP_BEACON_WINDOW;
+  if (b.sampleCount < GROUP_BEACON_WINDOW) b.sampleCount++;
+  int64_t hi = INT64_MIN, lo = INT64_MAX;
+  for (uint8_t i = 0; i < b.sampleCount; i++) {
+    int64_t v = b.samples[(b.sampleNext + GROUP_BEACON_WINDOW - 1 - i) % GROUP_BEACON_WINDOW];
+    if (v > hi) hi = v;
+    if (v < lo) lo = v;
+  }
+  b.offsetMs = hi;
+  b.jitterMs = (int32_t)(hi - lo);
+}
+
+static bool groupSendPacket(const GroupPacket &p) {
+  return groupLink.udp.beginPacketMulticast(GROUP_MULTICAST_ADDR, GROUP_PORT, WiFi.localIP()) &&
+         groupLink.udp.write((const uint8_t *)&p, sizeof(p)) == sizeof(p) && groupLink.udp.endPacket();
+}
+
+// Sends a trigger to every member of group, this device included, to
+// start leadMs from now on the group clock, or on receipt without one
+bool groupSend(uint16_t group, uint8_t channelMask, uint32_t durationMs, uint32_t leadMs) {
+  GroupPacket p;
+  p.magic = GROUP_MAGIC;
+  p.version = GROUP_PROTO_VERSION;
+  p.channelMask = channelMask;
+  p.group = group;
+  p.sender = ESP.getChipId();
+  p.seq = ++groupLink.seq;
+  p.durationMs = durationMs;
+  p.startEpochMs = 0;
+  if (groupFollowing()) {
+    p.startEpochMs = groupLocalMs() + groupLink.beacon.offsetMs + leadMs;
+  } else if (timeSync.valid) {
+    p.startEpochMs = systemClock.epochMs() + leadMs;
+  }
+  bool ok = WiFi.isConnected();
+  for (uint8_t i = 0; i < GROUP_SEND_COPIES && ok; i++) ok = groupSendPacket(p);
+  groupLink.sent++;
+  Serial.printf("Group %u: trigger sent%s\n", group, ok ? "" : " (failed)");
+  groupAccept(p); // multicast is not looped back
+  return ok;
+}
+
+// EVT_GROUP_BEACON: a leader with NTP time beacons its clock to each of
+// its groups
+void onGroupBeaconTimer() {
+  timers.armIn(EVT_GROUP_BEACON, GROUP_BEACON_MS);
+  if (!config.groupLeader || !groupLink.joinedIp || !timeSync.valid) return;
+  GroupPacket p;
+  p.magic = GROUP_BEACON_MAGIC;
+  p.version = GROUP_PROTO_VERSION;
+  p.channelMask = 0;
+  p.sender = ESP.getChipId();
+  p.seq = ++groupLink.seq;
+  p.durationMs = 0;
+  for (uint16_t g : config.groups) {
+    p.group = g;
+    p.startEpochMs = systemClock.epochMs();
+    groupSendPacket(p);
+  }
+}
+
+// Called every loop pass: keeps the membership on the current address and
+// takes in received packets. Off in safe mode.
+void groupService() {
+  uint32_t ip = WiFi.isConnected() && !config.groups.empty() && !safeMode ? (uint32_t)WiFi.localIP() : 0;
+  if (ip != groupLink.joinedIp && (int32_t)(millis() - groupLink.joinRetryAt) >= 0) {
+    groupLink.udp.stop();
+    groupLink.joinedIp = 0;
+    if (ip) {
+      if (groupLink.udp.beginMulticast(WiFi.localIP(), GROUP_MULTICAST_ADDR, GROUP_PORT)) {
+        groupLink.joinedIp = ip;
+        Serial.println("Group: joined multicast group");
+      } else {
+        groupLink.joinRetryAt = millis() + GROUP_JOIN_RETRY_MS;
+        Serial.println("Group: multicast join failed");
+      }
+    }
+    statusChanged();
+  }
+  if (!groupLink.joinedIp) return;
+  int len;
+  while ((len = groupLink.udp.parsePacket()) > 0) {
+    GroupPacket p;
+    if (len != (int)sizeof(p) || groupLink.udp.read((unsigned char *)&p, sizeof(p)) != (int)sizeof(p)) continue;
+    if (p.magic == GROUP_BEACON_MAGIC) {
+      groupBeaconReceived(p);
+    } else {
+      groupAccept(p);
+    }
+  }
+}
+
+// Advertises the web UI and API as _diffuser._tcp.local
+void setupDiscovery() {
+  String host = "diffuser-" + String(ESP.getChipId(), HEX);
+  if (!MDNS.begin(host)) {
+    Serial.println("mDNS: failed to start");
+    return;
+  }
+  MDNS.addService("diffuser", "tcp", 80);
+  MDNS.addServiceTxt("diffuser", "tcp", "id", String(ESP.getChipId(), HEX).c_str());
+  MDNS.addServiceTxt("diffuser", "tcp", "groupPort", String(GROUP_PORT).c_str());
+  Serial.printf("mDNS: %s.local\n", host.c_str());
+}
+
+// ================== OTA pulls ==================
+// An "update" op names an image URL; each device fetches it after its own
+// stagger delay, once the OTA section finds an idle window
+static const size_t OTA_URL_SIZE = 192;
+static const size_t OTA_MD5_SIZE = 33; // hex digest and NUL
+static const uint32_t OTA_MAX_STAGGER_SEC = 86400;
+
+struct OtaState {
+  bool windowOpen = false;   // no pulse and no scheduled fire close, refreshed by EVT_OTA_CHECK
+  bool espotaOn = false;     // ArduinoOTA started, which needs a password at boot
+  bool pullPending = false;
+  char pullUrl[OTA_URL_SIZE] = "";
+  char pullMd5[OTA_MD5_SIZE] = "";
+  uint32_t pullDueMs = 0;    // millis() of the next attempt
+  uint8_t pullAttempts = 0;
+  int httpStatus = 0;        // /api/update: non-zero once the upload failed
+  bool httpImageOk = false;  // /api/update: a complete, verified image was written
+  bool healthy = false;      // this boot stayed up long enough to clear bootFailures
+  uint32_t failures = 0;     // updates started and not completed since boot
+  char lastError[64] = "";
+};
+OtaState ota;
+
+// Spreads a fleet's downloads over staggerSec: each device waits a fixed
+// share of it derived from its chip id. The MD5 is mandatory: it is the
+// only check that the downloaded image is the announced one.
+static void otaQueuePull(const char *url, const char *md5, uint32_t staggerSec) {
+  if (!md5HexValid(md5)) {
+    Serial.println("OTA: pull without a valid MD5 ignored");
+    return;
+  }
+  if (strcasecmp(md5, ESP.getSketchMD5().c_str()) == 0) {
+    Serial.println("OTA: announced image is already running");
+    return;
+  }
+  copyString(ota.pullUrl, url);
+  copyString(ota.pullMd5, md5);
+  uint32_t spreadMs = staggerSec * 1000;
+  uint32_t delayMs = spreadMs ? (ESP.getChipId() * 2654435761u) % spreadMs : 0;
+  ota.pullDueMs = millis() + delayMs;
+  ota.pullAttempts = 0;
+  ota.pullPending = true;
+  Serial.printf("OTA: pulling %s in %lu s\n", ota.pullUrl, (unsigned long)(delayMs / 1000));
+  statusChanged();
+}
+
+// ================== MQTT ==================
+// Besides the text commands listed in MqttCommand.h, a message starting
+// with '{' is a JSON batch: {"id":"...","ops":[{"op":"...","ch":0,...},...]}.
+// The whole batch is validated before anything is applied, so one bad op
+// leaves the config untouched. Saving, recompiling the schedule and
+// re-arming intervals then happen once per batch instead of once per op.
+// Parsing and validation live in DiffuserCore's MqttCommand; this section
+// applies the result.
+static const uint16_t MQTT_BUFFER_SIZE = 1024; // PubSubClient packet buffer, bounds a batch
+static const size_t MQTT_COMMAND_CAPACITY = 3072;
+
+// Global rather than on the 4 KB loop stack; reused by every batch
+StaticJsonDocument<MQTT_COMMAND_CAPACITY> mqttCommandDoc;
+
+// Side effects collected while applying a batch
+struct MqttBatchEffects {
+  bool dirty = false;
+  bool scheduleChanged = false;
+  uint8_t intervalMask = 0; // channels whose interval needs re-arming
+};
+
+static MqttLimits mqttLimits() {
+  MqttLimits limits;
+  limits.channelCount = config.channelCount;
+  limits.groupDefaultLeadMs = GROUP_DEFAULT_LEAD_MS;
+  limits.groupMaxLeadMs = GROUP_MAX_LEAD_MS;
+  limits.urlSize = OTA_URL_SIZE;
+  limits.maxStaggerSec = OTA_MAX_STAGGER_SEC;
+  return limits;
+}
+
+// Applies one validated op
+static void mqttApplyOp(JsonObjectConst op, MqttBatchEffects &fx) {
+  uint8_t type = mqttOpType(op);
+  uint8_t ch = op["ch"] | 0;
+  ChannelConfig &c = config.channels[ch];
+  switch (type) {
+    case OP_TRIGGER:
+      triggerPulse(ch, TRIG_SRC_MQTT);
+      break;
+    case OP_TRIGGER_ALL:
+      for (uint8_t i = 0; i < config.channelCount; i++) triggerPulse(i, TRIG_SRC_MQTT);
+      break;
+    case OP_PULSE:
+      c.durationMs = op["ms"];
+      fx.dirty = true;
+      break;
+    case OP_INTERVAL:
+      c.intervalSeconds = op["seconds"] | c.intervalSeconds;
+      c.intervalEnabled = (op["enabled"] | true) && c.intervalSeconds > 0;
+      fx.dirty = true;
+      fx.intervalMask |= 1 << ch;
+      break;
+    case OP_STOP_INTERVAL:
+      c.intervalEnabled = false;
+      fx.dirty = true;
+      fx.intervalMask |= 1 << ch;
+      break;
+    case OP_SCHEDULE:
+      scheduleTimesFromJson(op["times"].as<JsonArrayConst>(), c);
+      fx.dirty = fx.scheduleChanged = true;
+      break;
+    case OP_ADD_SCHEDULE:
+      scheduleAddMinute(c, (uint16_t)parseTimeToMinutes(op["time"].as<const char *>()));
+      fx.dirty = fx.scheduleChanged = true;
+      break;
+    case OP_CLEAR_SCHEDULE:
+      c.scheduleCount = 0;
+      fx.dirty = fx.scheduleChanged = true;
+      break;
+    case OP_RULES:
+      scheduleRulesFromJson(op["rules"].as<JsonArrayConst>(), c.scheduleRules);
+      fx.dirty = fx.scheduleChanged = true;
+      break;
+    case OP_ADD_RULE: {
+      ScheduleRule r;
+      scheduleRuleFromJson(op["rule"], r);
+      c.scheduleRules.push_back(r);
+      fx.dirty = fx.scheduleChanged = true;
+      break;
+    }
+    case OP_CLEAR_RULES:
+      c.scheduleRules.clear();
+      fx.dirty = fx.scheduleChanged = true;
+      break;
+    case OP_GROUP_TRIGGER:
+      groupSend(op["group"], op["mask"] | 0, op["ms"] | 0, op["leadMs"] | GROUP_DEFAULT_LEAD_MS);
+      break;
+    case OP_UPDATE:
+      otaQueuePull(op["url"], op["md5"], op["staggerSec"] | 0);
+      break;
+  }
+}
+
+// Replies on <topic>/result when the batch carries an "id"
+static void mqttPublishResult(const char *id, const char *error, size_t applied) {
+  if (!id) return;
+  StaticJsonDocument<JSON_OBJECT_SIZE(4)> reply;
+  reply["id"] = id;
+  reply["ok"] = error == nullptr;
+  reply["applied"] = applied;
+  if (error) reply["error"] = error;
+  // Serialize before publishing: id and error may point into the client's
+  // buffer, which publish() reuses
+  char out[160];
+  size_t len = serializeJson(reply, out, sizeof(out));
+  char resultTopic[MQTT_TOPIC_SIZE + 8];
+  snprintf(resultTopic, sizeof(resultTopic), "%s/result", config.mqttTopic);
+  mqttClient.publish(resultTopic, (const uint8_t *)out, len, false);
+}
+
+static void mqttHandleBatch(byte *payload, unsigned int length) {
+  // char* input: parsed in place, strings point into payload (no copies)
+  DeserializationError err = deserializeJson(mqttCommandDoc, (char *)payload, length);
+  if (err) {
+    Serial.printf("MQTT: bad JSON batch: %s\n", err.c_str());
+    return;
+  }
+  const char *id = mqttCommandDoc["id"];
+  JsonArrayConst ops = mqttCommandDoc["ops"].as<JsonArrayConst>();
+  size_t scheduleSizes[MAX_CHANNELS];
+  size_t ruleSizes[MAX_CHANNELS];
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    scheduleSizes[i] = config.channels[i].scheduleCount;
+    ruleSizes[i] = config.channels[i].scheduleRules.size();
+  }
+  size_t index;
+  const char *error = mqttValidateOps(ops, mqttLimits(), scheduleSizes, ruleSizes, index);
+  if (error) {
+    char msg[64];
+    if (index < ops.size()) {
+      snprintf(msg, sizeof(msg), "op %u: %s", (unsigned)index, error);
+    } else {
+      copyString(msg, error);
+    }
+    Serial.printf("MQTT: batch rejected, %s\n", msg);
+    mqttPublishResult(id, msg, 0);
+    return;
+  }
+
+  MqttBatchEffects fx;
+  for (JsonVariantConst op : ops) mqttApplyOp(op.as<JsonObjectConst>(), fx);
+  if (fx.dirty) markConfigDirty();
+  if (fx.scheduleChanged) compileSchedule();
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    if (fx.intervalMask & (1 << i)) armInterval(i);
+  }
+  Serial.printf("MQTT: applied batch of %u ops\n", (unsigned)ops.size());
+  mqttPublishResult(id, nullptr, ops.size());
+}
+
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  unsigned int start = 0;
+  while (start < length && isspace(payload[start])) start++;
+  if (start < length && payload[start] == '{') {
+    Serial.printf("MQTT batch on %s (%u bytes)\n", topic, length);
+    mqttHandleBatch(payload + start, length - start);
+    return;
+  }
+
+  Serial.printf("MQTT msg on %s: '%.*s'\n", topic, (int)length, (const char *)payload);
+  MqttTextCommand cmd;
+  const char *error = mqttParseText((const char *)payload, length, config.channelCount, cmd);
+  if (error) {
+    Serial.printf("MQTT: %s\n", error);
+    return;
+  }
+  ChannelConfig &c = config.channels[cmd.ch];
+  switch (cmd.kind) {
+    case MqttTextCommand::TRIGGER:
+      triggerPulse(cmd.ch, TRIG_SRC_MQTT);
+      break;
+    case MqttTextCommand::TRIGGER_ALL:
+      for (uint8_t i = 0; i < config.channelCount; i++) triggerPulse(i, TRIG_SRC_MQTT);
+      break;
+    case MqttTextCommand::INTERVAL:
+      c.intervalSeconds = cmd.value;
+      c.intervalEnabled = true;
+      markConfigDirty();
+      armInterval(cmd.ch);
+      break;
+    case MqttTextCommand::STOP_INTERVAL:
+      c.intervalEnabled = false;
+      markConfigDirty();
+      armInterval(cmd.ch);
+      break;
+    case MqttTextCommand::ADD_SCHEDULE:
+      if (!scheduleAddMinute(c, (uint16_t)cmd.value)) {
+        Serial.println("MQTT: schedule is full");
+        break;
+      }
+      markConfigDirty();
+      compileSchedule();
+      break;
+    case MqttTextCommand::CLEAR_SCHEDULE:
+      c.scheduleCount = 0;
+      markConfigDirty();
+      compileSchedule();
+      break;
+  }
+}
+
+// Reconnects run as a small state machine driven by EVT_MQTT_RECONNECT:
+// resolve the broker (cached), then connect in a later loop pass. The
+// lookup is asynchronous; the timer polls for the answer, so it never holds
+// up loop(). The TCP connect and the wait for CONNACK are still blocking
+// calls inside WiFiClient and PubSubClient, bounded by
+// MQTT_CONNECT_TIMEOUT_MS and MQTT_SOCKET_TIMEOUT_S. Failures back off
+// exponentially with jitter. Pulse ends are interrupt driven, so a slow
+// step cannot stretch a pulse.
+enum MqttLinkState : uint8_t { MQTT_LINK_IDLE, MQTT_LINK_RESOLVE, MQTT_LINK_CONNECT, MQTT_LINK_UP };
+
+static const char *const MQTT_LINK_STATE_NAMES[] = {"idle", "resolve", "connect", "up"};
+
+static const uint32_t MQTT_BACKOFF_MIN_MS = 1000;
+static const uint32_t MQTT_BACKOFF_MAX_MS = 60000;
+static const uint32_t MQTT_DNS_TIMEOUT_MS = 5000;
+static const uint32_t MQTT_DNS_POLL_MS = 50;
+static const uint32_t MQTT_DNS_TTL_MS = 10UL * 60UL * 1000UL;
+static const uint32_t MQTT_CONNECT_TIMEOUT_MS = 500; // TCP connect
+static const uint16_t MQTT_SOCKET_TIMEOUT_S = 1;     // CONNACK and other reads
+static const uint8_t MQTT_FAILURES_BEFORE_RESOLVE = 3;
+
+struct MqttLink {
+  MqttLinkState state = MQTT_LINK_IDLE;
+  IPAddress brokerIp;
+  bool brokerIpValid = false;
+  unsigned long resolvedAt = 0;
+  bool dnsPending = false; // lookup started, answer not taken yet
+  uint32_t dnsStartedAt = 0;
+  uint8_t dnsGeneration = 0; // answers to an abandoned lookup are ignored
+  volatile bool dnsDone = false;
+  volatile bool dnsFound = false;
+  IPAddress dnsIp;
+  uint8_t failures = 0;    // consecutive, drives the backoff
+  uint32_t attempts = 0;   // connect attempts since boot
+  uint32_t connects = 0;   // successful connects since boot
+};
+MqttLink mqttLink;
+
+// Retained state under <topic>/state/..., published only when a value
+// changed (RSSI and heap only past a deadband) and at most once per
+// MQTT_STATE_MIN_INTERVAL_MS. Dashboards subscribe instead of polling
+// /api/status. Per channel: active (0/1), pulses (count since boot, so
+// pulses shorter than the rate limit still show up), interval (seconds,
+// 0 = off) and schedule (CRC of the compiled table).
+static const uint32_t MQTT_STATE_SAMPLE_MS = 30000; // RSSI and heap
+static const int32_t MQTT_STATE_RSSI_DEADBAND = 3;  // dBm
+static const int32_t MQTT_STATE_HEAP_DEADBAND = 1024;
+
+enum MqttStateSlot : uint8_t {
+  STATE_RSSI,
+  STATE_HEAP,
+  STATE_CHANNEL_BASE // then MQTT_STATE_PER_CHANNEL slots per channel
+};
+
+enum MqttChannelState : uint8_t { CH_STATE_ACTIVE, CH_STATE_PULSES, CH_STATE_INTERVAL, CH_STATE_SCHEDULE, MQTT_STATE_PER_CHANNEL };
+
+static const char *const MQTT_CHANNEL_STATE_NAMES[MQTT_STATE_PER_CHANNEL] = {"active", "pulses", "interval", "schedule"};
+
+static const uint8_t MQTT_STATE_SLOTS = STATE_CHANNEL_BASE + MAX_CHANNELS * MQTT_STATE_PER_CHANNEL;
+
+struct MqttStateCache {
+  int32_t value[MQTT_STATE_SLOTS];   // last value the broker has
+  bool published[MQTT_STATE_SLOTS];  // false: unknown to the broker, publish on change or resync
+  uint32_t publishes = 0;
+};
+MqttStateCache mqttState;
+
+static int32_t mqttStateValue(uint8_t slot) {
+  if (slot == STATE_RSSI) return WiFi.RSSI();
+  if (slot == STATE_HEAP) return (int32_t)ESP.getFreeHeap();
+  uint8_t ch = (slot - STATE_CHANNEL_BASE) / MQTT_STATE_PER_CHANNEL;
+  switch ((slot - STATE_CHANNEL_BASE) % MQTT_STATE_PER_CHANNEL) {
+    case CH_STATE_ACTIVE: return (pulse.activeMask & (1 << ch)) != 0;
+    case CH_STATE_PULSES: return (int32_t)pulse.ch[ch].pulses;
+    case CH_STATE_INTERVAL:
+      return config.channels[ch].intervalEnabled ? (int32_t)config.channels[ch].intervalSeconds : 0;
+    default:
+      return (int32_t)~scheduleCrcUpdate(0xFFFFFFFF, ch);
+  }
+}
+
+static void mqttStateTopic(uint8_t slot, char *buf, size_t len) {
+  if (slot < STATE_CHANNEL_BASE) {
+    snprintf(buf, len, "%s/state/%s", config.mqttTopic, slot == STATE_RSSI ? "rssi" : "heap");
+    return;
+  }
+  uint8_t ch = (slot - STATE_CHANNEL_BASE) / MQTT_STATE_PER_CHANNEL;
+  uint8_t kind = (slot - STATE_CHANNEL_BASE) % MQTT_STATE_PER_CHANNEL;
+  snprintf(buf, len, "%s/state/ch%u/%s", config.mqttTopic, ch, MQTT_CHANNEL_STATE_NAMES[kind]);
+}
+
+// EVT_MQTT_STATE: publish every slot whose value moved, then sample again
+// after MQTT_STATE_SAMPLE_MS
+void mqttStateFlush() {
+  mqttStateLastFlushAt = millis();
+  timers.armIn(EVT_MQTT_STATE, MQTT_STATE_SAMPLE_MS);
+  if (mqttLink.state != MQTT_LINK_UP || !mqttClient.connected()) return;
+
+  char topic[96];
+  char payload[12];
+  for (uint8_t slot = 0; slot < MQTT_STATE_SLOTS; slot++) {
+    bool inUse = slot < STATE_CHANNEL_BASE ||
+                 (slot - STATE_CHANNEL_BASE) / MQTT_STATE_PER_CHANNEL < config.channelCount;
+    if (!inUse) {
+      // Channel was removed: clear its retained topic
+      if (mqttState.published[slot]) {
+        mqttStateTopic(slot, topic, sizeof(topic));
+        mqttClient.publish(topic, (const uint8_t *)"", 0, true);
+        mqttState.published[slot] = false;
+      }
+      continue;
+    }
+    int32_t v = mqttStateValue(slot);
+    if (mqttState.published[slot]) {
+      int32_t deadband = slot == STATE_RSSI ? MQTT_STATE_RSSI_DEADBAND : slot == STATE_HEAP ? MQTT_STATE_HEAP_DEADBAND : 0;
+      int32_t diff = v - mqttState.value[slot];
+      if ((diff < 0 ? -diff : diff) <= deadband) continue;
+    }
+    bool isCrc = slot >= STATE_CHANNEL_BASE &&
+                 (slot - STATE_CHANNEL_BASE) % MQTT_STATE_PER_CHANNEL == CH_STATE_SCHEDULE;
+    if (isCrc) {
+      snprintf(payload, sizeof(payload), "%08lx", (unsigned long)(uint32_t)v);
+    } else {
+      snprintf(payload, sizeof(payload), "%ld", (long)v);
+    }
+    mqttStateTopic(slot, topic, sizeof(topic));
+    if (!mqttClient.publish(topic, payload, true)) return; // retry on the next flush
+    mqttState.value[slot] = v;
+    mqttState.published[slot] = true;
+    mqttState.publishes++;
+    statusChanged();
+  }
+}
+
+// After a (re)connect the broker's retained values may be stale
+static void mqttStateResync() {
+  for (uint8_t slot = 0; slot < MQTT_STATE_SLOTS; slot++) mqttState.published[slot] = false;
+  timers.armIn(EVT_MQTT_STATE, 0);
+}
+
+static uint32_t mqttBackoffMs() {
+  uint32_t delayMs = MQTT_BACKOFF_MIN_MS;
+  for (uint8_t i = 1; i < mqttLink.failures && delayMs < MQTT_BACKOFF_MAX_MS; i++) delayMs *= 2;
+  if (delayMs > MQTT_BACKOFF_MAX_MS) delayMs = MQTT_BACKOFF_MAX_MS;
+  // equal jitter: somewhere in [delay/2, delay] so a fleet doesn't retry in lockstep
+  return delayMs / 2 + ESP.random() % (delayMs / 2 + 1);
+}
+
+static void mqttRetryLater() {
+  mqttLink.state = MQTT_LINK_RESOLVE;
+  statusChanged();
+  timers.armIn(EVT_MQTT_RECONNECT, mqttBackoffMs());
+}
+
+static void mqttOnConnected() {
+  mqttLink.state = MQTT_LINK_UP;
+  mqttLink.failures = 0;
+  mqttLink.connects++;
+  statusChanged();
+  Serial.println("MQTT connected");
+  mqttClient.subscribe(config.mqttTopic);
+  bootMark(BOOT_MQTT_READY);
+  // Publish online status; the broker replaces it with the "offline" will
+  // if the connection drops
+  char statusTopic[MQTT_TOPIC_SIZE + 8];
+  snprintf(statusTopic, sizeof(statusTopic), "%s/status", config.mqttTopic);
+  mqttClient.publish(statusTopic, "online", true);
+  mqttStateResync();
+}
+
+// Runs in the lwIP context: only hands the answer over
+static void mqttDnsFound(const char *name, const ip_addr_t *addr, void *arg) {
+  (void)name;
+  if ((uint8_t)(uintptr_t)arg != mqttLink.dnsGeneration) return;
+  if (addr) mqttLink.dnsIp = IPAddress(addr);
+  mqttLink.dnsFound = addr != nullptr;
+  mqttLink.dnsDone = true;
+}
+
+static void mqttResolveFailed() {
+  Serial.printf("MQTT: cannot resolve %s\n", config.mqttHost);
+  mqttLink.dnsPending = false;
+  mqttLink.dnsGeneration++;
+  mqttLink.failures++;
+  mqttRetryLater();
+}
+
+// Starts the broker lookup or picks up its answer; false while it is still
+// running (the timer is re-armed to poll) or when it failed
+static bool mqttResolveStep() {
+  if (mqttLink.brokerIpValid && millis() - mqttLink.resolvedAt <= MQTT_DNS_TTL_MS) return true;
+  IPAddress ip;
+  if (!mqttLink.dnsPending && !ip.fromString(config.mqttHost)) {
+    ip_addr_t addr;
+    mqttLink.dnsDone = false;
+    err_t err = dns_gethostbyname(config.mqttHost, &addr, mqttDnsFound,
+                                  (void *)(uintptr_t)mqttLink.dnsGeneration);
+    if (err == ERR_INPROGRESS) {
+      mqttLink.dnsPending = true;
+      mqttLink.dnsStartedAt = millis();
+      timers.armIn(EVT_MQTT_RECONNECT, MQTT_DNS_POLL_MS);
+      return false;
+    }
+    if (err != ERR_OK) {
+      mqttResolveFailed();
+      return false;
+    }
+    ip = IPAddress(&addr); // cached by lwIP
+  } else if (mqttLink.dnsPending) {
+    if (!mqttLink.dnsDone) {
+      if (millis() - mqttLink.dnsStartedAt > MQTT_DNS_TIMEOUT_MS) {
+        mqttResolveFailed();
+      } else {
+        timers.armIn(EVT_MQTT_RECONNECT, MQTT_DNS_POLL_MS);
+      }
+      return false;
+    }
+    mqttLink.dnsPending = false;
+    mqttLink.dnsGeneration++;
+    if (!mqttLink.dnsFound) {
+      mqttResolveFailed();
+      return false;
+    }
+    ip = mqttLink.dnsIp;
+  }
+  mqttLink.brokerIp = ip;
+  mqttLink.brokerIpValid = true;
+  mqttLink.resolvedAt = millis();
+  return true;
+}
+
+// One step of the reconnect state machine
+void mqttReconnectStep() {
+  if (!config.mqttHost[0] || mqttLink.state == MQTT_LINK_UP) return;
+  if (!WiFi.isConnected()) {
+    mqttLink.dnsPending = false;
+    mqttLink.dnsGeneration++;
+    mqttRetryLater();
+    return;
+  }
+  if (mqttLink.state != MQTT_LINK_CONNECT) {
+    if (!mqttResolveStep()) return;
+    // Connect on the next pass so HTTP gets serviced in between
+    mqttLink.state = MQTT_LINK_CONNECT;
+    statusChanged();
+    timers.armIn(EVT_MQTT_RECONNECT, 0);
+    return;
+  }
+
+  mqttClient.setServer(mqttLink.brokerIp, config.mqttPort);
+  mqttClient.setCallback(mqttCallback);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
+  wifiClient.setTimeout(MQTT_CONNECT_TIMEOUT_MS);
+
+  String clientId = "diffuser-" + String(ESP.getChipId(), HEX);
+  char statusTopic[MQTT_TOPIC_SIZE + 8];
+  snprintf(statusTopic, sizeof(statusTopic), "%s/status", config.mqttTopic);
+  bool ok;
+  mqttLink.attempts++;
+  if (config.mqttUser[0]) {
+    ok = mqttClient.connect(clientId.c_str(), config.mqttUser, config.mqttPass,
+                            statusTopic, 1, true, "offline");
+  } else {
+    ok = mqttClient.connect(clientId.c_str(), statusTopic, 1, true, "offline");
+  }
+  if (ok) {
+    mqttOnConnected();
+    return;
+  }
+  Serial.printf("MQTT connect failed, rc=%d\n", mqttClient.state());
+  mqttLink.failures++;
+  if (mqttLink.failures % MQTT_FAILURES_BEFORE_RESOLVE == 0) {
+    mqttLink.brokerIpValid = false; // broker may have moved
+  }
+  mqttRetryLater();
+}
+
+// Clean disconnect; a clean DISCONNECT suppresses the will, so publish the
+// status ourselves
+void mqttDisconnect(const char *status) {
+  if (!mqttClient.connected()) return;
+  char statusTopic[MQTT_TOPIC_SIZE + 8];
+  snprintf(statusTopic, sizeof(statusTopic), "%s/status", config.mqttTopic);
+  mqttClient.publish(statusTopic, status, true);
+  mqttClient.disconnect();
+}
+
+// Drop any connection and start over, e.g. after the broker settings changed
+void mqttRestart() {
+  mqttDisconnect("offline");
+  mqttLink.state = MQTT_LINK_IDLE;
+  mqttLink.brokerIpValid = false;
+  mqttLink.dnsPending = false;
+  mqttLink.dnsGeneration++; // the host may have changed
+  mqttLink.failures = 0;
+  statusChanged();
+  timers.cancel(EVT_MQTT_RECONNECT);
+  if (!config.mqttHost[0]) return;
+  mqttLink.state = MQTT_LINK_RESOLVE;
+  timers.armIn(EVT_MQTT_RECONNECT, 0);
+}
+
+// Called every loop pass: service the client, notice lost connections
+void mqttService() {
+  if (mqttLink.state != MQTT_LINK_UP) return;
+  if (mqttClient.connected()) {
+    mqttClient.loop();
+    return;
+  }
+  Serial.println("MQTT connection lost");
+  mqttLink.failures = 1;
+  mqttRetryLater();
+}
+
+// ================== Power management ==================
+static const uint32_t LOOP_IDLE_LIGHT_SLEEP_MS = 250; // longer idle lets light sleep engage
+static const uint32_t DEEP_SLEEP_MIN_AWAKE_MS = 30000; // stay reachable after each wake
+static const uint32_t DEEP_SLEEP_WAKE_LEAD_MS = 15000; // reconnect WiFi and NTP before the event
+
+void applyPowerMode() {
+  switch (config.powerMode) {
+    case 1: WiFi.setSleepMode(WIFI_MODEM_SLEEP, config.listenInterval); break;
+    case 2: WiFi.setSleepMode(WIFI_LIGHT_SLEEP, config.listenInterval); break;
+    default: WiFi.setSleepMode(WIFI_NONE_SLEEP); break;
+  }
+}
+
+uint32_t loopIdleCapMs() {
+  return config.powerMode == 2 ? LOOP_IDLE_LIGHT_SLEEP_MS : LOOP_IDLE_MAX_MS;
+}
+
+// Resume the interval phases saved before deep sleep or a planned restart.
+// The time elapsed is the sleep plus everything since boot.
+void restoreIntervalFromRtc() {
+  if (!rtcStateValid || !(rtcWokeFromSleep || rtcPlannedRestart)) return;
+  uint32_t elapsed = rtcState.sleptMs + millis();
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    uint32_t saved = rtcState.intervalRemainingMs[i];
+    if (saved == 0 || !timers.armed(EVT_INTERVAL + i)) continue;
+    uint32_t remaining = saved > elapsed ? saved - elapsed : 0;
+    timers.armIn(EVT_INTERVAL + i, remaining);
+  }
+}
+
+// Time left in each armed interval phase, 0 for the rest; returns the
+// smallest, UINT32_MAX when none is armed
+static uint32_t intervalRemainingMs(uint32_t remaining[MAX_CHANNELS]) {
+  uint32_t next = UINT32_MAX;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    remaining[i] = 0;
+    if (!timers.armed(EVT_INTERVAL + i)) continue;
+    int32_t d = (int32_t)(timers.deadline(EVT_INTERVAL + i) - millis());
+    remaining[i] = d > 0 ? (uint32_t)d : 0;
+    if (remaining[i] < next) next = remaining[i];
+  }
+  return next;
+}
+
+// Nothing running or queued, no group start pending, and no scheduled fire
+// within scheduleGapMs; lets a blocking update or a restart run in between
+static bool triggersIdleFor(uint32_t scheduleGapMs) {
+  if (pulseBusy() || triggerQueueDepth() || groupLink.pendingCount) return false;
+  return !timeSync.valid || msUntilNextScheduledFire() >= scheduleGapMs;
+}
+
+// Before a planned restart: the interval phases and schedule record go to
+// RTC memory (restored as after a deep sleep), the config to flash
+static void prepareRestart(const char *mqttStatus) {
+  uint32_t intervalRemaining[MAX_CHANNELS];
+  intervalRemainingMs(intervalRemaining);
+  rtcState.sleptMs = 0;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    rtcState.intervalRemainingMs[i] = intervalRemaining[i];
+  }
+  rtcState.plannedRestart = 1;
+  rtcSaveSchedule();
+  flushConfig();
+  eventLogFlush();
+  mqttDisconnect(mqttStatus);
+}
+
+// Enter deep sleep when nothing is due on any channel for at least
+// deepSleepMinGapSec. Wakes DEEP_SLEEP_WAKE_LEAD_MS early so WiFi and NTP
+// are back in time. Requires GPIO16 (D0) wired to RST.
+void maybeDeepSleep() {
+  if (config.deepSleepMinGapSec == 0 || pulseBusy() || safeMode) return;
+  if (millis() < DEEP_SLEEP_MIN_AWAKE_MS || !timeSync.valid || groupLink.pendingCount) return;
+
+  uint32_t gap = msUntilNextScheduledFire();
+  uint32_t intervalRemaining[MAX_CHANNELS];
+  uint32_t nextInterval = intervalRemainingMs(intervalRemaining);
+  if (nextInterval < gap) gap = nextInterval;
+  if (gap == UINT32_MAX || gap < config.deepSleepMinGapSec * 1000UL || gap <= DEEP_SLEEP_WAKE_LEAD_MS) return;
+
+  uint64_t sleepMs = gap - DEEP_SLEEP_WAKE_LEAD_MS;
+  uint64_t maxMs = ESP.deepSleepMax() / 1000;
+  if (sleepMs > maxMs) sleepMs = maxMs;
+
+  rtcState.sleptMs = (uint32_t)sleepMs;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    rtcState.intervalRemainingMs[i] = intervalRemaining[i];
+  }
+  rtcSaveSchedule();
+  flushConfig();
+  eventLogFlush();
+
+  Serial.printf("Deep sleep for %lu s\n", (unsigned long)(sleepMs / 1000));
+  mqttDisconnect("sleeping");
+  ESP.deepSleep(sleepMs * 1000ULL);
+}
+
+// ================== Heap watchdog ==================
+// Weeks of uptime fragment the heap until a page no longer fits in the
+// largest free block. The heap is sampled every HEAP_SAMPLE_MS and the low
+// point of each span is kept for the trend. A threshold crossed for
+// HEAP_BREACH_SAMPLES samples in a row plans a restart, taken at the first
+// idle sample with no fire close; the schedule and interval phases go
+// through RTC memory, so no fire is lost or repeated.
+static const uint32_t HEAP_SAMPLE_MS = 10000;
+static const uint8_t HEAP_SPAN_SAMPLES = 30;                 // 5 min per history entry
+static const uint8_t HEAP_HISTORY_LEN = 24;                  // 2 h of trend
+static const uint8_t HEAP_BREACH_SAMPLES = 3;
+static const uint32_t HEAP_RESTART_MIN_UPTIME_MS = 600000;   // a threshold set too tight cannot restart-loop
+static const uint32_t HEAP_RESTART_SCHEDULE_GAP_MS = 120000; // WiFi and NTP are back before the next fire
+static const uint32_t HEAP_RESTART_INTERVAL_GAP_MS = 15000;  // setup is done before the next interval
+
+struct HeapSample {
+  uint16_t freeBytes;
+  uint16_t maxBlock;
+  uint8_t fragPct;
+};
+
+struct HeapWatch {
+  HeapSample last = {0, 0, 0};
+  HeapSample low = {UINT16_MAX, UINT16_MAX, 0};  // worst since boot
+  HeapSample span = {UINT16_MAX, UINT16_MAX, 0}; // worst of the current span
+  uint8_t spanSamples = 0;
+  HeapSample history[HEAP_HISTORY_LEN]; // worst per span, oldest at historyHead once full
+  uint8_t historyHead = 0;
+  uint8_t historyCount = 0;
+  uint32_t samples = 0;
+  uint8_t breaches = 0;                // consecutive samples past a threshold
+  bool restartPending = false;
+  const char *restartCause = "";
+  uint32_t restartPendingSinceMs = 0;
+  uint32_t restartDeferrals = 0;       // samples that found no idle gap
+};
+HeapWatch heapWatch;
+
+static uint16_t heapClamp(uint32_t v) {
+  return v > UINT16_MAX ? UINT16_MAX : (uint16_t)v;
+}
+
+static void heapFoldWorst(HeapSample &into, const HeapSample &s) {
+  if (s.freeBytes < into.freeBytes) into.freeBytes = s.freeBytes;
+  if (s.maxBlock < into.maxBlock) into.maxBlock = s.maxBlock;
+  if (s.fragPct > into.fragPct) into.fragPct = s.fragPct;
+}
+
+static const HeapSample &heapHistoryAt(uint8_t i) {
+  return heapWatch.history[(heapWatch.historyHead + i) % HEAP_HISTORY_LEN];
+}
+
+// Least-squares slope of one field over the history, per hour; 0 with
+// fewer than two spans
+static int32_t heapTrendPerHour(uint16_t HeapSample::*field) {
+  uint8_t n = heapWatch.historyCount;
+  if (n < 2) return 0;
+  float sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    float y = heapHistoryAt(i).*field;
+    sumX += i;
+    sumY += y;
+    sumXY += i * y;
+    sumXX += (float)i * i;
+  }
+  float perSpan = (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+  return (int32_t)(perSpan * (3600000.0f / (HEAP_SAMPLE_MS * HEAP_SPAN_SAMPLES)));
+}
+
+static const char *heapThresholdCause(const HeapSample &s) {
+  if (config.heapMinBlock && s.maxBlock < config.heapMinBlock) return "maxBlock";
+  if (config.heapMaxFrag && s.fragPct > config.heapMaxFrag) return "fragmentation";
+  return nullptr;
+}
+
+// Neither a scheduled nor an interval fire during the restart and reconnect
+static bool heapRestartGapOk() {
+  uint32_t intervalRemaining[MAX_CHANNELS];
+  return triggersIdleFor(HEAP_RESTART_SCHEDULE_GAP_MS) &&
+         intervalRemainingMs(intervalRemaining) >= HEAP_RESTART_INTERVAL_GAP_MS;
+}
+
+static void heapRestart() {
+  Serial.printf("Heap watchdog: restarting (%s; free %u, max block %u, fragmentation %u%%)\n",
+                heapWatch.restartCause, (unsigned)heapWatch.last.freeBytes, (unsigned)heapWatch.last.maxBlock,
+                (unsigned)heapWatch.last.fragPct);
+  rtcState.heapRestarts++;
+  prepareRestart("restarting");
+  ESP.restart();
+}
+
+// EVT_HEAP_SAMPLE
+void onHeapSampleTimer() {
+  timers.armIn(EVT_HEAP_SAMPLE, HEAP_SAMPLE_MS);
+  HeapSample s;
+  s.freeBytes = heapClamp(ESP.getFreeHeap());
+  s.maxBlock = heapClamp(ESP.getMaxFreeBlockSize());
+  s.fragPct = ESP.getHeapFragmentation();
+  heapWatch.last = s;
+  heapWatch.samples++;
+  heapFoldWorst(heapWatch.low, s);
+  heapFoldWorst(heapWatch.span, s);
+  if (++heapWatch.spanSamples >= HEAP_SPAN_SAMPLES) {
+    uint8_t slot = (heapWatch.historyHead + heapWatch.historyCount) % HEAP_HISTORY_LEN;
+    heapWatch.history[slot] = heapWatch.span;
+    if (heapWatch.historyCount < HEAP_HISTORY_LEN) {
+      heapWatch.historyCount++;
+    } else {
+      heapWatch.historyHead = (heapWatch.historyHead + 1) % HEAP_HISTORY_LEN;
+    }
+    heapWatch.span = {UINT16_MAX, UINT16_MAX, 0};
+    heapWatch.spanSamples = 0;
+  }
+
+  if (heapWatch.restartPending && !config.heapMinBlock && !config.heapMaxFrag) {
+    heapWatch.restartPending = false; // watchdog switched off meanwhile
+    Serial.println("Heap watchdog: disabled, restart cancelled");
+    statusChanged();
+  }
+  const char *cause = heapThresholdCause(s);
+  heapWatch.breaches = cause ? (heapWatch.breaches < UINT8_MAX ? heapWatch.breaches + 1 : UINT8_MAX) : 0;
+  if (!heapWatch.restartPending && heapWatch.breaches >= HEAP_BREACH_SAMPLES) {
+    heapWatch.restartPending = true;
+    heapWatch.restartCause = cause;
+    heapWatch.restartPendingSinceMs = millis();
+    Serial.printf("Heap watchdog: %s past its threshold, restart planned\n", cause);
+    statusChanged();
+  }
+  if (!heapWatch.restartPending || millis() < HEAP_RESTART_MIN_UPTIME_MS) return;
+
+  if (!heapRestartGapOk()) {
+    heapWatch.restartDeferrals++;
+    return;
+  }
+  heapRestart();
+}
+
+// ================== OTA ==================
+// Images come in three ways, each written straight to flash through
+// Update as it arrives: ArduinoOTA (espota, the IDE), POST /api/update, and
+// a pull from a URL announced over MQTT. None starts while a pulse runs, a
+// scheduled fire is less than OTA_SCHEDULE_GAP_MS away or an interval pulse
+// less than OTA_INTERVAL_GAP_MS away, since the transfer blocks the loop.
+// The restart afterwards keeps the interval phases and schedule record in
+// RTC memory.
+//
+// The flash holds one application image, so a bad one cannot be rolled
+// back. Instead OTA_SAFE_MODE_FAILURES crashed boots in a row start safe
+// mode: outputs, schedules, MQTT and groups stay off while WiFi, the web UI
+// and OTA run, so a fixed image can still be installed. A boot that stays
+// up for OTA_HEALTHY_MS clears the count.
+static const uint16_t OTA_PORT = 8266;
+static const char *const OTA_HTTP_USER = "admin";
+static const uint32_t OTA_CHECK_MS = 1000;
+static const uint32_t OTA_SCHEDULE_GAP_MS = 180000; // transfer, restart and NTP fit before the next fire
+static const uint32_t OTA_INTERVAL_GAP_MS = 60000;  // transfer fits; the phase itself survives the restart
+static const uint32_t OTA_PULL_RETRY_MS = 60000;    // times the attempt number
+static const uint8_t OTA_PULL_ATTEMPTS = 3;
+static const uint8_t OTA_SAFE_MODE_FAILURES = 3;
+static const uint32_t OTA_HEALTHY_MS = 60000;
+
+static void otaSetError(const char *msg) {
+  copyString(ota.lastError, msg); // cut short if longer
+  ota.failures++;
+  Serial.printf("OTA: failed: %s\n", msg);
+  statusChanged();
+}
+
+static void otaRestart() {
+  Serial.println("OTA: image written, restarting");
+  prepareRestart("updating");
+  ESP.restart();
+}
+
+static bool otaIdle() {
+  uint32_t intervalRemaining[MAX_CHANNELS];
+  return triggersIdleFor(OTA_SCHEDULE_GAP_MS) && intervalRemainingMs(intervalRemaining) >= OTA_INTERVAL_GAP_MS;
+}
+
+static void otaRunPull() {
+  ota.pullAttempts++;
+  Serial.printf("OTA: downloading %s (attempt %u)\n", ota.pullUrl, (unsigned)ota.pullAttempts);
+  WiFiClient client;
+  ESPhttpUpdate.rebootOnUpdate(false); // the interval phases go to RTC first
+  ESPhttpUpdate.setMD5sum(ota.pullMd5);
+  if (ESPhttpUpdate.update(client, ota.pullUrl) == HTTP_UPDATE_OK) {
+    ota.pullPending = false;
+    otaRestart();
+  }
+  otaSetError(ESPhttpUpdate.getLastErrorString().c_str());
+  if (ota.pullAttempts >= OTA_PULL_ATTEMPTS) {
+    ota.pullPending = false;
+    Serial.println("OTA: giving up on the pull");
+  } else {
+    ota.pullDueMs = millis() + OTA_PULL_RETRY_MS * ota.pullAttempts;
+  }
+}
+
+// EVT_OTA_CHECK
+void onOtaCheckTimer() {
+  timers.armIn(EVT_OTA_CHECK, OTA_CHECK_MS);
+  if (!ota.healthy && millis() >= OTA_HEALTHY_MS) {
+    ota.healthy = true;
+    if (rtcState.bootFailures) {
+      rtcState.bootFailures = 0;
+      rtcSave();
+    }
+  }
+  ota.windowOpen = otaIdle();
+  if (ota.pullPending && ota.windowOpen && WiFi.status() == WL_CONNECTED &&
+      (int32_t)(millis() - ota.pullDueMs) >= 0) {
+    otaRunPull();
+  }
+}
+
+// ArduinoOTA is only listened to while the window is open; espota gets no
+// answer otherwise and can simply be run again
+void otaService() {
+  if (ota.espotaOn && ota.windowOpen && !pulseBusy()) ArduinoOTA.handle();
+}
+
+// Without an OTA password, ArduinoOTA is not started and /api/update
+// refuses uploads; anyone on the LAN could flash the device otherwise
+void setupOta() {
+  timers.armIn(EVT_OTA_CHECK, OTA_CHECK_MS); // MQTT pulls and the health check
+  if (config.otaPassword[0]) {
+    String host = "diffuser-" + String(ESP.getChipId(), HEX);
+    ArduinoOTA.setHostname(host.c_str());
+    ArduinoOTA.setPort(OTA_PORT);
+    ArduinoOTA.setPassword(config.otaPassword); // read once, at boot
+    ArduinoOTA.onStart([]() { Serial.println("OTA: receiving image"); });
+    ArduinoOTA.onEnd([]() { prepareRestart("updating"); }); // ArduinoOTA restarts next
+    ArduinoOTA.onError([](ota_error_t error) {
+      static const char *const names[] = {"auth", "begin", "connect", "receive", "end"};
+      otaSetError(error <= OTA_END_ERROR ? names[error] : "unknown");
+    });
+    ArduinoOTA.begin(false); // mDNS is set up by setupDiscovery()
+    MDNS.enableArduino(OTA_PORT, true);
+    ota.espotaOn = true;
+  } else {
+    Serial.println("OTA: no password set, ArduinoOTA and /api/update are off");
+  }
+  if (safeMode) {
+    Serial.printf("Safe mode: %u crashed boots in a row, outputs, schedules and MQTT are off\n",
+                  (unsigned)rtcState.bootFailures);
+  }
+}
+
+// ================== Web UI ==================
+// Pages are streamed to the client through a small fixed buffer using chunked
+// transfer encoding, so peak heap per request does not grow with the page size.
+class ChunkedResponse : public Print {
+public:
+  explicit ChunkedResponse(ESP8266WebServer &srv) : _srv(srv) {}
+  ~ChunkedResponse() { flush(); }
+
+  void begin(int code, const char *contentType) {
+    _srv.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    _srv.send(code, contentType, "");
+  }
+
+  // Flushes buffered bytes and sends the terminating zero-length chunk
+  void end() {
+    flush();
+    _srv.sendContent("");
+  }
+
+  size_t write(uint8_t c) override {
+    if (_len == sizeof(_buf)) flush();
+    _buf[_len++] = (char)c;
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t size) override {
+    size_t left = size;
+    while (left > 0) {
+      if (_len == sizeof(_buf)) flush();
+      size_t n = sizeof(_buf) - _len;
+      if (n > left) n = left;
+      memcpy(_buf + _len, data, n);
+      _len += n;
+      data += n;
+      left -= n;
+    }
+    return size;
+  }
+
+  void flush() override {
+    if (_len == 0) return;
+    _srv.sendContent(_buf, _len);
+    _len = 0;
+  }
+
+private:
+  ESP8266WebServer &_srv;
+  char _buf[512];
+  size_t _len = 0;
+};
+
+void renderHeader(Print &out, const char *title) {
+  out.print("<!DOCTYPE html><html><head><meta charset='utf-8'>");
+  out.print("<meta name='viewport' content='width=device-width, initial-scale=1'>");
+  out.print("<title>");
+  printEscaped(out, title);
+  out.print("</title>");
+  out.print("<link rel='stylesheet' href='/static/style.css'>");
+  out.print("<script defer src='/static/app.js'></script>");
+  out.print("</head><body>");
+  out.print("<header><h1>Diffuser Controller</h1><nav><a href='/'>Dashboard</a> | <a href='/config'>Config</a> | <a href='/api/wifi-portal'>WiFi Setup</a></nav><hr/></header>");
+  if (safeMode) {
+    out.print("<p><strong>Safe mode:</strong> the last boots crashed, so outputs, schedules and MQTT are off. Install a fixed image under Config &gt; Firmware.</p>");
+  }
+}
+
+void renderFooter(Print &out) {
+  out.print("<footer><hr/><small>ESP8266 ");
+  out.print(ESP.getChipId(), HEX);
+  out.print("</small></footer>");
+  out.print("</body></html>");
+}
+
+// Forms address a channel through a hidden "ch" field
+static void printChannelField(Print &out, uint8_t ch) {
+  out.print("<input type='hidden' name='ch' value='");
+  out.print(ch);
+  out.print("'>");
+}
+
+static const char *const WEEKDAY_NAMES[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+
+// e.g. "09:00-17:00 every 30 min, Mon Tue Wed Thu Fri, 800 ms, from 2024-06-01"
+static void printScheduleRule(Print &out, const ScheduleRule &r) {
+  char buf[11];
+  formatMinutes(r.startMin, buf);
+  out.print(buf);
+  if (r.periodMin) {
+    formatMinutes(r.endMin, buf);
+    out.printf("-%s every %u min", buf, r.periodMin);
+  }
+  out.print(", ");
+  if (r.weekdays == 0x7F) {
+    out.print("daily");
+  } else {
+    for (uint8_t d = 0; d < 7; d++) {
+      if (r.weekdays & (1 << d)) out.printf(" %s", WEEKDAY_NAMES[d]);
+    }
+  }
+  if (r.durationMs) out.printf(", %lu ms", (unsigned long)r.durationMs);
+  if (r.fromDay) {
+    formatDate(r.fromDay, buf);
+    out.printf(", from %s", buf);
+  }
+  if (r.toDay) {
+    formatDate(r.toDay, buf);
+    out.printf(", until %s", buf);
+  }
+}
+
+static void renderChannelSection(Print &out, uint8_t ch) {
+  const ChannelConfig &c = config.channels[ch];
+  out.print("<section><h2>Channel ");
+  out.print(ch);
+  out.print("</h2>");
+  // data-ch picks the entry in /api/status "channels"
+  out.print("<div>Pin: <span data-ch='");
+  out.print(ch);
+  out.print("' data-status='pin'>GPIO");
+  out.print(c.pin);
+  out.print(c.activeHigh ? " (Active HIGH)</span></div>" : " (Active LOW)</span></div>");
+  out.print("<div>Duration: <span data-ch='");
+  out.print(ch);
+  out.print("' data-status='durationMs'>");
+  out.print(c.durationMs);
+  out.print(" ms</span></div>");
+  // Updated live from /api/events
+  out.print("<div>State: <span data-ch='");
+  out.print(ch);
+  out.print("' data-status='active'>");
+  out.print((pulse.activeMask & (1 << ch)) ? "On" : "Idle");
+  out.print("</span>, <span data-ch='");
+  out.print(ch);
+  out.print("' data-status='pulses'>");
+  out.print(pulse.ch[ch].pulses);
+  out.print("</span> pulses</div>");
+  out.print("<div>Next interval: <span data-ch='");
+  out.print(ch);
+  out.print("' data-status='intervalNext'>");
+  out.print(timers.armed(EVT_INTERVAL + ch) ? "pending" : "off");
+  out.print("</span></div>");
+
+  // Manual trigger
+  out.print("<form method='POST' action='/api/trigger'>");
+  printChannelField(out, ch);
+  out.print("<button type='submit'>Trigger Now</button></form>");
+
+  // Interval
+  out.print("<h3>Interval Trigger</h3>");
+  out.print("<form method='POST' action='/api/interval'>");
+  printChannelField(out, ch);
+  out.print("<label>Every (seconds): <input type='number' name='seconds' min='1' max='2147483' value='");
+  out.print(c.intervalSeconds);
+  out.print("'></label><br/>");
+  out.print("<label><input type='checkbox' name='enabled' ");
+  out.print(c.intervalEnabled ? "checked" : "");
+  out.print("> Enabled</label><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+
+  // Schedule
+  out.print("<h3>Daily Schedule</h3>");
+  out.print("<div>Times:</div><ul>");
+  for (uint8_t i = 0; i < c.scheduleCount; i++) {
+    char buf[6];
+    formatMinutes(c.scheduleMinutes[i], buf);
+    out.print("<li>");
+    out.print(buf);
+    out.print(" ");
+    out.print("<form style='display:inline' method='POST' action='/api/schedule/remove'>");
+    printChannelField(out, ch);
+    out.print("<input type='hidden' name='idx' value='");
+    out.print((unsigned)i);
+    out.print("'><button type='submit'>Remove</button></form>");
+    out.print("</li>");
+  }
+  out.print("</ul>");
+  out.print("<form method='POST' action='/api/schedule/add'>");
+  printChannelField(out, ch);
+  out.print("<label>Add HH:MM: <input type='time' name='time' required></label> ");
+  out.print("<button type='submit'>Add</button>");
+  out.print("</form>");
+
+  // Rules
+  out.print("<h3>Schedule Rules</h3><ul>");
+  for (size_t i = 0; i < c.scheduleRules.size(); i++) {
+    out.print("<li>");
+    printScheduleRule(out, c.scheduleRules[i]);
+    out.print(" <form style='display:inline' method='POST' action='/api/schedule/rule/remove'>");
+    printChannelField(out, ch);
+    out.print("<input type='hidden' name='idx' value='");
+    out.print((unsigned)i);
+    out.print("'><button type='submit'>Remove</button></form>");
+    out.print("</li>");
+  }
+  out.print("</ul>");
+  out.print("<form method='POST' action='/api/schedule/rule/add'>");
+  printChannelField(out, ch);
+  out.print("<label>From <input type='time' name='start' required></label> ");
+  out.print("<label>until <input type='time' name='end'></label> ");
+  out.print("<label>every (min) <input type='number' name='every' min='0' max='1439' value='0'></label><br/>");
+  for (uint8_t d = 0; d < 7; d++) {
+    out.printf("<label><input type='checkbox' name='day%u' checked> %s</label> ", d, WEEKDAY_NAMES[d]);
+  }
+  out.print("<br/><label>Pulse (ms, 0 = channel) <input type='number' name='durationMs' min='0' max='600000' "
+            "value='0'></label><br/>");
+  out.print("<label>Active from <input type='date' name='from'></label> ");
+  out.print("<label>to <input type='date' name='to'></label><br/>");
+  out.print("<button type='submit'>Add Rule</button>");
+  out.print("</form>");
+  out.print("</section>");
+}
+
+void renderIndexPage(Print &out) {
+  // Status
+  renderHeader(out, "Dashboard");
+  out.print("<section><h2>Status</h2>");
+  // data-status fields are refreshed in place by /static/app.js from /api/status
+  out.print("<div>WiFi: <span data-status='ip'>");
+  if (WiFi.isConnected()) {
+    out.print(WiFi.localIP());
+  } else {
+    out.print("Not connected");
+  }
+  out.print("</span></div>");
+  out.print("<div>MQTT: <span data-status='mqttConnected'>");
+  out.print(mqttClient.connected() ? "Connected" : "Disconnected");
+  out.print("</span></div>");
+  if (config.channelCount > 1) {
+    out.print("<form method='POST' action='/api/trigger'><input type='hidden' name='ch' value='all'>");
+    out.print("<button type='submit'>Trigger All</button></form>");
+  }
+  out.print("</section>");
+
+  for (uint8_t ch = 0; ch < config.channelCount; ch++) {
+    renderChannelSection(out, ch);
+  }
+
+  renderFooter(out);
+}
+
+void renderConfigPage(Print &out) {
+  renderHeader(out, "Config");
+
+  out.print("<section><h2>Channels</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  out.print("<label>Number of channels: <input type='number' name='channelCount' min='1' max='");
+  out.print(MAX_CHANNELS);
+  out.print("' value='");
+  out.print(config.channelCount);
+  out.print("'></label><br/>");
+  static const char *const policyLabels[TRIGGER_POLICY_COUNT] = {
+    "Drop it", "Extend the running pulse", "Queue it for afterwards"
+  };
+  out.print("<label>Trigger while a channel is pulsing: <select name='triggerPolicy'>");
+  for (uint8_t i = 0; i < TRIGGER_POLICY_COUNT; i++) {
+    out.print("<option value='");
+    out.print(i);
+    out.print(config.triggerPolicy == i ? "' selected>" : "'>");
+    out.print(policyLabels[i]);
+    out.print("</option>");
+  }
+  out.print("</select></label>");
+  out.print("<br/><button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  // Pin select: common NodeMCU pins
+  static const struct PinOption { const char* label; int gpio; } options[] = {
+    {"D0 (GPIO16)", 16}, {"D1 (GPIO5)", 5}, {"D2 (GPIO4)", 4}, {"D3 (GPIO0)", 0},
+    {"D4 (GPIO2)", 2}, {"D5 (GPIO14)", 14}, {"D6 (GPIO12)", 12}, {"D7 (GPIO13)", 13},
+    {"D8 (GPIO15)", 15}
+  };
+  for (uint8_t ch = 0; ch < config.channelCount; ch++) {
+    const ChannelConfig &c = config.channels[ch];
+    out.print("<section><h2>Channel ");
+    out.print(ch);
+    out.print(" Trigger</h2>");
+    out.print("<form method='POST' action='/api/config'>");
+    printChannelField(out, ch);
+    out.print("<label>Trigger Pin: <select name='triggerPin'>");
+    for (auto &opt: options) {
+      out.print("<option value='");
+      out.print(opt.gpio);
+      out.print(c.pin == opt.gpio ? "' selected>" : "'>");
+      printEscaped(out, opt.label);
+      out.print("</option>");
+    }
+    out.print("</select></label><br/>");
+    out.print("<label>Active Level: <select name='activeLevel'>");
+    out.print(c.activeHigh ? "<option value='HIGH' selected>HIGH</option>" : "<option value='HIGH'>HIGH</option>");
+    out.print(!c.activeHigh ? "<option value='LOW' selected>LOW</option>" : "<option value='LOW'>LOW</option>");
+    out.print("</select></label><br/>");
+    out.print("<label>Pulse Duration (ms): <input type='number' min='1' max='600000' name='pulseMs' value='");
+    out.print(c.durationMs);
+    out.print("'></label>");
+    out.print("<br/><button type='submit'>Save</button>");
+    out.print("</form>");
+    out.print("</section>");
+  }
+
+  out.print("<section><h2>MQTT</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  out.print("<label>Host: <input type='text' name='mqttHost' value='");
+  printEscaped(out, config.mqttHost);
+  out.print("'></label><br/>");
+  out.print("<label>Port: <input type='number' name='mqttPort' min='1' max='65535' value='");
+  out.print(config.mqttPort);
+  out.print("'></label><br/>");
+  out.print("<label>Username: <input type='text' name='mqttUser' value='");
+  printEscaped(out, config.mqttUser);
+  out.print("'></label><br/>");
+  printPasswordField(out, "Password", "mqttPass", "mqttPassClear", config.mqttPass);
+  out.print("<label>Topic (subscribe): <input type='text' name='mqttTopic' value='");
+  printEscaped(out, config.mqttTopic);
+  out.print("'></label><br/>");
+  out.print("<label>Publish metrics every (seconds, 0 = off): <input type='number' name='metricsPublishSec' min='0' max='65535' value='");
+  out.print(config.metricsPublishSec);
+  out.print("'></label><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  out.print("<section><h2>Time</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  out.print("<label>Timezone offset (minutes from UTC): <input type='number' name='tz' min='-720' max='840' value='");
+  out.print(config.timezoneOffsetMinutes);
+  out.print("'></label><br/>");
+  out.print("<label>Timezone with DST (POSIX TZ, overrides the offset): <input name='timezone' "
+            "placeholder='CET-1CEST,M3.5.0,M10.5.0/3' value='");
+  printEscaped(out, config.timezone);
+  out.print("'></label><br/>");
+  out.print("<label>Fire missed schedule entries up to (seconds late): <input type='number' name='catchUp' min='0' max='3600' value='");
+  out.print(config.scheduleCatchUpSec);
+  out.print("'></label><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  out.print("<section><h2>Groups</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  out.print("<label>Member of groups (1-65535, comma separated): <input name='groups' value='");
+  for (size_t i = 0; i < config.groups.size(); i++) {
+    if (i) out.print(", ");
+    out.print(config.groups[i]);
+  }
+  out.print("'></label><br/>");
+  out.print("<label><input type='checkbox' name='groupLeader' ");
+  out.print(config.groupLeader ? "checked" : "");
+  out.print("> Time leader (members time group starts by this device's clock)</label><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("<form method='POST' action='/api/group/trigger'>");
+  out.print("<label>Group: <input type='number' name='group' min='1' max='65535' required></label> ");
+  out.print("<label>Start in (ms): <input type='number' name='leadMs' min='0' max='60000' value='");
+  out.print(GROUP_DEFAULT_LEAD_MS);
+  out.print("'></label> ");
+  out.print("<button type='submit'>Trigger group</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  out.print("<section><h2>Power</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  static const char *const powerModes[] = {"Always on", "Modem sleep", "Light sleep"};
+  out.print("<label>WiFi power mode: <select name='powerMode'>");
+  for (uint8_t i = 0; i < 3; i++) {
+    out.print("<option value='");
+    out.print(i);
+    out.print(config.powerMode == i ? "' selected>" : "'>");
+    out.print(powerModes[i]);
+    out.print("</option>");
+  }
+  out.print("</select></label><br/>");
+  out.print("<label>Listen interval (DTIM periods): <input type='number' name='listenInterval' min='1' max='10' value='");
+  out.print(config.listenInterval);
+  out.print("'></label><br/>");
+  out.print("<label>Deep sleep when idle for at least (seconds, 0 = off): <input type='number' name='deepSleepMinGap' min='0' value='");
+  out.print(config.deepSleepMinGapSec);
+  out.print("'></label><br/>");
+  out.print("<small>Deep sleep needs GPIO16 (D0) wired to RST; the web UI is unreachable while asleep.</small><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  out.print("<section><h2>Heap watchdog</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  out.print("<label>Restart when the largest free block stays below (bytes, 0 = off): <input type='number' name='heapMinBlock' min='0' max='65535' value='");
+  out.print(config.heapMinBlock);
+  out.print("'></label><br/>");
+  out.print("<label>Restart when fragmentation stays above (%, 0 = off): <input type='number' name='heapMaxFrag' min='0' max='100' value='");
+  out.print(config.heapMaxFrag);
+  out.print("'></label><br/>");
+  out.print("<small>The restart waits for a gap with no scheduled or interval fire close; schedule and interval phases carry over.</small><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  out.print("<section><h2>Firmware</h2>");
+  out.print("<p>Running image MD5: ");
+  out.print(ESP.getSketchMD5());
+  out.print("</p>");
+  out.print("<form data-upload='/api/update'>");
+  out.print("<label>Image (.bin or .bin.gz): <input type='file' name='image' accept='.bin,.gz' required></label><br/>");
+  out.print("<button type='submit'>Upload</button> <span data-upload-status></span>");
+  out.print("</form>");
+  out.print("<form method='POST' action='/api/config'>");
+  printPasswordField(out, "OTA password (ArduinoOTA and /api/update, both off while none is set)", "otaPassword",
+                     "otaPasswordClear", config.otaPassword);
+  out.print("<small>A new password applies to ArduinoOTA after the next restart.</small><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  out.print("<section><h2>WiFi</h2>");
+  out.print("<form method='POST' action='/api/config'>");
+  out.print("<input type='hidden' name='wifiForm' value='1'>");
+  out.print("<label><input type='checkbox' name='wifiFastReconnect' ");
+  out.print(config.wifiFastReconnect ? "checked" : "");
+  out.print("> Fast reconnect (reuse last AP, channel and IP after a reset)</label><br/>");
+  out.print("<button type='submit'>Save</button>");
+  out.print("</form>");
+  out.print("</section>");
+
+  renderFooter(out);
+}
+
+void handleRoot() {
+  ChunkedResponse out(server);
+  out.begin(200, "text/html; charset=utf-8");
+  renderIndexPage(out);
+  out.end();
+}
+
+void handleConfigPage() {
+  ChunkedResponse out(server);
+  out.begin(200, "text/html; charset=utf-8");
+  renderConfigPage(out);
+  out.end();
+}
+
+// Pre-gzipped assets from include/web_assets.h, revalidated by ETag
+void handleStaticAsset(const WebAsset &asset) {
+  server.sendHeader("ETag", asset.etag);
+  server.sendHeader("Cache-Control", "public, max-age=86400, must-revalidate");
+  if (server.header("If-None-Match") == asset.etag) {
+    server.send(304);
+    return;
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, asset.contentType, (PGM_P)asset.data, asset.length);
+}
+
+// Request arguments by name without String temporaries: the server keeps
+// each value as a String already, and these hand out views of it rather
+// than copies. Looked up by index, since arg(const String&) would build a
+// String from the name.
+static const String *findArg(const char *name) {
+  for (int i = 0; i < server.args(); i++) {
+    if (server.argName(i) == name) return &server.arg(i);
+  }
+  return nullptr;
+}
+
+static bool argPresent(const char *name) {
+  return findArg(name) != nullptr;
+}
+
+// Value of name, "" when absent; valid until the handler returns
+static const char *argStr(const char *name) {
+  const String *v = findArg(name);
+  return v ? v->c_str() : "";
+}
+
+static long argLong(const char *name) {
+  return atol(argStr(name));
+}
+
+static bool argIs(const char *name, const char *value) {
+  return strcmp(argStr(name), value) == 0;
+}
+
+// Form side of printPasswordField: an empty field keeps the stored value
+// and clearName empties it; true when dst changed
+template <size_t N>
+static bool passwordArgCopy(const char *name, const char *clearName, char (&dst)[N]) {
+  const char *v = argPresent(clearName) ? "" : argStr(name);
+  if ((!v[0] && !argPresent(clearName)) || strcmp(v, dst) == 0) return false;
+  copyString(dst, v);
+  return true;
+}
+
+// Copies name into a fixed buffer with surrounding whitespace trimmed;
+// false when it does not fit
+static bool argCopyTrimmed(const char *name, char *out, size_t cap) {
+  const char *v = argStr(name);
+  while (isspace((unsigned char)*v)) v++;
+  size_t len = strlen(v);
+  while (len && isspace((unsigned char)v[len - 1])) len--;
+  if (len >= cap) return false;
+  memcpy(out, v, len);
+  out[len] = '\0';
+  return true;
+}
+
+static void redirectTo(const char *location) {
+  server.sendHeader("Location", location);
+  server.send(303);
+}
+
+// Channel addressed by the "ch" argument, channel 0 when absent. Sends a
+// 400 and returns false when it is out of range.
+bool channelArg(uint8_t &ch) {
+  ch = 0;
+  if (!argPresent("ch")) return true;
+  long n = argLong("ch");
+  if (n < 0 || n >= config.channelCount) {
+    server.send(400, "text/plain", "Invalid channel");
+    return false;
+  }
+  ch = (uint8_t)n;
+  return true;
+}
+
+void handleTriggerPost() {
+  bool queued = true;
+  if (argIs("ch", "all")) {
+    // started together in this pass's commit
+    for (uint8_t i = 0; i < config.channelCount; i++) queued = triggerPulse(i, TRIG_SRC_WEB) && queued;
+  } else {
+    uint8_t ch;
+    if (!channelArg(ch)) return;
+    queued = triggerPulse(ch, TRIG_SRC_WEB);
+  }
+  if (!queued) {
+    server.send(503, "text/plain", "Trigger queue full");
+    return;
+  }
+  redirectTo("/");
+}
+
+// group, plus optional mask (channel bits, 0 = all), ms and leadMs
+void handleGroupTriggerPost() {
+  long group = argLong("group");
+  long mask = argPresent("mask") ? argLong("mask") : 0;
+  long ms = argPresent("ms") ? argLong("ms") : 0;
+  long lead = argPresent("leadMs") ? argLong("leadMs") : GROUP_DEFAULT_LEAD_MS;
+  if (group < 1 || group > 65535 || mask < 0 || mask > 0xFF || ms < 0 || ms > 600000 || lead < 0 ||
+      lead > (long)GROUP_MAX_LEAD_MS) {
+    server.send(400, "text/plain", "Invalid group, mask, ms or leadMs");
+    return;
+  }
+  if (!groupSend((uint16_t)group, (uint8_t)mask, (uint32_t)ms, (uint32_t)lead)) {
+    server.send(503, "text/plain", "Not connected");
+    return;
+  }
+  redirectTo("/config");
+}
+
+void handleIntervalPost() {
+  uint8_t ch;
+  if (!channelArg(ch)) return;
+  if (!argPresent("seconds")) {
+    server.send(400, "text/plain", "Missing seconds");
+    return;
+  }
+  long s = argLong("seconds");
+  if (s < 0 || s > (long)MAX_INTERVAL_SECONDS) {
+    server.send(400, "text/plain", "seconds out of range, at most 2147483");
+    return;
+  }
+  ChannelConfig &c = config.channels[ch];
+  bool en = argPresent("enabled");
+  c.intervalSeconds = (uint32_t)s;
+  c.intervalEnabled = en && s > 0;
+  markConfigDirty();
+  armInterval(ch);
+  redirectTo("/");
+}
+
+void handleScheduleAdd() {
+  uint8_t ch;
+  if (!channelArg(ch)) return;
+  if (!argPresent("time")) {
+    server.send(400, "text/plain", "Missing time");
+    return;
+  }
+  int m = parseTimeToMinutes(argStr("time"));
+  if (m < 0) {
+    server.send(400, "text/plain", "Invalid time format, expected HH:MM");
+    return;
+  }
+  if (!scheduleAddMinute(config.channels[ch], (uint16_t)m)) {
+    server.send(400, "text/plain", "Schedule is full");
+    return;
+  }
+  markConfigDirty();
+  compileSchedule();
+  redirectTo("/");
+}
+
+void handleScheduleRemove() {
+  uint8_t ch;
+  if (!channelArg(ch)) return;
+  if (!argPresent("idx")) {
+    server.send(400, "text/plain", "Missing idx");
+    return;
+  }
+  ChannelConfig &c = config.channels[ch];
+  long idx = argLong("idx");
+  if (idx < 0 || idx >= c.scheduleCount) {
+    server.send(400, "text/plain", "Invalid idx");
+    return;
+  }
+  scheduleRemoveAt(c, (uint8_t)idx);
+  markConfigDirty();
+  compileSchedule();
+  redirectTo("/");
+}
+
+// Form fields: start, end, every, day0..day6 (checkboxes, 0 = Sunday),
+// durationMs, from, to. Validated by the same parser as the JSON config.
+void handleScheduleRuleAdd() {
+  uint8_t ch;
+  if (!channelArg(ch)) return;
+  std::vector<ScheduleRule> &rules = config.channels[ch].scheduleRules;
+  if (rules.size() >= MAX_SCHEDULE_RULES) {
+    server.send(400, "text/plain", "Too many rules");
+    return;
+  }
+  // The document borrows the server's argument strings
+  StaticJsonDocument<JSON_OBJECT_SIZE(7)> doc;
+  doc["start"] = argStr("start");
+  for (const char *key : {"end", "from", "to"}) {
+    if (*argStr(key)) doc[key] = argStr(key);
+  }
+  doc["everyMin"] = argLong("every");
+  doc["durationMs"] = argLong("durationMs");
+  uint8_t weekdays = 0;
+  for (uint8_t d = 0; d < 7; d++) {
+    char name[5] = {'d', 'a', 'y', (char)('0' + d), '\0'};
+    if (argPresent(name)) weekdays |= 1 << d;
+  }
+  doc["weekdays"] = weekdays;
+  ScheduleRule r;
+  const char *error = scheduleRuleFromJson(doc.as<JsonVariantConst>(), r);
+  if (error) {
+    server.send(400, "text/plain", error);
+    return;
+  }
+  rules.push_back(r);
+  markConfigDirty();
+  compileSchedule();
+  redirectTo("/");
+}
+
+void handleScheduleRuleRemove() {
+  uint8_t ch;
+  if (!channelArg(ch)) return;
+  std::vector<ScheduleRule> &rules = config.channels[ch].scheduleRules;
+  int idx = argPresent("idx") ? argLong("idx") : -1;
+  if (idx < 0 || (size_t)idx >= rules.size()) {
+    server.send(400, "text/plain", "Invalid idx");
+    return;
+  }
+  rules.erase(rules.begin() + idx);
+  markConfigDirty();
+  compileSchedule();
+  redirectTo("/");
+}
+
+// Grow or shrink the channel table. Removed channels stop; their settings
+// are kept in RAM (and come back if re-added before a reboot).
+void setChannelCount(uint8_t n) {
+  if (n < 1) n = 1;
+  if (n > MAX_CHANNELS) n = MAX_CHANNELS;
+  if (n == config.channelCount) return;
+  for (uint8_t i = n; i < config.channelCount; i++) pulseAbort(i);
+  pulseService();
+  uint8_t prev = config.channelCount;
+  config.channelCount = n;
+  for (uint8_t i = prev; i < n; i++) applyChannelPin(i);
+  compileSchedule();
+  armIntervals();
+}
+
+static const size_t METRICS_JSON_CAPACITY =
+    JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(LOOP_BUCKET_COUNT + 1) +
+    JSON_OBJECT_SIZE(12) + JSON_ARRAY_SIZE(HEAP_HISTORY_LEN) + HEAP_HISTORY_LEN * JSON_ARRAY_SIZE(3) +
+    JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(5) +
+    JSON_ARRAY_SIZE(MAX_CHANNELS) + MAX_CHANNELS * JSON_OBJECT_SIZE(3) +
+    JSON_ARRAY_SIZE(MAX_ROUTE_METRICS) + MAX_ROUTE_METRICS * JSON_OBJECT_SIZE(5);
+
+void metricsToJson(JsonDocument &doc) {
+  doc["uptimeMs"] = millis();
+
+  JsonObject loopObj = doc.createNestedObject("loop");
+  loopObj["count"] = loopMetrics.count;
+  loopObj["sumUs"] = loopMetrics.sumUs;
+  loopObj["maxUs"] = loopMetrics.maxUs;
+  JsonArray bounds = loopObj.createNestedArray("bucketUs");
+  for (uint8_t i = 0; i < LOOP_BUCKET_COUNT; i++) bounds.add(LOOP_BUCKET_US[i]);
+  JsonArray buckets = loopObj.createNestedArray("buckets"); // per bucket, last is above the largest bound
+  for (uint8_t i = 0; i <= LOOP_BUCKET_COUNT; i++) buckets.add(loopMetrics.buckets[i]);
+
+  JsonObject heap = doc.createNestedObject("heap");
+  heap["free"] = ESP.getFreeHeap();
+  heap["maxBlock"] = ESP.getMaxFreeBlockSize();
+  heap["fragmentation"] = ESP.getHeapFragmentation();
+  heap["samples"] = heapWatch.samples;
+  heap["lowFree"] = heapWatch.samples ? heapWatch.low.freeBytes : 0;
+  heap["lowMaxBlock"] = heapWatch.samples ? heapWatch.low.maxBlock : 0;
+  heap["highFragmentation"] = heapWatch.low.fragPct;
+  heap["freeTrendPerHour"] = heapTrendPerHour(&HeapSample::freeBytes);
+  heap["maxBlockTrendPerHour"] = heapTrendPerHour(&HeapSample::maxBlock);
+  heap["restartDeferrals"] = heapWatch.restartDeferrals;
+  heap["historySpanSec"] = HEAP_SAMPLE_MS * HEAP_SPAN_SAMPLES / 1000;
+  JsonArray history = heap.createNestedArray("history"); // [free, maxBlock, fragmentation] per span, oldest first
+  for (uint8_t i = 0; i < heapWatch.historyCount; i++) {
+    const HeapSample &h = heapHistoryAt(i);
+    JsonArray entry = history.createNestedArray();
+    entry.add(h.freeBytes);
+    entry.add(h.maxBlock);
+    entry.add(h.fragPct);
+  }
+
+  JsonObject timeObj = doc.createNestedObject("time");
+  timeObj["synced"] = timeSync.valid;
+  timeObj["sinceSyncMs"] = timeSync.valid ? millis() - timeSync.lastSyncMillis : 0;
+  timeObj["lastStepMs"] = timeSync.lastStepMs;
+  timeObj["driftPpm"] = timeSync.driftPpm;
+  timeObj["syncs"] = timeSync.syncs;
+  timeObj["requests"] = timeSync.requests;
+  timeObj["missed"] = timeSync.missed;
+
+  JsonObject groupObj = doc.createNestedObject("group");
+  groupObj["following"] = groupFollowing();
+  groupObj["clockOffsetMs"] = groupLink.beacon.offsetMs;
+  groupObj["clockJitterMs"] = groupLink.beacon.jitterMs;
+  groupObj["beacons"] = groupLink.beacon.received;
+  groupObj["timedStarts"] = groupLink.timedStarts;
+  groupObj["lastStartErrorUs"] = groupLink.lastStartErrorUs;
+  groupObj["maxStartErrorUs"] = groupLink.maxStartErrorUs;
+
+  JsonObject mqttObj = doc.createNestedObject("mqtt");
+  mqttObj["attempts"] = mqttLink.attempts;
+  mqttObj["connects"] = mqttLink.connects;
+  mqttObj["failures"] = mqttLink.failures;
+  mqttObj["statePublishes"] = mqttState.publishes;
+
+  JsonObject queueObj = doc.createNestedObject("triggerQueue");
+  queueObj["requests"] = triggerQueue.requests;
+  queueObj["dropped"] = triggerQueue.dropped;
+  queueObj["coalesced"] = triggerQueue.coalesced;
+  queueObj["overflows"] = triggerQueue.overflows;
+
+  JsonObject logObj = doc.createNestedObject("eventLog");
+  logObj["records"] = eventLog.nextSeq - eventLog.firstSeq;
+  logObj["capacity"] = EVENT_LOG_CAPACITY;
+  logObj["pending"] = eventLog.pending;
+  logObj["flushes"] = eventLog.flushes;
+  logObj["lost"] = eventLog.lost;
+
+  JsonArray channels = doc.createNestedArray("channels");
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    JsonObject ch = channels.createNestedObject();
+    ch["pulses"] = pulse.ch[i].pulses;
+    ch["overruns"] = pulse.ch[i].overruns;
+    ch["maxErrorUs"] = pulse.ch[i].maxErrorUs;
+  }
+
+  JsonArray routes = doc.createNestedArray("routes");
+  for (uint8_t i = 0; i < routeMetricCount; i++) {
+    const RouteMetric &m = routeMetrics[i];
+    JsonObject r = routes.createNestedObject();
+    r["method"] = httpMethodName(m.method);
+    r["path"] = m.path;
+    r["count"] = m.count;
+    r["sumUs"] = m.sumUs;
+    r["maxUs"] = m.maxUs;
+  }
+}
+
+static void printSeconds(Print &out, uint64_t us) {
+  out.print((double)us / 1e6, 6);
+}
+
+// Sample values end in a bare '\n': println() would add "\r", which the
+// Prometheus parser reads as part of the number
+template <typename T>
+static void promValue(Print &out, T v) {
+  out.print(v);
+  out.print('\n');
+}
+
+static void promValue(Print &out, double v, int digits) {
+  out.print(v, digits);
+  out.print('\n');
+}
+
+// Prometheus text exposition format, version 0.0.4
+void renderMetricsPrometheus(Print &out) {
+  out.print("# TYPE diffuser_uptime_seconds gauge\ndiffuser_uptime_seconds ");
+  promValue(out, millis() / 1000);
+
+  out.print("# TYPE diffuser_loop_duration_seconds histogram\n");
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i <= LOOP_BUCKET_COUNT; i++) {
+    cumulative += loopMetrics.buckets[i];
+    out.print("diffuser_loop_duration_seconds_bucket{le=\"");
+    if (i < LOOP_BUCKET_COUNT) printSeconds(out, LOOP_BUCKET_US[i]); else out.print("+Inf");
+    out.print("\"} ");
+    promValue(out, cumulative);
+  }
+  out.print("diffuser_loop_duration_seconds_sum ");
+  printSeconds(out, loopMetrics.sumUs);
+  out.print("\ndiffuser_loop_duration_seconds_count ");
+  promValue(out, loopMetrics.count);
+  out.print("# TYPE diffuser_loop_max_seconds gauge\ndiffuser_loop_max_seconds ");
+  printSeconds(out, loopMetrics.maxUs);
+  out.print('\n');
+
+  out.print("# TYPE diffuser_heap_free_bytes gauge\ndiffuser_heap_free_bytes ");
+  promValue(out, ESP.getFreeHeap());
+  out.print("# TYPE diffuser_heap_max_block_bytes gauge\ndiffuser_heap_max_block_bytes ");
+  promValue(out, ESP.getMaxFreeBlockSize());
+  out.print("# TYPE diffuser_heap_fragmentation_percent gauge\ndiffuser_heap_fragmentation_percent ");
+  promValue(out, ESP.getHeapFragmentation());
+  out.print("# TYPE diffuser_heap_low_max_block_bytes gauge\ndiffuser_heap_low_max_block_bytes ");
+  promValue(out, heapWatch.samples ? heapWatch.low.maxBlock : 0);
+  out.print("# TYPE diffuser_heap_max_block_trend_bytes_per_hour gauge\ndiffuser_heap_max_block_trend_bytes_per_hour ");
+  promValue(out, heapTrendPerHour(&HeapSample::maxBlock));
+  out.print("# TYPE diffuser_heap_restart_pending gauge\ndiffuser_heap_restart_pending ");
+  promValue(out, heapWatch.restartPending ? 1 : 0);
+  out.print("# TYPE diffuser_heap_restarts_total counter\ndiffuser_heap_restarts_total ");
+  promValue(out, rtcState.heapRestarts);
+
+  out.print("# TYPE diffuser_mqtt_connect_attempts_total counter\ndiffuser_mqtt_connect_attempts_total ");
+  promValue(out, mqttLink.attempts);
+  out.print("# TYPE diffuser_mqtt_connects_total counter\ndiffuser_mqtt_connects_total ");
+  promValue(out, mqttLink.connects);
+  out.print("# TYPE diffuser_mqtt_connected gauge\ndiffuser_mqtt_connected ");
+  promValue(out, mqttClient.connected() ? 1 : 0);
+
+  out.print("# TYPE diffuser_trigger_requests_total counter\ndiffuser_trigger_requests_total ");
+  promValue(out, triggerQueue.requests);
+  out.print("# TYPE diffuser_trigger_dropped_total counter\ndiffuser_trigger_dropped_total ");
+  promValue(out, triggerQueue.dropped);
+  out.print("# TYPE diffuser_trigger_coalesced_total counter\ndiffuser_trigger_coalesced_total ");
+  promValue(out, triggerQueue.coalesced);
+  out.print("# TYPE diffuser_trigger_overflows_total counter\ndiffuser_trigger_overflows_total ");
+  promValue(out, triggerQueue.overflows);
+  out.print("# TYPE diffuser_event_log_records gauge\ndiffuser_event_log_records ");
+  promValue(out, eventLog.nextSeq - eventLog.firstSeq);
+  out.print("# TYPE diffuser_event_log_lost_total counter\ndiffuser_event_log_lost_total ");
+  promValue(out, eventLog.lost);
+
+  out.print("# TYPE diffuser_group_clock_offset_seconds gauge\ndiffuser_group_clock_offset_seconds ");
+  promValue(out, (double)groupLink.beacon.offsetMs / 1e3, 3);
+  out.print("# TYPE diffuser_group_clock_jitter_seconds gauge\ndiffuser_group_clock_jitter_seconds ");
+  promValue(out, (double)groupLink.beacon.jitterMs / 1e3, 3);
+  out.print("# TYPE diffuser_group_timed_starts_total counter\ndiffuser_group_timed_starts_total ");
+  promValue(out, groupLink.timedStarts);
+  out.print("# TYPE diffuser_group_start_error_seconds gauge\ndiffuser_group_start_error_seconds ");
+  promValue(out, (double)groupLink.lastStartErrorUs / 1e6, 6);
+  out.print("# TYPE diffuser_group_start_error_max_seconds gauge\ndiffuser_group_start_error_max_seconds ");
+  printSeconds(out, groupLink.maxStartErrorUs);
+  out.print('\n');
+
+  out.print("# TYPE diffuser_pulses_total counter\n");
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    out.print("diffuser_pulses_total{channel=\"");
+    out.print(i);
+    out.print("\"} ");
+    promValue(out, pulse.ch[i].pulses);
+  }
+  out.print("# TYPE diffuser_pulse_overruns_total counter\n");
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    out.print("diffuser_pulse_overruns_total{channel=\"");
+    out.print(i);
+    out.print("\"} ");
+    promValue(out, pulse.ch[i].overruns);
+  }
+
+  out.print("# TYPE diffuser_http_requests_total counter\n");
+  for (uint8_t i = 0; i < routeMetricCount; i++) {
+    out.print("diffuser_http_requests_total{method=\"");
+    out.print(httpMethodName(routeMetrics[i].method));
+    out.print("\",path=\"");
+    out.print(routeMetrics[i].path);
+    out.print("\"} ");
+    promValue(out, routeMetrics[i].count);
+  }
+  out.print("# TYPE diffuser_http_request_seconds_total counter\n");
+  for (uint8_t i = 0; i < routeMetricCount; i++) {
+    out.print("diffuser_http_request_seconds_total{method=\"");
+    out.print(httpMethodName(routeMetrics[i].method));
+    out.print("\",path=\"");
+    out.print(routeMetrics[i].path);
+    out.print("\"} ");
+    printSeconds(out, routeMetrics[i].sumUs);
+    out.print('\n');
+  }
+  out.print("# TYPE diffuser_http_request_max_seconds gauge\n");
+  for (uint8_t i = 0; i < routeMetricCount; i++) {
+    out.print("diffuser_http_request_max_seconds{method=\"");
+    out.print(httpMethodName(routeMetrics[i].method));
+    out.print("\",path=\"");
+    out.print(routeMetrics[i].path);
+    out.print("\"} ");
+    printSeconds(out, routeMetrics[i].maxUs);
+    out.print('\n');
+  }
+}
+
+// GET /api/metrics: JSON, or Prometheus text with ?format=prometheus
+void handleMetrics() {
+  ChunkedResponse out(server);
+  if (argIs("format", "prometheus")) {
+    out.begin(200, "text/plain; version=0.0.4");
+    renderMetricsPrometheus(out);
+  } else {
+    DynamicJsonDocument doc(METRICS_JSON_CAPACITY);
+    metricsToJson(doc);
+    out.begin(200, "application/json");
+    serializeJson(doc, out);
+  }
+  out.end();
+}
+
+static const long EVENT_LOG_PAGE_DEFAULT = 100;
+static const long EVENT_LOG_PAGE_MAX = 500;
+
+// GET /api/events/log?from=<seq>&limit=<n>: trigger event records, oldest
+// first. Each record is read from flash as it is sent, so a page costs one
+// record of RAM. Pass nextFrom back as from for the next page.
+void handleEventLog() {
+  long limit = argPresent("limit") ? argLong("limit") : EVENT_LOG_PAGE_DEFAULT;
+  long from = argPresent("from") ? argLong("from") : 0;
+  if (limit < 1 || limit > EVENT_LOG_PAGE_MAX || from < 0) {
+    server.send(400, "text/plain", "Invalid from or limit");
+    return;
+  }
+  uint32_t seq = (uint32_t)from > eventLog.firstSeq ? (uint32_t)from : eventLog.firstSeq;
+  File f;
+  if (eventLog.ready && seq < eventLog.nextSeq - eventLog.pending) f = LittleFS.open(EVENT_LOG_PATH, "r");
+
+  ChunkedResponse out(server);
+  out.begin(200, "application/json");
+  out.printf("{\"capacity\":%u,\"first\":%lu,\"count\":%lu,\"events\":[", EVENT_LOG_CAPACITY,
+             (unsigned long)eventLog.firstSeq, (unsigned long)(eventLog.nextSeq - eventLog.firstSeq));
+  long sent = 0;
+  for (; seq < eventLog.nextSeq && sent < limit; seq++) {
+    EventRecord r;
+    if (!eventLogRead(f, seq, r)) continue; // torn, or lost in a failed write
+    if (sent++) out.print(',');
+    out.printf("{\"seq\":%lu,\"epoch\":%lu,\"uptimeMs\":%lu,\"ch\":%u,\"source\":\"%s\",\"requestedMs\":%lu,"
+               "\"actualMs\":%lu,\"flags\":[",
+               (unsigned long)r.seq, (unsigned long)r.epochSec, (unsigned long)r.uptimeMs, r.channel,
+               r.source < TRIG_SRC_COUNT ? TRIGGER_SOURCE_NAMES[r.source] : "unknown", (unsigned long)r.requestedMs,
+               (unsigned long)r.actualMs);
+    bool first = true;
+    for (uint8_t i = 0; i < EVENT_FLAG_COUNT; i++) {
+      if (!(r.flags & (1 << i))) continue;
+      out.printf(first ? "\"%s\"" : ",\"%s\"", EVENT_FLAG_NAMES[i]);
+      first = false;
+    }
+    out.print("]}");
+  }
+  out.printf("],\"nextFrom\":%lu}", (unsigned long)seq);
+  out.end();
+  if (f) f.close();
+}
+
+// GET /metrics: the conventional Prometheus scrape path
+void handleMetricsPrometheus() {
+  ChunkedResponse out(server);
+  out.begin(200, "text/plain; version=0.0.4");
+  renderMetricsPrometheus(out);
+  out.end();
+}
+
+// EVT_METRICS_PUBLISH: the JSON metrics to <topic>/metrics, streamed so
+// they need not fit the client buffer
+void onMetricsPublishTimer() {
+  if (config.metricsPublishSec == 0) return;
+  timers.armIn(EVT_METRICS_PUBLISH, config.metricsPublishSec * 1000UL);
+  if (mqttLink.state != MQTT_LINK_UP || !mqttClient.connected()) return;
+  DynamicJsonDocument doc(METRICS_JSON_CAPACITY);
+  metricsToJson(doc);
+  char topic[MQTT_TOPIC_SIZE + 8];
+  snprintf(topic, sizeof(topic), "%s/metrics", config.mqttTopic);
+  mqttClient.beginPublish(topic, measureJson(doc), false);
+  serializeJson(doc, mqttClient);
+  mqttClient.endPublish();
+}
+
+void armMetricsPublish() {
+  if (config.metricsPublishSec > 0) {
+    timers.armIn(EVT_METRICS_PUBLISH, config.metricsPublishSec * 1000UL);
+  } else {
+    timers.cancel(EVT_METRICS_PUBLISH);
+  }
+}
+
+void handleConfigPost() {
+  uint8_t ch;
+  if (!channelArg(ch)) return;
+  PosixTz tzCheck;
+  char tzRule[TIMEZONE_SIZE];
+  if (!argCopyTrimmed("timezone", tzRule, sizeof(tzRule)) || (tzRule[0] && !parsePosixTz(tzRule, tzCheck))) {
+    server.send(400, "text/plain", "Invalid timezone, expected a POSIX TZ string such as CET-1CEST,M3.5.0,M10.5.0/3");
+    return;
+  }
+  // Checked up front, so a bad field leaves the config untouched
+  static const struct {
+    const char *name;
+    size_t size;
+  } stringFields[] = {{"mqttHost", MQTT_HOST_SIZE}, {"mqttUser", MQTT_CRED_SIZE}, {"mqttPass", MQTT_CRED_SIZE},
+                      {"mqttTopic", MQTT_TOPIC_SIZE}, {"otaPassword", MQTT_CRED_SIZE}};
+  for (const auto &f : stringFields) {
+    if (strlen(argStr(f.name)) >= f.size) {
+      server.send(400, "text/plain", "Value too long");
+      return;
+    }
+  }
+  ChannelConfig &c = config.channels[ch];
+  bool needApplyPin = false;
+  bool needReconnectMqtt = false;
+
+  if (argPresent("channelCount")) {
+    long n = argLong("channelCount");
+    setChannelCount(n < 1 ? 1 : n > MAX_CHANNELS ? MAX_CHANNELS : (uint8_t)n);
+  }
+  if (argPresent("triggerPolicy")) {
+    long policy = argLong("triggerPolicy");
+    config.triggerPolicy = policy >= 0 && policy < TRIGGER_POLICY_COUNT ? (uint8_t)policy : (uint8_t)TRIGGER_POLICY_DROP;
+  }
+  if (argPresent("triggerPin")) {
+    int newPin = argLong("triggerPin");
+    if (newPin != c.pin) {
+      pulseAbort(ch);
+      pulseService();
+      c.pin = newPin;
+      needApplyPin = true;
+    }
+  }
+  if (argPresent("activeLevel")) {
+    bool high = (argIs("activeLevel", "HIGH"));
+    if (high != c.activeHigh) {
+      pulseAbort(ch); // ends at the level it started with
+      pulseService();
+      c.activeHigh = high;
+      needApplyPin = true;
+    }
+  }
+  if (argPresent("pulseMs")) {
+    long ms_in = argLong("pulseMs");
+    if (ms_in < 1) ms_in = 1;               // enforce minimum 1 ms
+    if (ms_in > 600000) ms_in = 600000;     // clamp to 10 minutes
+    c.durationMs = (uint32_t)ms_in;
+  }
+  if (argPresent("mqttHost") && !argIs("mqttHost", config.mqttHost)) {
+    copyString(config.mqttHost, argStr("mqttHost"));
+    needReconnectMqtt = true;
+  }
+  if (argPresent("mqttPort")) {
+    uint16_t newPort = (uint16_t) argLong("mqttPort");
+    if (newPort != config.mqttPort) { config.mqttPort = newPort; needReconnectMqtt = true; }
+  }
+  if (argPresent("mqttUser") && !argIs("mqttUser", config.mqttUser)) {
+    copyString(config.mqttUser, argStr("mqttUser"));
+    needReconnectMqtt = true;
+  }
+  if (passwordArgCopy("mqttPass", "mqttPassClear", config.mqttPass)) needReconnectMqtt = true;
+  if (argPresent("mqttTopic") && !argIs("mqttTopic", config.mqttTopic)) {
+    copyString(config.mqttTopic, argStr("mqttTopic"));
+    needReconnectMqtt = true;
+  }
+  passwordArgCopy("otaPassword", "otaPasswordClear", config.otaPassword);
+  if (argPresent("metricsPublishSec")) {
+    long sec = argLong("metricsPublishSec");
+    config.metricsPublishSec = sec < 0 ? 0 : sec > 65535 ? 65535 : (uint16_t)sec;
+    armMetricsPublish();
+  }
+  if (argPresent("tz")) {
+    config.timezoneOffsetMinutes = argLong("tz");
+    copyString(config.timezone, tzRule);
+    applyTimezone();
+    compileSchedule();
+  }
+  if (argPresent("groups")) {
+    // Numbers separated by anything else; out-of-range ones are skipped
+    config.groups.clear(); // keeps the capacity reserved in AppConfig()
+    const char *p = argStr("groups");
+    while (*p && config.groups.size() < MAX_GROUPS) {
+      if (!isdigit((unsigned char)*p)) {
+        p++;
+        continue;
+      }
+      char *end;
+      unsigned long g = strtoul(p, &end, 10);
+      p = end;
+      if (g >= 1 && g <= 65535 && !groupIsMember((uint16_t)g)) config.groups.push_back((uint16_t)g);
+    }
+    config.groupLeader = argPresent("groupLeader"); // unchecked checkboxes are not submitted
+  }
+  if (argPresent("catchUp")) {
+    long sec = argLong("catchUp");
+    config.scheduleCatchUpSec = sec < 0 ? 0 : sec > 3600 ? 3600 : (uint16_t)sec;
+  }
+  bool needApplyPower = false;
+  if (argPresent("powerMode")) {
+    long mode = argLong("powerMode");
+    if (mode < 0 || mode > 2) mode = 0;
+    needApplyPower = (uint8_t)mode != config.powerMode;
+    config.powerMode = (uint8_t)mode;
+  }
+  if (argPresent("listenInterval")) {
+    long li = argLong("listenInterval");
+    if (li < 1) li = 1;
+    if (li > 10) li = 10; // SDK maximum
+    needApplyPower = needApplyPower || (uint8_t)li != config.listenInterval;
+    config.listenInterval = (uint8_t)li;
+  }
+  if (argPresent("wifiForm")) {
+    // unchecked checkboxes are not submitted
+    config.wifiFastReconnect = argPresent("wifiFastReconnect");
+  }
+  if (argPresent("deepSleepMinGap")) {
+    long gap = argLong("deepSleepMinGap");
+    config.deepSleepMinGapSec = gap > 0 ? (uint32_t)gap : 0;
+  }
+  if (argPresent("heapMinBlock")) {
+    long block = argLong("heapMinBlock");
+    config.heapMinBlock = block < 0 ? 0 : block > 65535 ? 65535 : (uint16_t)block;
+  }
+  if (argPresent("heapMaxFrag")) {
+    long frag = argLong("heapMaxFrag");
+    config.heapMaxFrag = frag < 0 ? 0 : frag > 100 ? 100 : (uint8_t)frag;
+  }
+
+  markConfigDirty();
 
-// ================== Globals ==================
-ESP8266WebServer server(80);
-WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+  if (needApplyPower) {
+    applyPowerMode();
+  }
 
-unsigned long lastTriggerAt = 0;
-bool triggerInProgress = false;
+  // In safe mode the outputs and MQTT wait for the next boot
+  if (needApplyPin && !safeMode) {
+    applyChannelPin(ch);
+  }
+  if (needReconnectMqtt && !safeMode) {
+    mqttRestart();
+  }
 
-unsigned long nextIntervalAt = 0;
+  redirectTo("/config");
+}
 
-time_t lastTimeCheck = 0;
-int lastDayOfYear = -1;
-// One flag per schedule time to mark whether it fired today
-std::vector<bool> scheduleFiredToday;
+// Serialized /api/status, rebuilt only when statusGeneration moved. The
+// buffer is kept and only grows, so steady polling allocates nothing.
+struct StatusCache {
+  char *buf = nullptr;
+  size_t cap = 0;
+  size_t len = 0;
+  bool valid = false;
+  uint32_t generation = 0;
+  // Inputs that change without passing through statusChanged()
+  uint32_t ip = 0;
+  bool mqttUp = false;
+  uint32_t timerLateUpdates = 0;
+};
+StatusCache statusCache;
 
-// ================== Utility ==================
-static int parseTimeToMinutes(const String &hhmm) {
-  // Expect "HH:MM"
-  if (hhmm.length() < 4) return -1;
-  int colon = hhmm.indexOf(':');
-  if (colon < 0) return -1;
-  int hh = hhmm.substring(0, colon).toInt();
-  int mm = hhmm.substring(colon + 1).toInt();
-  if (hh < 0 || hh > 23 || mm < 0 || mm > 59) return -1;
-  return hh * 60 + mm;
-}
-
-static String htmlEscape(const String &in) {
-  String out;
-  out.reserve(in.length());
-  for (size_t i = 0; i < in.length(); i++) {
-    char c = in[i];
-    switch (c) {
-      case '&': out += "&amp;"; break;
-      case '<': out += "&lt;"; break;
-      case '>': out += "&gt;"; break;
-      case '"': out += "&quot;"; break;
-      case '\'': out += "&#39;"; break;
-      default: out += c; break;
-    }
-  }
-  return out;
+static void statusPollChanges() {
+  uint32_t ip = WiFi.isConnected() ? (uint32_t)WiFi.localIP() : 0;
+  bool mqttUp = mqttClient.connected();
+  if (ip != statusCache.ip || mqttUp != statusCache.mqttUp || timers.lateUpdates() != statusCache.timerLateUpdates) {
+    statusCache.ip = ip;
+    statusCache.mqttUp = mqttUp;
+    statusCache.timerLateUpdates = timers.lateUpdates();
+    statusChanged();
+  }
 }
 
-void saveConfig() {
-  if (!LittleFS.begin()) {
-    LittleFS.format();
-    LittleFS.begin();
+static void statusRender() {
+  size_t cap = 1024 + JSON_OBJECT_SIZE(EVT_COUNT) + JSON_OBJECT_SIZE(8) + JSON_OBJECT_SIZE(6) +
+               JSON_OBJECT_SIZE(14) + JSON_ARRAY_SIZE(MAX_GROUPS) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(6) +
+               JSON_OBJECT_SIZE(7) + OTA_URL_SIZE + OTA_MD5_SIZE + sizeof(ota.lastError) +
+               JSON_ARRAY_SIZE(config.channelCount);
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    const ChannelConfig &c = config.channels[i];
+    cap += JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(c.scheduleCount) +
+           c.scheduleCount * JSON_STRING_SIZE(5) +
+           JSON_ARRAY_SIZE(c.scheduleRules.size()) + c.scheduleRules.size() * SCHEDULE_RULE_JSON_CAPACITY;
   }
-  DynamicJsonDocument doc(8192);
-  doc["triggerPin"] = config.triggerPin;
-  doc["triggerActiveHigh"] = config.triggerActiveHigh;
-  doc["triggerDurationMs"] = config.triggerDurationMs;
-
-  JsonObject mqtt = doc.createNestedObject("mqtt");
-  mqtt["host"] = config.mqttHost;
-  mqtt["port"] = config.mqttPort;
-  mqtt["user"] = config.mqttUser;
-  mqtt["pass"] = config.mqttPass;
-  mqtt["topic"] = config.mqttTopic;
-
-  doc["intervalSeconds"] = config.intervalSeconds;
-  doc["intervalEnabled"] = config.intervalEnabled;
-
-  doc["timezoneOffsetMinutes"] = config.timezoneOffsetMinutes;
-
-  JsonArray sched = doc.createNestedArray("scheduleTimes");
-  for (auto &t : config.scheduleTimes) {
-    sched.add(t);
+  DynamicJsonDocument doc(cap);
+  doc["ip"] = WiFi.isConnected() ? WiFi.localIP().toString() : "Not connected";
+  doc["mqttConnected"] = mqttClient.connected();
+  JsonObject mqttLinkObj = doc.createNestedObject("mqttLink");
+  mqttLinkObj["state"] = MQTT_LINK_STATE_NAMES[mqttLink.state];
+  mqttLinkObj["failures"] = mqttLink.failures;
+  mqttLinkObj["attempts"] = mqttLink.attempts;
+  mqttLinkObj["connects"] = mqttLink.connects;
+  mqttLinkObj["statePublishes"] = mqttState.publishes;
+  JsonArray channels = doc.createNestedArray("channels");
+  for (uint8_t i = 0; i < config.channelCount; i++) {
+    const ChannelConfig &c = config.channels[i];
+    const ChannelPulse &p = pulse.ch[i];
+    JsonObject ch = channels.createNestedObject();
+    ch["pin"] = c.pin;
+    ch["activeHigh"] = c.activeHigh;
+    ch["durationMs"] = c.durationMs;
+    ch["intervalEnabled"] = c.intervalEnabled;
+    ch["intervalSeconds"] = c.intervalSeconds;
+    ch["active"] = (pulse.activeMask & (1 << i)) != 0;
+    JsonArray sched = ch.createNestedArray("scheduleTimes");
+    for (uint8_t n = 0; n < c.scheduleCount; n++) {
+      char buf[6];
+      formatMinutes(c.scheduleMinutes[n], buf);
+      sched.add(buf); // char array: copied
+    }
+    JsonArray rules = ch.createNestedArray("scheduleRules");
+    for (auto &r : c.scheduleRules) scheduleRuleToJson(r, rules.createNestedObject());
+    JsonObject pulseObj = ch.createNestedObject("pulse");
+    pulseObj["lastWidthUs"] = p.lastWidthUs;
+    pulseObj["lastRequestedMs"] = p.lastRequestedMs;
+    pulseObj["maxErrorUs"] = p.maxErrorUs;
+    pulseObj["overruns"] = p.overruns;
+    pulseObj["count"] = p.pulses;
   }
-
-  File f = LittleFS.open("/config.json", "w");
-  if (!f) {
-    Serial.println("Failed to open config file for writing");
-    return;
+  JsonObject queueObj = doc.createNestedObject("triggerQueue");
+  queueObj["policy"] = TRIGGER_POLICY_NAMES[config.triggerPolicy];
+  queueObj["depth"] = triggerQueueDepth();
+  queueObj["maxDepth"] = triggerQueue.maxDepth;
+  queueObj["requests"] = triggerQueue.requests;
+  queueObj["dropped"] = triggerQueue.dropped;
+  queueObj["coalesced"] = triggerQueue.coalesced;
+  queueObj["overflows"] = triggerQueue.overflows;
+  queueObj["maxWaitMs"] = triggerQueue.maxWaitMs;
+  doc["timezoneOffsetMinutes"] = config.timezoneOffsetMinutes;
+  doc["timezone"] = (const char *)config.timezone;
+  doc["utcOffsetMinutes"] = tzOffsetMinutes(tzTable, systemClock.epochMs());
+  JsonObject timeObj = doc.createNestedObject("time");
+  timeObj["synced"] = timeSync.valid;
+  timeObj["lastSyncEpochMs"] = timeSync.lastSyncEpochMs;
+  timeObj["lastStepMs"] = timeSync.lastStepMs;
+  timeObj["driftPpm"] = timeSync.driftPpm;
+  timeObj["syncs"] = timeSync.syncs;
+  timeObj["missed"] = timeSync.missed;
+  JsonObject groupObj = doc.createNestedObject("group");
+  JsonArray groupIds = groupObj.createNestedArray("ids");
+  for (uint16_t g : config.groups) groupIds.add(g);
+  groupObj["joined"] = groupLink.joinedIp != 0;
+  groupObj["pending"] = groupLink.pendingCount;
+  groupObj["sent"] = groupLink.sent;
+  groupObj["received"] = groupLink.received;
+  groupObj["fired"] = groupLink.fired;
+  groupObj["duplicates"] = groupLink.duplicates;
+  groupObj["stale"] = groupLink.stale;
+  groupObj["unsynced"] = groupLink.unsynced;
+  groupObj["overflows"] = groupLink.overflows;
+  groupObj["leader"] = config.groupLeader;
+  groupObj["followingId"] = groupLink.beacon.leader;
+  groupObj["lastStartErrorUs"] = groupLink.lastStartErrorUs;
+  groupObj["maxStartErrorUs"] = groupLink.maxStartErrorUs;
+  JsonObject schedObj = doc.createNestedObject("schedule");
+  schedObj["catchUpSec"] = config.scheduleCatchUpSec;
+  schedObj["caughtUp"] = scheduleCaughtUp;
+  doc["powerMode"] = config.powerMode;
+  doc["listenInterval"] = config.listenInterval;
+  doc["deepSleepMinGapSec"] = config.deepSleepMinGapSec;
+  doc["wifiFastReconnect"] = config.wifiFastReconnect;
+  JsonObject heapWd = doc.createNestedObject("heapWatchdog");
+  heapWd["minBlock"] = config.heapMinBlock;
+  heapWd["maxFragmentation"] = config.heapMaxFrag;
+  heapWd["restartPending"] = heapWatch.restartPending;
+  heapWd["cause"] = heapWatch.restartPending ? heapWatch.restartCause : "";
+  heapWd["restarts"] = rtcState.heapRestarts;
+  heapWd["lastBootPlanned"] = rtcPlannedRestart;
+  JsonObject otaObj = doc.createNestedObject("ota");
+  otaObj["safeMode"] = safeMode;
+  otaObj["bootFailures"] = rtcState.bootFailures;
+  otaObj["sketchMd5"] = ESP.getSketchMD5();
+  otaObj["pullPending"] = ota.pullPending;
+  otaObj["pullUrl"] = ota.pullPending ? ota.pullUrl : "";
+  otaObj["failures"] = ota.failures;
+  otaObj["lastError"] = ota.lastError;
+  JsonObject boot = doc.createNestedObject("bootMs");
+  for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) boot[BOOT_PHASE_NAMES[i]] = bootPhaseMs[i];
+  boot["wifiFastPath"] = bootWifiFastPath;
+  JsonObject late = doc.createNestedObject("timerMaxLateMs");
+  for (uint8_t i = 0; i < EVT_COUNT; i++) late[TIMER_EVENT_NAMES[i]] = timers.maxLateMs(i);
+  size_t len = measureJson(doc);
+  if (len + 1 > statusCache.cap) {
+    size_t grown = (len + 256) & ~(size_t)255; // headroom for counters growing a digit
+    char *buf = (char *)realloc(statusCache.buf, grown);
+    if (!buf) {
+      statusCache.valid = false;
+      return;
+    }
+    statusCache.buf = buf;
+    statusCache.cap = grown;
   }
-  serializeJsonPretty(doc, f);
-  f.close();
-  Serial.println("Config saved");
+  statusCache.len = serializeJson(doc, statusCache.buf, statusCache.cap);
+  statusCache.generation = statusGeneration;
+  statusCache.valid = true;
 }
 
-void loadConfig() {
-  if (!LittleFS.begin()) {
-    LittleFS.format();
-    LittleFS.begin();
-  }
-  if (!LittleFS.exists("/config.json")) {
-    Serial.println("No config.json, using defaults");
-    return;
-  }
-  File f = LittleFS.open("/config.json", "r");
-  if (!f) {
-    Serial.println("Failed to open config.json");
+void handleStatusJson() {
+  statusPollChanges();
+  char etag[12];
+  snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)statusGeneration);
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", "no-cache");
+  if (server.header("If-None-Match") == etag) {
+    server.send(304);
     return;
   }
-  DynamicJsonDocument doc(8192);
-  auto err = deserializeJson(doc, f);
-  f.close();
-  if (err) {
-    Serial.printf("Failed to parse config.json: %s\n", err.c_str());
+  if (!statusCache.valid || statusCache.generation != statusGeneration) statusRender();
+  if (!statusCache.valid) {
+    server.send(503, "text/plain", "Out of memory");
     return;
   }
+  server.send(200, "application/json", statusCache.buf, statusCache.len);
+}
 
-  config.triggerPin = doc["triggerPin"] | config.triggerPin;
-  config.triggerActiveHigh = doc["triggerActiveHigh"] | config.triggerActiveHigh;
-  config.triggerDurationMs = doc["triggerDurationMs"] | config.triggerDurationMs;
-
-  if (doc.containsKey("mqtt")) {
-    JsonObject mqtt = doc["mqtt"];
-    config.mqttHost = String((const char*) (mqtt["host"] | config.mqttHost.c_str()));
-    config.mqttPort = mqtt["port"] | config.mqttPort;
-    config.mqttUser = String((const char*) (mqtt["user"] | config.mqttUser.c_str()));
-    config.mqttPass = String((const char*) (mqtt["pass"] | config.mqttPass.c_str()));
-    config.mqttTopic = String((const char*) (mqtt["topic"] | config.mqttTopic.c_str()));
-  }
-
-  config.intervalSeconds = doc["intervalSeconds"] | config.intervalSeconds;
-  config.intervalEnabled = doc["intervalEnabled"] | config.intervalEnabled;
+// GET /api/events: a Server-Sent Events stream for the dashboard. Events:
+//   pulse     {"ch":n,"active":bool,"pulses":n}
+//   interval  {"ch":n,"enabled":bool,"seconds":n,"nextMs":n|null}
+//   link      {"wifi":bool,"ip":"a.b.c.d","mqtt":bool,"mqttState":"up"}
+// A new stream starts with the current value of each. Streams hold their
+// socket after the handler returns; a client that cannot take an event
+// without blocking is dropped and reconnects by itself.
+static const uint8_t SSE_MAX_CLIENTS = 4;
+static const uint32_t SSE_PING_MS = 15000;
 
-  config.timezoneOffsetMinutes = doc["timezoneOffsetMinutes"] | config.timezoneOffsetMinutes;
+struct SseHub {
+  WiFiClient clients[SSE_MAX_CLIENTS];
+  uint8_t used = 0; // bit per slot
+  uint32_t ip = 0; // link as last sent
+  uint8_t mqttState = MQTT_LINK_IDLE;
+};
+SseHub sse;
 
-  config.scheduleTimes.clear();
-  if (doc.containsKey("scheduleTimes") && doc["scheduleTimes"].is<JsonArray>()) {
-    for (JsonVariant v : doc["scheduleTimes"].as<JsonArray>()) {
-      String t = v.as<String>();
-      if (parseTimeToMinutes(t) >= 0) {
-        config.scheduleTimes.push_back(t);
-      }
-    }
+static void sseWrite(uint8_t slot, const char *buf, size_t len) {
+  WiFiClient &client = sse.clients[slot];
+  if (!client.connected() || (size_t)client.availableForWrite() < len || client.write(buf, len) != len) {
+    client.stop();
+    sse.used &= ~(1 << slot);
   }
-
-  Serial.println("Config loaded");
 }
 
-void applyTriggerPin() {
-  pinMode(config.triggerPin, OUTPUT);
-  // Set the pin to inactive level initially
-  if (config.triggerActiveHigh) {
-    digitalWrite(config.triggerPin, LOW);
-  } else {
-    digitalWrite(config.triggerPin, HIGH);
+// Sends one event to one slot, or to every stream when slot is SSE_MAX_CLIENTS
+static void sseSend(uint8_t slot, const char *event, const char *data) {
+  char buf[192];
+  int len = snprintf(buf, sizeof(buf), "event: %s\ndata: %s\n\n", event, data);
+  if (len <= 0 || (size_t)len >= sizeof(buf)) return;
+  for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if ((slot == i || slot == SSE_MAX_CLIENTS) && (sse.used & (1 << i))) sseWrite(i, buf, len);
   }
 }
 
-// Non-blocking pulse trigger
-void triggerPulse() {
-  if (triggerInProgress) return;
-  triggerInProgress = true;
-  lastTriggerAt = millis();
-  // drive active
-  digitalWrite(config.triggerPin, config.triggerActiveHigh ? HIGH : LOW);
-  Serial.println("Trigger: ON");
+static void sseSendPulse(uint8_t slot, uint8_t ch) {
+  char data[64];
+  snprintf(data, sizeof(data), "{\"ch\":%u,\"active\":%s,\"pulses\":%lu}", ch,
+           (pulse.activeMask & (1 << ch)) ? "true" : "false", (unsigned long)pulse.ch[ch].pulses);
+  sseSend(slot, "pulse", data);
 }
 
-// Calculate local time with timezone offset
-void getLocalTimeBrokenDown(struct tm &tm_local, time_t &epoch_local) {
-  time_t now_utc = time(nullptr);
-  epoch_local = now_utc + (time_t)(config.timezoneOffsetMinutes * 60);
-  gmtime_r(&epoch_local, &tm_local); // gmtime on adjusted epoch gives local broken-down time
+static void sseSendInterval(uint8_t slot, uint8_t ch) {
+  const ChannelConfig &c = config.channels[ch];
+  uint8_t evt = EVT_INTERVAL + ch;
+  char next[12] = "null";
+  if (timers.armed(evt)) {
+    int32_t left = (int32_t)(timers.deadline(evt) - millis());
+    snprintf(next, sizeof(next), "%ld", (long)(left < 0 ? 0 : left));
+  }
+  char data[96];
+  snprintf(data, sizeof(data), "{\"ch\":%u,\"enabled\":%s,\"seconds\":%lu,\"nextMs\":%s}", ch,
+           c.intervalEnabled ? "true" : "false", (unsigned long)c.intervalSeconds, next);
+  sseSend(slot, "interval", data);
 }
 
-void resetScheduleFlagsForNewDay(const tm &tm_local) {
-  // Reset flags daily
-  scheduleFiredToday.assign(config.scheduleTimes.size(), false);
-  lastDayOfYear = tm_local.tm_yday;
+static void sseSendLink(uint8_t slot) {
+  IPAddress ip(sse.ip);
+  char data[96];
+  snprintf(data, sizeof(data), "{\"wifi\":%s,\"ip\":\"%u.%u.%u.%u\",\"mqtt\":%s,\"mqttState\":\"%s\"}",
+           sse.ip ? "true" : "false", ip[0], ip[1], ip[2], ip[3],
+           sse.mqttState == MQTT_LINK_UP ? "true" : "false", MQTT_LINK_STATE_NAMES[sse.mqttState]);
+  sseSend(slot, "link", data);
 }
 
-// MQTT
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  String msg;
-  msg.reserve(length);
-  for (unsigned int i = 0; i < length; i++) msg += (char)payload[i];
-  msg.trim();
-  Serial.printf("MQTT msg on %s: '%s'\n", topic, msg.c_str());
-
-  // Simple protocol
-  // "TRIGGER" or "1" -> trigger
-  // "INTERVAL:x" -> set interval seconds and enable
-  // "STOP_INTERVAL" -> disable interval
-  // "ADD_SCHEDULE:HH:MM"
-  // "CLEAR_SCHEDULE"
-  if (msg.equalsIgnoreCase("TRIGGER") || msg == "1") {
-    triggerPulse();
-  } else if (msg.startsWith("INTERVAL:")) {
-    uint32_t s = msg.substring(String("INTERVAL:").length()).toInt();
-    if (s > 0) {
-      config.intervalSeconds = s;
-      config.intervalEnabled = true;
-      saveConfig();
-      nextIntervalAt = millis() + (config.intervalSeconds * 1000UL);
-    }
-  } else if (msg.equalsIgnoreCase("STOP_INTERVAL")) {
-    config.intervalEnabled = false;
-    saveConfig();
-  } else if (msg.startsWith("ADD_SCHEDULE:")) {
-    String t = msg.substring(String("ADD_SCHEDULE:").length());
-    t.trim();
-    if (parseTimeToMinutes(t) >= 0) {
-      config.scheduleTimes.push_back(t);
-      saveConfig();
-      scheduleFiredToday.assign(config.scheduleTimes.size(), false);
-    }
-  } else if (msg.equalsIgnoreCase("CLEAR_SCHEDULE")) {
-    config.scheduleTimes.clear();
-    saveConfig();
-    scheduleFiredToday.assign(0, false);
+void handleEvents() {
+  uint8_t slot = 0;
+  while (slot < SSE_MAX_CLIENTS && (sse.used & (1 << slot)) && sse.clients[slot].connected()) slot++;
+  if (slot == SSE_MAX_CLIENTS) {
+    server.send(503, "text/plain", "Too many event streams");
+    return;
   }
+  WiFiClient &client = sse.clients[slot];
+  client.stop(); // a stream that went away unnoticed
+  client = server.client();
+  client.setNoDelay(true);
+  client.print(F("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                 "Connection: keep-alive\r\n\r\nretry: 3000\n\n"));
+  sse.used |= 1 << slot;
+  sse.ip = WiFi.isConnected() ? (uint32_t)WiFi.localIP() : 0;
+  sse.mqttState = mqttLink.state;
+  sseSendLink(slot);
+  for (uint8_t ch = 0; ch < config.channelCount; ch++) {
+    sseSendPulse(slot, ch);
+    sseSendInterval(slot, ch);
+  }
+  if (!timers.armed(EVT_SSE_PING)) timers.armIn(EVT_SSE_PING, SSE_PING_MS);
 }
 
-void connectMqtt() {
-  if (config.mqttHost.length() == 0) return;
-  mqttClient.setServer(config.mqttHost.c_str(), config.mqttPort);
-  mqttClient.setCallback(mqttCallback);
-
-  String clientId = "diffuser-" + String(ESP.getChipId(), HEX);
-  bool ok;
-  if (config.mqttUser.length() > 0) {
-    ok = mqttClient.connect(clientId.c_str(), config.mqttUser.c_str(), config.mqttPass.c_str());
-  } else {
-    ok = mqttClient.connect(clientId.c_str());
+// Called every loop pass, after pulseCommit()
+void sseService() {
+  if (!sse.used) {
+    ssePending = SsePending();
+    return;
   }
-  if (ok) {
-    Serial.println("MQTT connected");
-    mqttClient.subscribe(config.mqttTopic.c_str());
-    // Publish online status
-    String statusTopic = config.mqttTopic + "/status";
-    mqttClient.publish(statusTopic.c_str(), "online", true);
-  } else {
-    Serial.printf("MQTT connect failed, rc=%d\n", mqttClient.state());
+  uint32_t ip = WiFi.isConnected() ? (uint32_t)WiFi.localIP() : 0;
+  if (ip != sse.ip || mqttLink.state != sse.mqttState) {
+    sse.ip = ip;
+    sse.mqttState = mqttLink.state;
+    sseSendLink(SSE_MAX_CLIENTS);
+  }
+  SsePending p = ssePending;
+  ssePending = SsePending();
+  for (uint8_t ch = 0; ch < config.channelCount; ch++) {
+    if (p.pulseMask & (1 << ch)) sseSendPulse(SSE_MAX_CLIENTS, ch);
+    if (p.intervalMask & (1 << ch)) sseSendInterval(SSE_MAX_CLIENTS, ch);
   }
 }
 
-// ================== Web UI ==================
-String renderHeader(const String &title) {
-  String out;
-  out += "<!DOCTYPE html><html><head><meta charset='utf-8'>";
-  out += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-  out += "<title>" + htmlEscape(title) + "</title>";
-  out += "<style>body{font-family:sans-serif;max-width:720px;margin:20px auto;padding:0 12px}input,select,button{font-size:1rem;padding:6px}form{margin:10px 0}section{border:1px solid #ddd;border-radius:8px;padding:12px;margin:12px 0}h1,h2{margin:8px 0}code{background:#f5f5f5;padding:2px 4px;border-radius:4px}</style>";
-  out += "</head><body>";
-  out += "<header><h1>Diffuser Controller</h1><nav><a href='/'>Dashboard</a> | <a href='/config'>Config</a> | <a href='/api/wifi-portal'>WiFi Setup</a></nav><hr/></header>";
-  return out;
-}
-String renderFooter() {
-  String out;
-  out += "<footer><hr/><small>ESP8266 " + String(ESP.getChipId(), HEX) + "</small></footer>";
-  out += "</body></html>";
-  return out;
-}
-
-String renderIndexPage() {
-  // Status
-  String ip = WiFi.isConnected() ? WiFi.localIP().toString() : String("Not connected");
-  String out = renderHeader("Dashboard");
-  out += "<section><h2>Status</h2>";
-  out += "<div>WiFi: " + htmlEscape(ip) + "</div>";
-  out += "<div>MQTT: " + String(mqttClient.connected() ? "Connected" : "Disconnected") + "</div>";
-  out += "<div>Trigger Pin: GPIO" + String(config.triggerPin) + " (" + String(config.triggerActiveHigh ? "Active HIGH" : "Active LOW") + ")</div>";
-  out += "<div>Trigger Duration: " + String(config.triggerDurationMs) + " ms</div>";
-  out += "</section>";
+// EVT_SSE_PING: a comment line keeps proxies from closing idle streams and
+// finds clients that went away
+void onSsePingTimer() {
+  static const char ping[] = ": ping\n\n";
+  for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (sse.used & (1 << i)) sseWrite(i, ping, sizeof(ping) - 1);
+  }
+  if (sse.used) timers.armIn(EVT_SSE_PING, SSE_PING_MS);
+}
 
-  // Manual trigger
-  out += "<section><h2>Manual Trigger</h2>";
-  out += "<form method='POST' action='/api/trigger'><button type='submit'>Trigger Now</button></form>";
-  out += "</section>";
+// The fields applyConfigChanges compares, taken before a config write; the
+// MQTT settings only as a CRC, so the snapshot stays small
+struct ConfigApplyState {
+  uint8_t channelCount;
+  int pins[MAX_CHANNELS];
+  bool activeHigh[MAX_CHANNELS];
+  uint8_t powerMode;
+  uint16_t listenInterval;
+  uint32_t mqttCrc;
+};
 
-  // Interval
-  out += "<section><h2>Interval Trigger</h2>";
-  out += "<form method='POST' action='/api/interval'>";
-  out += "<label>Every (seconds): <input type='number' name='seconds' min='1' value='" + String(config.intervalSeconds) + "'></label><br/>";
-  out += "<label><input type='checkbox' name='enabled' " + String(config.intervalEnabled ? "checked" : "") + "> Enabled</label><br/>";
-  out += "<button type='submit'>Save</button>";
-  out += "</form>";
-  out += "</section>";
+static uint32_t mqttSettingsCrc(const AppConfig &cfg) {
+  uint32_t crc = 0xFFFFFFFF;
+  crc = crc32Update(crc, cfg.mqttHost, strlen(cfg.mqttHost) + 1);
+  crc = crc32Update(crc, &cfg.mqttPort, sizeof(cfg.mqttPort));
+  crc = crc32Update(crc, cfg.mqttUser, strlen(cfg.mqttUser) + 1);
+  crc = crc32Update(crc, cfg.mqttPass, strlen(cfg.mqttPass) + 1);
+  crc = crc32Update(crc, cfg.mqttTopic, strlen(cfg.mqttTopic) + 1);
+  return ~crc;
+}
 
-  // Schedule
-  out += "<section><h2>Daily Schedule</h2>";
-  out += "<div>Times:</div><ul>";
-  for (size_t i = 0; i < config.scheduleTimes.size(); i++) {
-    out += "<li>" + htmlEscape(config.scheduleTimes[i]) + " ";
-    out += "<form style='display:inline' method='POST' action='/api/schedule/remove'><input type='hidden' name='idx' value='" + String(i) + "'><button type='submit'>Remove</button></form>";
-    out += "</li>";
+static void configApplyState(ConfigApplyState &st) {
+  st.channelCount = config.channelCount;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    st.pins[i] = config.channels[i].pin;
+    st.activeHigh[i] = config.channels[i].activeHigh;
   }
-  out += "</ul>";
-  out += "<form method='POST' action='/api/schedule/add'>";
-  out += "<label>Add HH:MM: <input type='time' name='time' required></label> ";
-  out += "<button type='submit'>Add</button>";
-  out += "</form>";
-  out += "</section>";
-
-  out += renderFooter();
-  return out;
+  st.powerMode = config.powerMode;
+  st.listenInterval = config.listenInterval;
+  st.mqttCrc = mqttSettingsCrc(config);
 }
 
-String renderConfigPage() {
-  String out = renderHeader("Config");
-
-  out += "<section><h2>Trigger</h2>";
-  out += "<form method='POST' action='/api/config'>";
-  // Pin select: common NodeMCU pins
-  struct PinOption { const char* label; int gpio; } options[] = {
-    {"D0 (GPIO16)", 16}, {"D1 (GPIO5)", 5}, {"D2 (GPIO4)", 4}, {"D3 (GPIO0)", 0},
-    {"D4 (GPIO2)", 2}, {"D5 (GPIO14)", 14}, {"D6 (GPIO12)", 12}, {"D7 (GPIO13)", 13},
-    {"D8 (GPIO15)", 15}
-  };
-  out += "<label>Trigger Pin: <select name='triggerPin'>";
-  for (auto &opt: options) {
-    out += "<option value='" + String(opt.gpio) + "'" + String(config.triggerPin == opt.gpio ? " selected" : "") + ">";
-    out += htmlEscape(opt.label);
-    out += "</option>";
-  }
-  out += "</select></label><br/>";
-  out += "<label>Active Level: <select name='activeLevel'>";
-  out += "<option value='HIGH'" + String(config.triggerActiveHigh ? " selected" : "") + ">HIGH</option>";
-  out += "<option value='LOW'" + String(!config.triggerActiveHigh ? " selected" : "") + ">LOW</option>";
-  out += "</select></label><br/>";
-  out += "<label>Pulse Duration (ms): <input type='number' min='1' max='600000' name='pulseMs' value='" + String(config.triggerDurationMs) + "'></label>";
-  out += "<br/><button type='submit'>Save</button>";
-  out += "</form>";
-  out += "</section>";
-
-  out += "<section><h2>MQTT</h2>";
-  out += "<form method='POST' action='/api/config'>";
-  out += "<label>Host: <input type='text' name='mqttHost' value='" + htmlEscape(config.mqttHost) + "'></label><br/>";
-  out += "<label>Port: <input type='number' name='mqttPort' min='1' max='65535' value='" + String(config.mqttPort) + "'></label><br/>";
-  out += "<label>Username: <input type='text' name='mqttUser' value='" + htmlEscape(config.mqttUser) + "'></label><br/>";
-  out += "<label>Password: <input type='password' name='mqttPass' value='" + htmlEscape(config.mqttPass) + "'></label><br/>";
-  out += "<label>Topic (subscribe): <input type='text' name='mqttTopic' value='" + htmlEscape(config.mqttTopic) + "'></label><br/>";
-  out += "<button type='submit'>Save</button>";
-  out += "</form>";
-  out += "</section>";
-
-  out += "<section><h2>Time</h2>";
-  out += "<form method='POST' action='/api/config'>";
-  out += "<label>Timezone offset (minutes from UTC): <input type='number' name='tz' min='-720' max='840' value='" + String(config.timezoneOffsetMinutes) + "'></label><br/>";
-  out += "<button type='submit'>Save</button>";
-  out += "</form>";
-  out += "</section>";
-
-  out += renderFooter();
-  return out;
+// Re-apply runtime state after the whole config was replaced
+void applyConfigChanges(const ConfigApplyState &prev) {
+  if (safeMode) {
+    markConfigDirty(); // takes effect after the next boot
+    return;
+  }
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    bool wasActive = i < prev.channelCount;
+    bool isActive = i < config.channelCount;
+    const ChannelConfig &b = config.channels[i];
+    bool pinChanged = prev.pins[i] != b.pin || prev.activeHigh[i] != b.activeHigh;
+    if (wasActive && (!isActive || pinChanged)) {
+      pulseAbort(i); // ends on the pin it started on
+    }
+    if (isActive && (!wasActive || pinChanged)) {
+      applyChannelPin(i);
+    }
+  }
+  pulseService();
+  if (prev.powerMode != config.powerMode || prev.listenInterval != config.listenInterval) {
+    applyPowerMode();
+  }
+  if (prev.mqttCrc != mqttSettingsCrc(config)) mqttRestart();
+  applyTimezone();
+  compileSchedule();
+  armIntervals();
+  armMetricsPublish();
+  markConfigDirty();
 }
 
-void handleRoot() {
-  server.send(200, "text/html; charset=utf-8", renderIndexPage());
+// Export the full config as JSON (the on-flash format is binary)
+void handleConfigExport() {
+  DynamicJsonDocument doc(configJsonCapacity(config));
+  configToJson(config, doc);
+  ChunkedResponse out(server);
+  out.begin(200, "application/json");
+  serializeJson(doc, out);
+  out.end();
 }
 
-void handleConfigPage() {
-  server.send(200, "text/html; charset=utf-8", renderConfigPage());
-}
+// Config bodies are collected by the raw callback below into one static
+// buffer, bounded by CONFIG_BODY_MAX (the largest export is around 6 KB),
+// and parsed in place. ArduinoJson cannot parse chunk by chunk as they
+// arrive, so the body is held once, in memory set aside at build time rather
+// than grown on the heap per request.
+static const size_t CONFIG_BODY_MAX = 8192;
 
-void handleTriggerPost() {
-  triggerPulse();
-  server.sendHeader("Location", "/");
-  server.send(303);
+struct ConfigBody {
+  char buf[CONFIG_BODY_MAX + 1];
+  size_t len = 0;
+  bool present = false;
+  bool tooLarge = false;
+};
+ConfigBody configBody;
+
+static void configBodyReset() {
+  configBody.len = 0;
+  configBody.present = false;
+  configBody.tooLarge = false;
 }
 
-void handleIntervalPost() {
-  if (!server.hasArg("seconds")) {
-    server.send(400, "text/plain", "Missing seconds");
-    return;
-  }
-  uint32_t s = server.arg("seconds").toInt();
-  bool en = server.hasArg("enabled");
-  config.intervalSeconds = s;
-  config.intervalEnabled = en && s > 0;
-  saveConfig();
-  if (config.intervalEnabled) {
-    nextIntervalAt = millis() + (config.intervalSeconds * 1000UL);
+void handleConfigBodyRaw() {
+  HTTPRaw &raw = server.raw();
+  switch (raw.status) {
+    case RAW_START:
+      configBodyReset();
+      break;
+    case RAW_WRITE: {
+      if (configBody.tooLarge) break;
+      size_t len = configBody.len + raw.currentSize;
+      if (len > CONFIG_BODY_MAX) {
+        configBody.tooLarge = true;
+        break;
+      }
+      memcpy(configBody.buf + configBody.len, raw.buf, raw.currentSize);
+      configBody.buf[len] = '\0';
+      configBody.len = len;
+      configBody.present = true;
+      break;
+    }
+    case RAW_END:
+      break;
+    case RAW_ABORTED:
+      configBodyReset();
+      break;
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
 }
 
-void handleScheduleAdd() {
-  if (!server.hasArg("time")) {
-    server.send(400, "text/plain", "Missing time");
+// PUT /api/config replaces the config (absent keys take their defaults,
+// except the passwords, which the export leaves out and which are kept),
+// PATCH changes only the keys present; POST /api/config/import is the older
+// name for PATCH. The body uses the export format; the whole document is
+// validated before anything changes, it is saved once, and the resulting
+// config is returned.
+void handleConfigWrite() {
+  if (configBody.tooLarge) {
+    configBodyReset();
+    server.send(413, "text/plain", "Config JSON too large");
     return;
   }
-  String t = server.arg("time");
-  if (parseTimeToMinutes(t) < 0) {
-    server.send(400, "text/plain", "Invalid time format, expected HH:MM");
+  if (!configBody.present) {
+    server.send(400, "text/plain", "Missing JSON body");
     return;
   }
-  config.scheduleTimes.push_back(t);
-  saveConfig();
-  scheduleFiredToday.assign(config.scheduleTimes.size(), false);
-  server.sendHeader("Location", "/");
-  server.send(303);
-}
-
-void handleScheduleRemove() {
-  if (!server.hasArg("idx")) {
-    server.send(400, "text/plain", "Missing idx");
+  StaticJsonDocument<CONFIG_JSON_FILTER_CAPACITY> filter;
+  configJsonFilter(filter);
+  DynamicJsonDocument doc(configJsonInPlaceCapacity(configBody.len));
+  auto err = deserializeJson(doc, configBody.buf, configBody.len, DeserializationOption::Filter(filter));
+  if (err) {
+    configBodyReset();
+    server.send(400, "text/plain", String("Invalid JSON: ") + err.c_str());
     return;
   }
-  int idx = server.arg("idx").toInt();
-  if (idx < 0 || (size_t)idx >= config.scheduleTimes.size()) {
-    server.send(400, "text/plain", "Invalid idx");
+  char msg[64];
+  if (!configJsonValid(doc, msg, sizeof(msg))) {
+    configBodyReset();
+    server.send(400, "text/plain", msg);
     return;
   }
-  config.scheduleTimes.erase(config.scheduleTimes.begin() + idx);
-  saveConfig();
-  scheduleFiredToday.assign(config.scheduleTimes.size(), false);
-  server.sendHeader("Location", "/");
-  server.send(303);
+  ConfigApplyState prev;
+  configApplyState(prev);
+  if (server.method() == HTTP_PUT) {
+    char otaPassword[MQTT_CRED_SIZE], mqttPass[MQTT_CRED_SIZE];
+    copyString(otaPassword, config.otaPassword);
+    copyString(mqttPass, config.mqttPass);
+    resetConfig(config);
+    copyString(config.otaPassword, otaPassword);
+    copyString(config.mqttPass, mqttPass);
+  }
+  configFromJson(doc, config);
+  doc.clear();
+  configBodyReset(); // doc's strings pointed into it
+  applyConfigChanges(prev);
+  handleConfigExport();
 }
 
-void handleConfigPost() {
-  bool needApplyPin = false;
-  bool needReconnectMqtt = false;
-
-  if (server.hasArg("triggerPin")) {
-    int newPin = server.arg("triggerPin").toInt();
-    if (newPin != config.triggerPin) {
-      config.triggerPin = newPin;
-      needApplyPin = true;
+// POST /api/update takes the image as a raw body (Content-Type
+// application/octet-stream), so it reaches flash in network-sized pieces
+// and is never held in RAM. An X-MD5 header is checked against the whole
+// image. HTTP basic auth as OTA_HTTP_USER with the OTA password is
+// required, and without a password set the upload is refused with 403.
+// Refused with 503 outside an idle window.
+void handleUpdateBodyRaw() {
+  HTTPRaw &raw = server.raw();
+  switch (raw.status) {
+    case RAW_START: {
+      ota.httpImageOk = false;
+      ota.httpStatus = 0;
+      if (!config.otaPassword[0]) {
+        ota.httpStatus = 403;
+        break;
+      }
+      if (!server.authenticate(OTA_HTTP_USER, config.otaPassword)) {
+        ota.httpStatus = 401;
+        break;
+      }
+      if (!otaIdle()) {
+        ota.httpStatus = 503;
+        break;
+      }
+      uint32_t space = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+      const String &md5 = server.header("X-MD5");
+      if (!Update.begin(space) || (md5.length() && !Update.setMD5(md5.c_str()))) {
+        ota.httpStatus = 400;
+        otaSetError(Update.hasError() ? Update.getErrorString().c_str() : "invalid X-MD5");
+        Update.end(false);
+        break;
+      }
+      Serial.println("OTA: receiving image over HTTP");
+      break;
     }
+    case RAW_WRITE:
+      if (ota.httpStatus == 0 && Update.write(raw.buf, raw.currentSize) != raw.currentSize) {
+        ota.httpStatus = 500;
+        otaSetError(Update.getErrorString().c_str());
+      }
+      break;
+    case RAW_END:
+      if (ota.httpStatus != 0) break;
+      // true: the image is as long as the body, not the space reserved
+      ota.httpImageOk = Update.end(true);
+      if (!ota.httpImageOk) {
+        ota.httpStatus = 400;
+        otaSetError(Update.getErrorString().c_str());
+      }
+      break;
+    case RAW_ABORTED:
+      if (ota.httpStatus == 0) {
+        ota.httpStatus = 400;
+        otaSetError("upload aborted");
+      }
+      Update.end(false);
+      break;
+  }
+}
+
+void handleUpdatePost() {
+  int status = ota.httpStatus;
+  bool ok = ota.httpImageOk;
+  ota.httpStatus = 0;
+  ota.httpImageOk = false;
+  if (status == 401) {
+    server.requestAuthentication();
+    return;
   }
-  if (server.hasArg("activeLevel")) {
-    bool high = (server.arg("activeLevel") == "HIGH");
-    config.triggerActiveHigh = high;
+  if (status == 403) {
+    server.send(403, "text/plain", "Set an OTA password first");
+    return;
   }
-  if (server.hasArg("pulseMs")) {
-    long ms_in = server.arg("pulseMs").toInt();
-    if (ms_in < 1) ms_in = 1;               // enforce minimum 1 ms
-    if (ms_in > 600000) ms_in = 600000;     // clamp to 10 minutes
-    config.triggerDurationMs = (uint32_t)ms_in;
+  if (status == 503) {
+    server.sendHeader("Retry-After", "60");
+    server.send(503, "text/plain", "Busy: a pulse is running or a scheduled or interval fire is close");
+    return;
   }
-  if (server.hasArg("mqttHost")) {
-    String newHost = server.arg("mqttHost");
-    if (newHost != config.mqttHost) { config.mqttHost = newHost; needReconnectMqtt = true; }
+  if (status || !ok) {
+    server.send(status ? status : 400, "text/plain", status ? ota.lastError : "Missing image body");
+    return;
   }
-  if (server.hasArg("mqttPort")) {
-    uint16_t newPort = (uint16_t) server.arg("mqttPort").toInt();
-    if (newPort != config.mqttPort) { config.mqttPort = newPort; needReconnectMqtt = true; }
+  server.send(200, "text/plain", "Update OK, restarting");
+  server.client().stop();
+  otaRestart();
+}
+
+void handleWifiPortal() {
+  // Starts a blocking WiFiManager config portal
+  server.send(200, "text/html; charset=utf-8",
+              "<!DOCTYPE html><html><body><p>Starting WiFi config portal...</p><p><a href='/'>Back</a></p></body></html>");
+  server.client().stop(); // close client so the portal can take over
+  flushConfig();
+  eventLogFlush();
+  delay(200);
+  WiFiManager wm;
+  String apName = "Diffuser-" + String(ESP.getChipId(), HEX);
+  wm.startConfigPortal(apName.c_str());
+}
+
+// ================== Benchmark ==================
+// Built with -DDIFFUSER_BENCH (env:nodemcuv2_bench). Sending "bench" on the
+// serial console runs a fixed suite and prints one "BENCH key=value ..." line
+// per case, so results from two firmware versions can be diffed directly.
+// The config is restored (and saved) afterwards. The pulse case fires
+// channel 0.
+#ifdef DIFFUSER_BENCH
+// Print sink that only counts bytes
+class BenchSink : public Print {
+public:
+  size_t write(uint8_t) override { bytes++; return 1; }
+  size_t write(const uint8_t *, size_t size) override { bytes += size; return size; }
+  size_t bytes = 0;
+};
+
+struct BenchStats {
+  const char *name;
+  uint32_t n = 0;
+  uint32_t iters = 0;
+  uint32_t minUs = UINT32_MAX;
+  uint32_t maxUs = 0;
+  uint64_t sumUs = 0;
+  uint32_t heapBefore = 0;
+  size_t bytes = 0;
+
+  BenchStats(const char *benchName, uint32_t size) : name(benchName), n(size), heapBefore(ESP.getFreeHeap()) {}
+
+  void add(uint32_t us) {
+    iters++;
+    sumUs += us;
+    if (us < minUs) minUs = us;
+    if (us > maxUs) maxUs = us;
   }
-  if (server.hasArg("mqttUser")) {
-    String u = server.arg("mqttUser");
-    if (u != config.mqttUser) { config.mqttUser = u; needReconnectMqtt = true; }
+
+  void print() const {
+    Serial.printf("BENCH name=%s n=%u iters=%u min_us=%u avg_us=%u max_us=%u bytes=%u heap_free=%u heap_delta=%d max_block=%u\n",
+                  name, (unsigned)n, (unsigned)iters, (unsigned)(iters ? minUs : 0),
+                  (unsigned)(iters ? sumUs / iters : 0), (unsigned)maxUs, (unsigned)bytes,
+                  (unsigned)ESP.getFreeHeap(), (int)(ESP.getFreeHeap() - heapBefore),
+                  (unsigned)ESP.getMaxFreeBlockSize());
   }
-  if (server.hasArg("mqttPass")) {
-    String p = server.arg("mqttPass");
-    if (p != config.mqttPass) { config.mqttPass = p; needReconnectMqtt = true; }
+};
+
+static void benchRenderIndex(uint32_t entries) {
+  ChannelConfig &c = config.channels[0];
+  c.scheduleCount = 0;
+  for (uint32_t i = 0; i < entries; i++) {
+    scheduleAddMinute(c, (uint16_t)(((i * 37 / 60) % 24) * 60 + i * 37 % 60));
   }
-  if (server.hasArg("mqttTopic")) {
-    String t = server.arg("mqttTopic");
-    if (t != config.mqttTopic) { config.mqttTopic = t; needReconnectMqtt = true; }
+  compileSchedule();
+  BenchStats st("render_index", entries);
+  for (uint8_t i = 0; i < 20; i++) {
+    BenchSink sink;
+    uint32_t start = micros();
+    renderIndexPage(sink);
+    st.add(micros() - start);
+    st.bytes = sink.bytes;
+    yield();
   }
-  if (server.hasArg("tz")) {
-    config.timezoneOffsetMinutes = server.arg("tz").toInt();
+  st.print();
+}
+
+static void benchConfigRoundTrip() {
+  BenchStats save("config_save", config.channelCount);
+  BenchStats load("config_load", config.channelCount);
+  for (uint8_t i = 0; i < 5; i++) {
+    uint32_t start = micros();
+    saveConfig();
+    save.add(micros() - start);
+    start = micros();
+    loadConfig();
+    load.add(micros() - start);
+    yield();
   }
+  save.print();
+  load.print();
+}
 
-  saveConfig();
+static void benchMqttParse() {
+  // The last op is invalid, so the whole batch is parsed and validated but
+  // nothing is applied; batches without "id" publish no reply
+  static const char batch[] =
+      "{\"ops\":[{\"op\":\"pulse\",\"ch\":0,\"ms\":800},{\"op\":\"interval\",\"ch\":0,\"seconds\":600},"
+      "{\"op\":\"schedule\",\"ch\":0,\"times\":[\"08:00\",\"12:30\",\"18:45\"]},{\"op\":\"trigger\",\"ch\":0},"
+      "{\"op\":\"addSchedule\",\"ch\":0,\"time\":\"21:15\"},{\"op\":\"stopInterval\",\"ch\":0},{\"op\":\"bench\"}]}";
+  static const char text[] = "CH9:TRIGGER"; // rejected after parsing the prefix
+  char topic[] = "bench";
+  byte buf[sizeof(batch)];
 
-  if (needApplyPin) {
-    applyTriggerPin();
+  BenchStats js("mqtt_json_batch", 7);
+  for (uint8_t i = 0; i < 50; i++) {
+    memcpy(buf, batch, sizeof(batch)); // parsed in place, so copy every time
+    uint32_t start = micros();
+    mqttCallback(topic, buf, sizeof(batch) - 1);
+    js.add(micros() - start);
+    yield();
   }
-  if (needReconnectMqtt) {
-    if (mqttClient.connected()) mqttClient.disconnect();
-    connectMqtt();
+  js.bytes = sizeof(batch) - 1;
+  js.print();
+
+  BenchStats tx("mqtt_text", 1);
+  for (uint8_t i = 0; i < 50; i++) {
+    memcpy(buf, text, sizeof(text));
+    uint32_t start = micros();
+    mqttCallback(topic, buf, sizeof(text) - 1);
+    tx.add(micros() - start);
+    yield();
   }
+  tx.bytes = sizeof(text) - 1;
+  tx.print();
+}
 
-  server.sendHeader("Location", "/config");
-  server.send(303);
+static void benchParseTime() {
+  static const char *const inputs[] = {"08:00", "23:59", "7:05", "24:00", "12:3x", ""};
+  volatile int sink = 0;
+  BenchStats st("parse_time", sizeof(inputs) / sizeof(inputs[0]));
+  for (uint8_t r = 0; r < 20; r++) {
+    uint32_t start = micros();
+    for (uint8_t k = 0; k < 50; k++) {
+      for (uint8_t i = 0; i < st.n; i++) sink += parseTimeToMinutes(inputs[i]);
+    }
+    st.add((micros() - start) / 50); // per pass over all inputs
+    yield();
+  }
+  st.print();
 }
 
-void handleStatusJson() {
-  DynamicJsonDocument doc(1024);
-  doc["ip"] = WiFi.isConnected() ? WiFi.localIP().toString() : "Not connected";
-  doc["mqttConnected"] = mqttClient.connected();
-  doc["triggerPin"] = config.triggerPin;
-  doc["triggerActiveHigh"] = config.triggerActiveHigh;
-  doc["triggerDurationMs"] = config.triggerDurationMs;
-  doc["intervalEnabled"] = config.intervalEnabled;
-  doc["intervalSeconds"] = config.intervalSeconds;
-  doc["timezoneOffsetMinutes"] = config.timezoneOffsetMinutes;
-  JsonArray sched = doc.createNestedArray("scheduleTimes");
-  for (auto &t : config.scheduleTimes) sched.add(t);
-  String body;
-  serializeJson(doc, body);
-  server.send(200, "application/json", body);
+// Pulse width while the loop is busy rendering pages and JSON, as a stand-in
+// for HTTP load
+static void benchPulseUnderLoad() {
+  if (pulseBusy() || (pulse.endedMask & 1)) {
+    Serial.println("BENCH name=pulse_load skipped=busy");
+    return;
+  }
+  static const uint32_t PULSE_MS = 100;
+  BenchStats st("pulse_load", PULSE_MS);
+  uint32_t maxErr = 0;
+  int64_t sumErr = 0;
+  uint32_t renders = 0;
+  for (uint8_t i = 0; i < 10; i++) {
+    pulseRequest(0, PULSE_MS, TRIG_SRC_WEB, 0);
+    pulseCommit();
+    while (pulse.activeMask & 1) {
+      BenchSink sink;
+      renderIndexPage(sink);
+      DynamicJsonDocument doc(METRICS_JSON_CAPACITY);
+      metricsToJson(doc);
+      serializeJson(doc, sink);
+      renders++;
+      yield();
+    }
+    pulseService();
+    const ChannelPulse &p = pulse.ch[0];
+    int32_t err = (int32_t)(p.lastWidthUs - PULSE_MS * 1000UL);
+    uint32_t absErr = err < 0 ? (uint32_t)(-err) : (uint32_t)err;
+    if (absErr > maxErr) maxErr = absErr;
+    sumErr += err;
+    st.add(p.lastWidthUs);
+    delay(50);
+  }
+  st.bytes = renders;
+  st.print();
+  Serial.printf("BENCH name=pulse_error iters=%u avg_err_us=%d max_abs_err_us=%u\n",
+                (unsigned)st.iters, (int)(sumErr / st.iters), (unsigned)maxErr);
 }
 
-void handleWifiPortal() {
-  // Starts a blocking WiFiManager config portal
-  server.send(200, "text/html; charset=utf-8",
-              "<!DOCTYPE html><html><body><p>Starting WiFi config portal...</p><p><a href='/'>Back</a></p></body></html>");
-  server.client().stop(); // close client so the portal can take over
-  delay(200);
-  WiFiManager wm;
-  String apName = "Diffuser-" + String(ESP.getChipId(), HEX);
-  wm.startConfigPortal(apName.c_str());
+void runBenchmarks() {
+  flushConfig();
+  static AppConfig saved; // too large for the loop stack
+  saved = config;
+  Serial.printf("BENCH_BEGIN heap_free=%u max_block=%u fragmentation=%u cpu_mhz=%u\n",
+                (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxFreeBlockSize(),
+                (unsigned)ESP.getHeapFragmentation(), (unsigned)ESP.getCpuFreqMHz());
+  benchParseTime();
+  benchRenderIndex(0);
+  benchRenderIndex(16);
+  benchRenderIndex(MAX_SCHEDULE_ENTRIES);
+  config = saved;
+  compileSchedule();
+  benchConfigRoundTrip();
+  benchMqttParse();
+  benchPulseUnderLoad();
+  config = saved;
+  compileSchedule();
+  armIntervals();
+  saveConfig();
+  Serial.println("BENCH_END");
+}
+
+// Reads serial input a line at a time; "bench" runs the suite
+void benchSerialService() {
+  static char line[16];
+  static uint8_t len = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (len < sizeof(line) - 1) line[len++] = c;
+      continue;
+    }
+    line[len] = '\0';
+    if (strcmp(line, "bench") == 0) runBenchmarks();
+    len = 0;
+  }
 }
+#endif
 
 // ================== Setup/Loop ==================
+// Registers a handler with per-route request count and duration metrics
+static void serverOnTimed(const char *path, HTTPMethod method, ESP8266WebServer::THandlerFunction handler,
+                          ESP8266WebServer::THandlerFunction upload = nullptr) {
+  uint8_t idx = metricsAddRoute(path, method);
+  auto timed = [idx, handler]() {
+    uint32_t start = micros();
+    handler();
+    metricsRouteDone(idx, micros() - start);
+  };
+  if (upload) {
+    server.on(path, method, timed, upload);
+  } else {
+    server.on(path, method, timed);
+  }
+}
+
 void setupWebServer() {
-  server.on("/", HTTP_GET, handleRoot);
-  server.on("/config", HTTP_GET, handleConfigPage);
-  server.on("/api/trigger", HTTP_POST, handleTriggerPost);
-  server.on("/api/interval", HTTP_POST, handleIntervalPost);
-  server.on("/api/schedule/add", HTTP_POST, handleScheduleAdd);
-  server.on("/api/schedule/remove", HTTP_POST, handleScheduleRemove);
-  server.on("/api/config", HTTP_POST, handleConfigPost);
-  server.on("/api/status", HTTP_GET, handleStatusJson);
-  server.on("/api/wifi-portal", HTTP_GET, handleWifiPortal);
+  serverOnTimed("/", HTTP_GET, handleRoot);
+  serverOnTimed("/config", HTTP_GET, handleConfigPage);
+  serverOnTimed("/api/trigger", HTTP_POST, handleTriggerPost);
+  serverOnTimed("/api/interval", HTTP_POST, handleIntervalPost);
+  serverOnTimed("/api/group/trigger", HTTP_POST, handleGroupTriggerPost);
+  serverOnTimed("/api/schedule/add", HTTP_POST, handleScheduleAdd);
+  serverOnTimed("/api/schedule/remove", HTTP_POST, handleScheduleRemove);
+  serverOnTimed("/api/schedule/rule/add", HTTP_POST, handleScheduleRuleAdd);
+  serverOnTimed("/api/schedule/rule/remove", HTTP_POST, handleScheduleRuleRemove);
+  serverOnTimed("/api/config", HTTP_POST, handleConfigPost);
+  serverOnTimed("/api/config", HTTP_GET, handleConfigExport);
+  serverOnTimed("/api/config", HTTP_PUT, handleConfigWrite, handleConfigBodyRaw);
+  serverOnTimed("/api/config", HTTP_PATCH, handleConfigWrite, handleConfigBodyRaw);
+  serverOnTimed("/api/config/import", HTTP_POST, handleConfigWrite, handleConfigBodyRaw);
+  serverOnTimed("/api/update", HTTP_POST, handleUpdatePost, handleUpdateBodyRaw);
+  serverOnTimed("/api/status", HTTP_GET, handleStatusJson);
+  serverOnTimed("/api/events", HTTP_GET, handleEvents);
+  serverOnTimed("/api/events/log", HTTP_GET, handleEventLog);
+  serverOnTimed("/api/metrics", HTTP_GET, handleMetrics);
+  serverOnTimed("/metrics", HTTP_GET, handleMetricsPrometheus);
+  serverOnTimed("/api/wifi-portal", HTTP_GET, handleWifiPortal);
+  for (const WebAsset &asset : WEB_ASSETS) {
+    serverOnTimed(asset.path, HTTP_GET, [&asset]() { handleStaticAsset(asset); });
+  }
+  static const char *collectedHeaders[] = {"If-None-Match", "X-MD5"};
+  server.collectHeaders(collectedHeaders, sizeof(collectedHeaders) / sizeof(collectedHeaders[0]));
   server.begin();
   Serial.println("HTTP server started");
 }
 
+static const uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 1500;
+
+// Rejoin the cached AP directly: fixed BSSID and channel skip the scan, the
+// cached address skips DHCP. Credentials come from the SDK's saved config.
+bool fastReconnectWiFi() {
+  RtcWifiCache c;
+  if (!rtcLoadWifiCache(c)) return false;
+  String ssid = WiFi.SSID();
+  String psk = WiFi.psk();
+  if (ssid.length() == 0 || c.ssidCrc != crc32Bytes(ssid.c_str(), ssid.length())) return false;
+
+  // Credentials are already stored; don't rewrite them to flash
+  WiFi.persistent(false);
+  WiFi.config(IPAddress(c.ip), IPAddress(c.gateway), IPAddress(c.subnet), IPAddress(c.dns));
+  WiFi.begin(ssid.c_str(), psk.c_str(), c.channel, c.bssid, true);
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED && millis() - start < WIFI_FAST_CONNECT_TIMEOUT_MS) {
+    delay(5);
+  }
+  bool ok = WiFi.status() == WL_CONNECTED;
+  if (!ok) {
+    // Back to DHCP and a normal scan; disconnect while non-persistent
+    // so the stored credentials survive
+    WiFi.disconnect();
+    WiFi.config(0U, 0U, 0U);
+    Serial.println("WiFi: fast reconnect failed");
+  }
+  WiFi.persistent(true);
+  return ok;
+}
+
 void setupWiFi() {
   WiFi.mode(WIFI_STA);
-  WiFiManager wm;
-  wm.setConfigPortalTimeout(180); // 3 minutes
-  String apName = "Diffuser-" + String(ESP.getChipId(), HEX);
-  if (!wm.autoConnect(apName.c_str())) {
-    Serial.println("WiFi: Failed to connect or portal timeout. Rebooting...");
-    delay(1000);
-    ESP.restart();
+  bootWifiFastPath = config.wifiFastReconnect && fastReconnectWiFi();
+  if (!bootWifiFastPath) {
+    WiFiManager wm;
+    wm.setConfigPortalTimeout(180); // 3 minutes
+    String apName = "Diffuser-" + String(ESP.getChipId(), HEX);
+    if (!wm.autoConnect(apName.c_str())) {
+      Serial.println("WiFi: Failed to connect or portal timeout. Rebooting...");
+      delay(1000);
+      ESP.restart();
+    }
   }
-  Serial.print("WiFi connected: ");
+  Serial.print(bootWifiFastPath ? "WiFi connected (fast): " : "WiFi connected: ");
   Serial.println(WiFi.localIP());
+  rtcSaveWifiCache();
+  applyPowerMode();
 }
 
-void setupTime() {
+// Runs from the SNTP task between loop() passes; only notes the sample
+void onTimeSet() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < MIN_VALID_EPOCH) return;
+  timeSync.pendingEpochMs = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  timeSync.pendingMillis = millis();
+  timeSync.pending = true;
+}
+
+static void ntpRequest() {
   // Get UTC; we'll apply offset manually
   configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+  timeSync.requests++;
+  timeSync.syncsAtRequest = timeSync.syncs;
+}
+
+void setupTime() {
+  settimeofday_cb(onTimeSet);
+  ntpRequest();
+  timers.armIn(EVT_NTP_RESYNC, NTP_RETRY_MS);
   Serial.println("NTP requested");
 }
 
+// Folds an SNTP update into timeSync: the step from our extrapolation,
+// and the drift over the span since the previous sync
+void timeSyncService() {
+  if (!timeSync.pending) return;
+  timeSync.pending = false;
+  int64_t ntpMs = timeSync.pendingEpochMs;
+  uint32_t at = timeSync.pendingMillis;
+  bool first = !timeSync.valid;
+  int64_t step = first ? 0 : ntpMs - timeSyncExtrapolate(at);
+  if (!first) {
+    uint32_t span = at - timeSync.lastSyncMillis;
+    if (span >= TIME_DRIFT_MIN_SPAN_MS) {
+      // The correction applied since the last sync plus what was still off
+      int64_t ppm = timeSync.driftPpm + step * 1000000 / (int64_t)span;
+      if (ppm >= -TIME_DRIFT_MAX_PPM && ppm <= TIME_DRIFT_MAX_PPM) timeSync.driftPpm = (int32_t)ppm;
+    }
+  }
+  timeSync.lastStepMs = step > INT32_MAX ? INT32_MAX : step < INT32_MIN ? INT32_MIN : (int32_t)step;
+  timeSync.baseEpochMs = ntpMs;
+  timeSync.baseMillis = at;
+  timeSync.lastSyncEpochMs = ntpMs;
+  timeSync.lastSyncMillis = at;
+  timeSync.valid = true;
+  timeSync.syncs++;
+  Serial.printf("NTP: synced, step %ld ms, drift %ld ppm\n", (long)timeSync.lastStepMs, (long)timeSync.driftPpm);
+  statusChanged();
+  // The first time, or a step, moves the schedule; check it now rather
+  // than at the next planned wake-up
+  if (first || step > TIME_STEP_RECHECK_MS || step < -(int64_t)TIME_STEP_RECHECK_MS) {
+    timers.armIn(EVT_SCHEDULE, 0);
+  }
+}
+
+void onNtpResyncTimer() {
+  if (!timeSync.valid) {
+    Serial.println("NTP: no valid time yet, retrying");
+    ntpRequest();
+    timers.armIn(EVT_NTP_RESYNC, NTP_RETRY_MS);
+    return;
+  }
+  if (timeSync.syncs == timeSync.syncsAtRequest) {
+    timeSync.missed++;
+    Serial.println("NTP: no update since the last request");
+    statusChanged();
+  }
+  // Re-anchor so millis() wrapping after 49 days without a sync stays exact
+  uint32_t at = millis();
+  timeSync.baseEpochMs = timeSyncExtrapolate(at);
+  timeSync.baseMillis = at;
+  ntpRequest();
+  timers.armIn(EVT_NTP_RESYNC, NTP_RESYNC_MS);
+}
+
 void setupMQTT() {
-  if (config.mqttHost.length() == 0) {
+  if (!config.mqttHost[0]) {
     Serial.println("MQTT host not set, skipping MQTT");
     return;
   }
-  connectMqtt();
+  mqttRestart();
 }
 
 void setup() {
   Serial.begin(115200);
-  delay(200);
+  statusGeneration = ESP.random();
+  groupLink.seq = ESP.random(); // receivers remember recent seqs across our reboot
 
+  rtcLoad();
+  safeMode = rtcState.bootFailures >= OTA_SAFE_MODE_FAILURES;
   loadConfig();
-  applyTriggerPin();
+  eventLogBegin();
+  applyTimezone();
+  if (!safeMode) {
+    applyChannelPins();
+    pulseInit();
+  }
+  restoreScheduleFromRtc();
+  bootMark(BOOT_CONFIG);
 
   setupWiFi();
+  bootMark(BOOT_WIFI);
   setupTime();
+  bootMark(BOOT_TIME);
 
   setupWebServer();
-  setupMQTT();
+  setupDiscovery();
+  setupOta();
+  if (!safeMode) timers.armIn(EVT_GROUP_BEACON, GROUP_BEACON_MS);
+  bootMark(BOOT_WEB);
+  if (!safeMode) setupMQTT();
+  bootMark(BOOT_MQTT);
 
-  scheduleFiredToday.assign(config.scheduleTimes.size(), false);
+  if (!safeMode) {
+    compileSchedule();
+    armIntervals();
+    restoreIntervalFromRtc();
+  }
+  armMetricsPublish();
+  timers.armIn(EVT_HEAP_SAMPLE, HEAP_SAMPLE_MS);
+  bootMark(BOOT_SETUP);
   Serial.println("Setup complete");
 }
 
+void dispatchTimer(uint8_t evt) {
+  if (evt >= EVT_INTERVAL) {
+    onIntervalTimer(evt - EVT_INTERVAL);
+    return;
+  }
+  switch (evt) {
+    case EVT_PULSE_OFF: onPulseWatchdog(); break;
+    case EVT_SCHEDULE: onScheduleTimer(); break;
+    case EVT_MQTT_RECONNECT: mqttReconnectStep(); break;
+    case EVT_NTP_RESYNC: onNtpResyncTimer(); break;
+    case EVT_CONFIG_SAVE: saveConfig(); break;
+    case EVT_MQTT_STATE: mqttStateFlush(); break;
+    case EVT_METRICS_PUBLISH: onMetricsPublishTimer(); break;
+    case EVT_SSE_PING: onSsePingTimer(); break;
+    case EVT_GROUP_START: onGroupStartTimer(); break;
+    case EVT_GROUP_BEACON: onGroupBeaconTimer(); break;
+    case EVT_HEAP_SAMPLE: onHeapSampleTimer(); break;
+    case EVT_OTA_CHECK: onOtaCheckTimer(); break;
+    case EVT_EVENT_LOG_FLUSH: eventLogFlush(); break;
+  }
+}
+
 void loop() {
+  uint32_t loopStart = micros();
+
   // Web server
   server.handleClient();
 
-  // MQTT service
-  if (config.mqttHost.length() > 0) {
-    if (!mqttClient.connected()) {
-      static unsigned long lastReconnectAttempt = 0;
-      if (millis() - lastReconnectAttempt > 5000) {
-        lastReconnectAttempt = millis();
-        connectMqtt();
-      }
-    } else {
-      mqttClient.loop();
-    }
-  }
+  // Report pulses ended by the timer ISR
+  pulseService();
 
-  // Finish trigger pulse
-  if (triggerInProgress) {
-    if (millis() - lastTriggerAt >= config.triggerDurationMs) {
-      // drive inactive
-      digitalWrite(config.triggerPin, config.triggerActiveHigh ? LOW : HIGH);
-      triggerInProgress = false;
-      Serial.println("Trigger: OFF");
-    }
-  }
+  // Fold in an NTP update noted by the SNTP callback
+  timeSyncService();
 
-  // Interval handling
-  if (config.intervalEnabled && config.intervalSeconds > 0) {
-    if (nextIntervalAt == 0) {
-      nextIntervalAt = millis() + (config.intervalSeconds * 1000UL);
-    } else if ((long)(millis() - nextIntervalAt) >= 0) {
-      triggerPulse();
-      nextIntervalAt += (config.intervalSeconds * 1000UL);
-    }
+  // LAN group triggers and mDNS
+  groupService();
+  MDNS.update();
+
+  // ArduinoOTA, while no pulse or scheduled fire is close
+  otaService();
+
+  // MQTT service
+  mqttService();
+
+  // Timed work: pulse end, intervals, schedule, reconnects
+  uint8_t evt;
+  while ((evt = timers.popDue(millis())) != EVT_COUNT) {
+    dispatchTimer(evt);
   }
 
-  // Schedule handling (check once per second)
-  time_t now_utc = time(nullptr);
-  if (now_utc != lastTimeCheck) {
-    lastTimeCheck = now_utc;
-    struct tm tm_local;
-    time_t epoch_local;
-    getLocalTimeBrokenDown(tm_local, epoch_local);
+  // Apply the trigger policy, then start every pulse accepted during this
+  // pass in one GPIO write
+  triggerQueueService();
+  pulseCommit();
 
-    // New day?
-    if (tm_local.tm_yday != lastDayOfYear) {
-      resetScheduleFlagsForNewDay(tm_local);
-      Serial.println("New day: reset schedule flags");
-    }
+  // Push what changed to /api/events streams
+  sseService();
 
-    int currentMin = tm_local.tm_hour * 60 + tm_local.tm_min;
-    int sec = tm_local.tm_sec;
+  maybeDeepSleep();
+#ifdef DIFFUSER_BENCH
+  benchSerialService();
+#endif
+  metricsLoopDone(micros() - loopStart);
 
-    if (sec == 0) {
-      for (size_t i = 0; i < config.scheduleTimes.size(); i++) {
-        int schedMin = parseTimeToMinutes(config.scheduleTimes[i]);
-        if (schedMin >= 0 && !scheduleFiredToday[i] && schedMin == currentMin) {
-          triggerPulse();
-          scheduleFiredToday[i] = true;
-          Serial.printf("Scheduled trigger at %s\n", config.scheduleTimes[i].c_str());
-        }
-      }
-    }
-  }
-}
\ No newline at end of file
+  // Idle until the next deadline; delay() keeps the WiFi stack running
+  delay(timers.msUntilNext(millis(), loopIdleCapMs()));
+}
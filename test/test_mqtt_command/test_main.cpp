@@ -0,0 +1,229 @@
+#include <unity.h>
+#include <string.h>
+#include <ArduinoJson.h>
+#include <MqttCommand.h>
+#include <Schedule.h>
+
+static const uint8_t CHANNELS = 4;
+
+static MqttLimits limits() {
+  MqttLimits l;
+  l.channelCount = CHANNELS;
+  l.groupDefaultLeadMs = 250;
+  l.groupMaxLeadMs = 60000;
+  l.urlSize = 64;
+  l.maxStaggerSec = 86400;
+  return l;
+}
+
+static const char *parse(const char *msg, MqttTextCommand &cmd) {
+  return mqttParseText(msg, strlen(msg), CHANNELS, cmd);
+}
+
+// Validates a batch's ops against empty schedules; index is the failing op
+static const char *validate(const char *json, size_t &index, size_t *scheduleSizes = nullptr) {
+  static StaticJsonDocument<3072> doc;
+  static char buf[1024];
+  strncpy(buf, json, sizeof(buf) - 1);
+  TEST_ASSERT_FALSE(deserializeJson(doc, buf));
+  size_t sizes[CHANNELS] = {0}, rules[CHANNELS] = {0};
+  return mqttValidateOps(doc["ops"].as<JsonArrayConst>(), limits(), scheduleSizes ? scheduleSizes : sizes, rules,
+                         index);
+}
+
+// Small deterministic generator for the fuzz loops
+static uint32_t rngState = 12345;
+static uint32_t rng() {
+  rngState = rngState * 1103515245u + 12345u;
+  return rngState >> 16;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_text_commands() {
+  MqttTextCommand cmd;
+  TEST_ASSERT_NULL(parse("  trigger \n", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::TRIGGER, cmd.kind);
+  TEST_ASSERT_EQUAL(0, cmd.ch);
+  TEST_ASSERT_NULL(parse("1", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::TRIGGER, cmd.kind);
+  TEST_ASSERT_NULL(parse("TRIGGER_ALL", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::TRIGGER_ALL, cmd.kind);
+  TEST_ASSERT_NULL(parse("INTERVAL:30", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::INTERVAL, cmd.kind);
+  TEST_ASSERT_EQUAL_UINT32(30, cmd.value);
+  TEST_ASSERT_NULL(parse("stop_interval", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::STOP_INTERVAL, cmd.kind);
+  TEST_ASSERT_NULL(parse("ADD_SCHEDULE: 7:05", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::ADD_SCHEDULE, cmd.kind);
+  TEST_ASSERT_EQUAL_UINT32(425, cmd.value);
+  TEST_ASSERT_NULL(parse("CLEAR_SCHEDULE", cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::CLEAR_SCHEDULE, cmd.kind);
+}
+
+void test_text_channel_prefix() {
+  MqttTextCommand cmd;
+  TEST_ASSERT_NULL(parse("CH3: TRIGGER", cmd));
+  TEST_ASSERT_EQUAL(3, cmd.ch);
+  TEST_ASSERT_NULL(parse("ch2:INTERVAL:5", cmd));
+  TEST_ASSERT_EQUAL(2, cmd.ch);
+  TEST_ASSERT_EQUAL(MqttTextCommand::INTERVAL, cmd.kind);
+  TEST_ASSERT_NOT_NULL(parse("CH4:TRIGGER", cmd)); // only 4 channels
+  TEST_ASSERT_NOT_NULL(parse("CHx:TRIGGER", cmd));
+  TEST_ASSERT_NOT_NULL(parse("CH:TRIGGER", cmd));
+  TEST_ASSERT_NOT_NULL(parse("CH1TRIGGER", cmd));
+}
+
+void test_text_rejects_bad_values() {
+  MqttTextCommand cmd;
+  TEST_ASSERT_NOT_NULL(parse("INTERVAL:0", cmd));
+  TEST_ASSERT_NOT_NULL(parse("INTERVAL:-5", cmd));
+  TEST_ASSERT_NOT_NULL(parse("INTERVAL:30s", cmd));
+  TEST_ASSERT_NOT_NULL(parse("INTERVAL:9999999999", cmd));
+  TEST_ASSERT_NULL(parse("INTERVAL:2147483", cmd)); // the longest a signed millis() distance holds
+  TEST_ASSERT_NOT_NULL(parse("INTERVAL:2147484", cmd));
+  TEST_ASSERT_NOT_NULL(parse("ADD_SCHEDULE:24:00", cmd));
+  TEST_ASSERT_NOT_NULL(parse("ADD_SCHEDULE:08:00:00", cmd));
+  TEST_ASSERT_NOT_NULL(parse("add_schedule:08:00", cmd)); // prefixes are upper case
+  TEST_ASSERT_NOT_NULL(parse("TRIGGERX", cmd));
+  TEST_ASSERT_NOT_NULL(parse("", cmd));
+}
+
+void test_text_reads_only_length_bytes() {
+  MqttTextCommand cmd;
+  const char payload[] = "TRIGGER_ALLxyz";
+  TEST_ASSERT_NULL(mqttParseText(payload, 11, CHANNELS, cmd));
+  TEST_ASSERT_EQUAL(MqttTextCommand::TRIGGER_ALL, cmd.kind);
+}
+
+void test_batch_accepts_valid_ops() {
+  size_t index;
+  TEST_ASSERT_NULL(validate("{\"ops\":[{\"op\":\"trigger\",\"ch\":1},{\"op\":\"pulse\",\"ch\":2,\"ms\":500},"
+                            "{\"op\":\"schedule\",\"ch\":0,\"times\":[\"08:00\",\"9:30\"]},"
+                            "{\"op\":\"addRule\",\"ch\":3,\"rule\":{\"start\":\"09:00\",\"end\":\"17:00\","
+                            "\"everyMin\":30}}]}",
+                            index));
+  TEST_ASSERT_EQUAL(4, index);
+}
+
+void test_batch_reports_the_failing_op() {
+  size_t index;
+  TEST_ASSERT_EQUAL_STRING("invalid channel", validate("{\"ops\":[{\"op\":\"trigger\"},{\"op\":\"trigger\",\"ch\":4}]}", index));
+  TEST_ASSERT_EQUAL(1, index);
+  TEST_ASSERT_EQUAL_STRING("unknown op", validate("{\"ops\":[{\"op\":\"explode\"}]}", index));
+  TEST_ASSERT_EQUAL(0, index);
+  TEST_ASSERT_EQUAL_STRING("op must be an object", validate("{\"ops\":[1]}", index));
+  TEST_ASSERT_EQUAL_STRING("invalid time", validate("{\"ops\":[{\"op\":\"addSchedule\",\"time\":\"8:0\"}]}", index));
+  TEST_ASSERT_EQUAL_STRING("ms out of range", validate("{\"ops\":[{\"op\":\"pulse\",\"ms\":0}]}", index));
+  TEST_ASSERT_EQUAL_STRING("seconds out of range",
+                           validate("{\"ops\":[{\"op\":\"interval\",\"seconds\":2147484}]}", index));
+  TEST_ASSERT_EQUAL_STRING("seconds out of range",
+                           validate("{\"ops\":[{\"op\":\"interval\",\"seconds\":-1,\"enabled\":false}]}", index));
+  TEST_ASSERT_EQUAL_STRING("rule start must be HH:MM",
+                           validate("{\"ops\":[{\"op\":\"addRule\",\"rule\":{\"end\":\"10:00\"}}]}", index));
+}
+
+void test_batch_rejects_a_bad_ops_array() {
+  size_t index;
+  TEST_ASSERT_NOT_NULL(validate("{\"ops\":[]}", index));
+  TEST_ASSERT_EQUAL(0, index);
+  TEST_ASSERT_NOT_NULL(validate("{\"id\":\"x\"}", index));
+  TEST_ASSERT_NOT_NULL(validate("{\"ops\":[{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{}]}", index));
+  TEST_ASSERT_EQUAL(17, index);
+}
+
+void test_batch_tracks_schedule_sizes_across_ops() {
+  size_t index;
+  size_t sizes[CHANNELS] = {MAX_SCHEDULE_ENTRIES - 1, 0, 0, 0};
+  TEST_ASSERT_NULL(validate("{\"ops\":[{\"op\":\"addSchedule\",\"time\":\"08:00\"}]}", index, sizes));
+  TEST_ASSERT_EQUAL(MAX_SCHEDULE_ENTRIES, sizes[0]);
+  TEST_ASSERT_EQUAL_STRING("schedule is full",
+                           validate("{\"ops\":[{\"op\":\"addSchedule\",\"time\":\"08:00\"}]}", index, sizes));
+  TEST_ASSERT_NULL(validate("{\"ops\":[{\"op\":\"clearSchedule\"},{\"op\":\"addSchedule\",\"time\":\"08:00\"}]}", index,
+                            sizes));
+  TEST_ASSERT_EQUAL(1, sizes[0]);
+}
+
+void test_update_requires_md5_and_a_short_http_url() {
+  size_t index;
+  TEST_ASSERT_EQUAL_STRING("md5 must be 32 hex digits",
+                           validate("{\"ops\":[{\"op\":\"update\",\"url\":\"http://h/f.bin\"}]}", index));
+  TEST_ASSERT_EQUAL_STRING("md5 must be 32 hex digits",
+                           validate("{\"ops\":[{\"op\":\"update\",\"url\":\"http://h/f.bin\","
+                                    "\"md5\":\"0123456789abcdef0123456789abcdeg\"}]}",
+                                    index));
+  TEST_ASSERT_EQUAL_STRING("url must be http:// and short",
+                           validate("{\"ops\":[{\"op\":\"update\",\"url\":\"https://h/f.bin\","
+                                    "\"md5\":\"0123456789abcdef0123456789abcdef\"}]}",
+                                    index));
+  TEST_ASSERT_NULL(validate("{\"ops\":[{\"op\":\"update\",\"url\":\"http://h/f.bin\","
+                            "\"md5\":\"0123456789ABCDEF0123456789abcdef\",\"staggerSec\":600}]}",
+                            index));
+  TEST_ASSERT_TRUE(md5HexValid("0123456789abcdef0123456789abcdef"));
+  TEST_ASSERT_FALSE(md5HexValid("0123456789abcdef0123456789abcde"));
+}
+
+// Random bytes: whatever is accepted must be safe to apply
+void test_fuzz_text_commands() {
+  static const char alphabet[] = "CHch0123456789:_ TRIGERALNVSPDUOYx\n-";
+  char msg[24];
+  for (int i = 0; i < 20000; i++) {
+    size_t n = rng() % sizeof(msg);
+    for (size_t k = 0; k < n; k++) msg[k] = (i & 1) ? (char)rng() : alphabet[rng() % (sizeof(alphabet) - 1)];
+    MqttTextCommand cmd;
+    if (mqttParseText(msg, n, CHANNELS, cmd)) continue;
+    TEST_ASSERT_TRUE(cmd.ch < CHANNELS);
+    if (cmd.kind == MqttTextCommand::INTERVAL) TEST_ASSERT_TRUE(cmd.value > 0);
+    if (cmd.kind == MqttTextCommand::ADD_SCHEDULE) TEST_ASSERT_TRUE(cmd.value < 1440);
+  }
+}
+
+// Batches stitched from fragments: an accepted batch never grows a list
+// past its bound
+void test_fuzz_batches() {
+  static const char *const fragments[] = {
+    "{\"op\":\"addSchedule\",\"ch\":%u,\"time\":\"%u:%02u\"}", "{\"op\":\"clearSchedule\",\"ch\":%u}",
+    "{\"op\":\"addRule\",\"ch\":%u,\"rule\":{\"start\":\"%u:%02u\"}}", "{\"op\":\"clearRules\",\"ch\":%u}",
+    "{\"op\":\"pulse\",\"ch\":%u,\"ms\":%u%u}", "{\"op\":\"trigger\",\"ch\":%u%u%u}"};
+  static StaticJsonDocument<8192> doc; // host slots are larger than the ESP8266's
+  char json[1024];
+  size_t scheduleSizes[CHANNELS] = {0}, ruleSizes[CHANNELS] = {0};
+  for (int i = 0; i < 5000; i++) {
+    size_t len = (size_t)snprintf(json, sizeof(json), "{\"ops\":[");
+    size_t ops = 1 + rng() % MQTT_MAX_OPS;
+    for (size_t k = 0; k < ops && len < sizeof(json) - 128; k++) {
+      len += (size_t)snprintf(json + len, sizeof(json) - len, k ? "," : "");
+      len += (size_t)snprintf(json + len, sizeof(json) - len, fragments[rng() % 6], rng() % 5, rng() % 25, rng() % 61);
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    if (rng() % 4 == 0) json[rng() % len] = (char)rng(); // corrupt some
+    if (deserializeJson(doc, json)) continue;
+    size_t s[CHANNELS], r[CHANNELS], index;
+    memcpy(s, scheduleSizes, sizeof(s));
+    memcpy(r, ruleSizes, sizeof(r));
+    if (mqttValidateOps(doc["ops"].as<JsonArrayConst>(), limits(), s, r, index)) continue;
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+      TEST_ASSERT_TRUE(s[ch] <= MAX_SCHEDULE_ENTRIES);
+      TEST_ASSERT_TRUE(r[ch] <= MAX_SCHEDULE_RULES);
+    }
+    memcpy(scheduleSizes, s, sizeof(s)); // applied: the next batch starts from here
+    memcpy(ruleSizes, r, sizeof(r));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_text_commands);
+  RUN_TEST(test_text_channel_prefix);
+  RUN_TEST(test_text_rejects_bad_values);
+  RUN_TEST(test_text_reads_only_length_bytes);
+  RUN_TEST(test_batch_accepts_valid_ops);
+  RUN_TEST(test_batch_reports_the_failing_op);
+  RUN_TEST(test_batch_rejects_a_bad_ops_array);
+  RUN_TEST(test_batch_tracks_schedule_sizes_across_ops);
+  RUN_TEST(test_update_requires_md5_and_a_short_http_url);
+  RUN_TEST(test_fuzz_text_commands);
+  RUN_TEST(test_fuzz_batches);
+  return UNITY_END();
+}
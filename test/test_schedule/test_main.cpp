@@ -0,0 +1,280 @@
+#include <unity.h>
+#include <DiffuserClock.h>
+#include <Schedule.h>
+
+static const int64_t MS_PER_MIN = 60000;
+static const int64_t MS_PER_DAY = 86400000;
+static const int64_t SUNDAY_2026_01_04 = 1767484800000LL; // 00:00 UTC
+
+// The firmware's schedule check reduced to one channel: evaluates each
+// local minute once, catching up at most windowMin minutes after a jump,
+// and nothing that lies before the first check
+struct Driver {
+  const Clock &clock;
+  int32_t offsetMin;
+  int windowMin;
+  const ScheduleRule *rules = nullptr;
+  size_t ruleCount = 0;
+  CompiledSchedule sc;
+  int32_t loadedDay = -1;
+  int32_t evalDay = -1; // day and last minute evaluated, -1 before the first check
+  int highMin = -1;
+
+  int fireMin[64];
+  int32_t fireDay[64];
+  uint32_t fireMs[64];
+  int fires = 0;
+
+  Driver(const Clock &c, int32_t offset, int window) : clock(c), offsetMin(offset), windowMin(window) {}
+
+  void check() {
+    int64_t now = clock.epochMs();
+    int32_t day = localDay(now, offsetMin);
+    int minute = (int)(localMsOfDay(now, offsetMin) / MS_PER_MIN);
+    int from = minute;
+    if (evalDay >= 0) {
+      from = minute > windowMin ? minute - windowMin : 0;
+      if (day == evalDay && from <= highMin) from = highMin + 1;
+    }
+    if (day != loadedDay) {
+      scheduleStartDay(sc, rules, ruleCount, day, from);
+      loadedDay = day;
+    }
+    uint32_t durationMs;
+    int next;
+    while ((next = scheduleNextMin(sc)) >= 0 && schedulePopDue(sc, from, minute, durationMs)) {
+      if (fires < 64) {
+        fireDay[fires] = day;
+        fireMin[fires] = next;
+        fireMs[fires] = durationMs;
+      }
+      fires++;
+    }
+    evalDay = day;
+    highMin = minute;
+  }
+
+  // One check per simulated minute
+  void runMinutes(int64_t minutes, SimClock &sim) {
+    for (int64_t i = 0; i < minutes; i++) {
+      sim.advanceMs(MS_PER_MIN);
+      check();
+    }
+  }
+};
+
+static void addTimes(CompiledSchedule &sc, const char *const *times, size_t n) {
+  scheduleClear(sc);
+  for (size_t i = 0; i < n; i++) scheduleInsert(sc, (uint16_t)parseTimeToMinutes(times[i]));
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_parse_time_is_strict() {
+  TEST_ASSERT_EQUAL(0, parseTimeToMinutes("00:00"));
+  TEST_ASSERT_EQUAL(425, parseTimeToMinutes("7:05"));
+  TEST_ASSERT_EQUAL(1439, parseTimeToMinutes("23:59"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes("24:00"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes("12:60"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes("12:3"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes("12:3x"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes("12:30 "));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes("123:00"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes(" 8:00"));
+  TEST_ASSERT_EQUAL(-1, parseTimeToMinutes(""));
+}
+
+void test_times_stay_sorted() {
+  static const char *const times[] = {"18:45", "08:00", "12:30"};
+  CompiledSchedule sc;
+  addTimes(sc, times, 3);
+  TEST_ASSERT_EQUAL(3, sc.count);
+  TEST_ASSERT_EQUAL(480, sc.minutes[0]);
+  TEST_ASSERT_EQUAL(750, sc.minutes[1]);
+  TEST_ASSERT_EQUAL(1125, sc.minutes[2]);
+}
+
+void test_fires_each_time_once_a_day() {
+  static const char *const times[] = {"08:00", "12:30", "18:45"};
+  SimClock clock(SUNDAY_2026_01_04);
+  Driver d(clock, 0, 0);
+  addTimes(d.sc, times, 3);
+  d.check();
+  d.runMinutes(3 * 1440, clock);
+  TEST_ASSERT_EQUAL(9, d.fires);
+  for (int i = 0; i < 9; i++) {
+    TEST_ASSERT_EQUAL(d.sc.minutes[i % 3], d.fireMin[i]);
+    TEST_ASSERT_EQUAL(localDay(SUNDAY_2026_01_04, 0) + i / 3, d.fireDay[i]);
+    TEST_ASSERT_EQUAL_UINT32(0, d.fireMs[i]); // the channel's duration
+  }
+}
+
+void test_next_fire_follows_local_offset() {
+  static const char *const times[] = {"08:00"};
+  SimClock clock(SUNDAY_2026_01_04);
+  Driver d(clock, 60, 0); // UTC+1: 08:00 local is 07:00 UTC
+  addTimes(d.sc, times, 1);
+  d.check();
+  TEST_ASSERT_EQUAL(480, scheduleNextMin(d.sc));
+  d.runMinutes(6 * 60 + 59, clock);
+  TEST_ASSERT_EQUAL(0, d.fires);
+  d.runMinutes(1, clock);
+  TEST_ASSERT_EQUAL(1, d.fires);
+  TEST_ASSERT_EQUAL(-1, scheduleNextMin(d.sc));
+}
+
+void test_catch_up_after_a_jump_fires_in_order() {
+  static const char *const times[] = {"08:00", "12:30", "18:45"};
+  SimClock clock(SUNDAY_2026_01_04 + 7 * 60 * MS_PER_MIN);
+  Driver d(clock, 0, 24 * 60);
+  addTimes(d.sc, times, 3);
+  d.check();
+  clock.advanceMs(6 * 60 * MS_PER_MIN); // stalled until 13:00
+  d.check();
+  TEST_ASSERT_EQUAL(2, d.fires);
+  TEST_ASSERT_EQUAL(480, d.fireMin[0]);
+  TEST_ASSERT_EQUAL(750, d.fireMin[1]);
+  d.check(); // nothing fires twice
+  TEST_ASSERT_EQUAL(2, d.fires);
+  TEST_ASSERT_EQUAL(1125, scheduleNextMin(d.sc));
+}
+
+void test_catch_up_is_bounded_by_the_window_over_several_days() {
+  static const char *const times[] = {"06:00", "08:00"};
+  SimClock clock(SUNDAY_2026_01_04 + 7 * 60 * MS_PER_MIN + 30 * MS_PER_MIN);
+  Driver d(clock, 0, 120);
+  addTimes(d.sc, times, 2);
+  d.check(); // boot at 07:30: 06:00 already passed and is not caught up
+  TEST_ASSERT_EQUAL(0, d.fires);
+  clock.advanceMs(3 * MS_PER_DAY + 90 * MS_PER_MIN); // off until day 3, 09:00
+  d.check();
+  TEST_ASSERT_EQUAL(1, d.fires); // 08:00 is inside the 2 h window, 06:00 is not
+  TEST_ASSERT_EQUAL(480, d.fireMin[0]);
+  TEST_ASSERT_EQUAL(localDay(SUNDAY_2026_01_04, 0) + 3, d.fireDay[0]);
+  d.runMinutes(1440, clock); // the next day runs normally
+  TEST_ASSERT_EQUAL(3, d.fires);
+  TEST_ASSERT_EQUAL(360, d.fireMin[1]);
+  TEST_ASSERT_EQUAL(480, d.fireMin[2]);
+}
+
+void test_rule_repeats_on_its_weekdays_only() {
+  ScheduleRule r;
+  r.startMin = 9 * 60;
+  r.endMin = 10 * 60;
+  r.periodMin = 30;
+  r.weekdays = 1 << 1; // Monday
+  r.durationMs = 700;
+  SimClock clock(SUNDAY_2026_01_04);
+  Driver d(clock, 0, 0);
+  d.rules = &r;
+  d.ruleCount = 1;
+  scheduleClear(d.sc);
+  d.check();
+  d.runMinutes(7 * 1440, clock);
+  TEST_ASSERT_EQUAL(3, d.fires);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(localDay(SUNDAY_2026_01_04, 0) + 1, d.fireDay[i]);
+    TEST_ASSERT_EQUAL(9 * 60 + 30 * i, d.fireMin[i]);
+    TEST_ASSERT_EQUAL_UINT32(700, d.fireMs[i]);
+  }
+}
+
+void test_rule_crossed_several_times_fires_once() {
+  ScheduleRule r;
+  r.startMin = 9 * 60;
+  r.endMin = 12 * 60;
+  r.periodMin = 15;
+  SimClock clock(SUNDAY_2026_01_04 + (8 * 60 + 59) * MS_PER_MIN);
+  Driver d(clock, 0, 24 * 60);
+  d.rules = &r;
+  d.ruleCount = 1;
+  scheduleClear(d.sc);
+  d.check();
+  clock.advanceMs(61 * MS_PER_MIN); // 10:00
+  d.check();
+  TEST_ASSERT_EQUAL(1, d.fires);
+  TEST_ASSERT_EQUAL(9 * 60, d.fireMin[0]);
+  TEST_ASSERT_EQUAL(10 * 60 + 15, scheduleNextMin(d.sc));
+}
+
+void test_times_and_rules_interleave() {
+  static const char *const times[] = {"09:10"};
+  ScheduleRule r;
+  r.startMin = 9 * 60;
+  r.endMin = 9 * 60 + 20;
+  r.periodMin = 20;
+  SimClock clock(SUNDAY_2026_01_04);
+  Driver d(clock, 0, 0);
+  d.rules = &r;
+  d.ruleCount = 1;
+  addTimes(d.sc, times, 1);
+  d.check();
+  d.runMinutes(1440, clock);
+  TEST_ASSERT_EQUAL(3, d.fires);
+  TEST_ASSERT_EQUAL(9 * 60, d.fireMin[0]);
+  TEST_ASSERT_EQUAL(9 * 60 + 10, d.fireMin[1]);
+  TEST_ASSERT_EQUAL(9 * 60 + 20, d.fireMin[2]);
+}
+
+void test_first_fire_of_a_later_day() {
+  static const char *const times[] = {"08:00"};
+  ScheduleRule r;
+  r.startMin = 6 * 60;
+  r.weekdays = 1 << 2; // Tuesday
+  CompiledSchedule sc;
+  addTimes(sc, times, 1);
+  int32_t sunday = localDay(SUNDAY_2026_01_04, 0);
+  TEST_ASSERT_EQUAL(480, scheduleFirstFireOfDay(sc, &r, 1, sunday + 1));
+  TEST_ASSERT_EQUAL(360, scheduleFirstFireOfDay(sc, &r, 1, sunday + 2));
+  scheduleClear(sc);
+  TEST_ASSERT_EQUAL(-1, scheduleFirstFireOfDay(sc, &r, 1, sunday + 3));
+}
+
+void test_rule_date_bounds() {
+  ScheduleRule r;
+  r.startMin = 600;
+  r.fromDay = (uint16_t)parseDate("2026-01-05");
+  r.toDay = (uint16_t)parseDate("2026-01-06");
+  int32_t sunday = localDay(SUNDAY_2026_01_04, 0);
+  TEST_ASSERT_EQUAL(-1, ruleFirstFire(r, sunday, 0));
+  TEST_ASSERT_EQUAL(600, ruleFirstFire(r, sunday + 1, 0));
+  TEST_ASSERT_EQUAL(600, ruleFirstFire(r, sunday + 2, 0));
+  TEST_ASSERT_EQUAL(-1, ruleFirstFire(r, sunday + 3, 0));
+}
+
+void test_dates_round_trip() {
+  char buf[11];
+  int32_t day = parseDate("2028-02-29");
+  TEST_ASSERT_TRUE(day > 0);
+  formatDate((uint16_t)day, buf);
+  TEST_ASSERT_EQUAL_STRING("2028-02-29", buf);
+  TEST_ASSERT_EQUAL(-1, parseDate("2026-02-29"));
+  TEST_ASSERT_EQUAL(-1, parseDate("2026-13-01"));
+  TEST_ASSERT_EQUAL(-1, parseDate("2026-01-01x"));
+  TEST_ASSERT_EQUAL(0, weekdayOfDay(localDay(SUNDAY_2026_01_04, 0)));
+}
+
+void test_interval_deadline_does_not_drift() {
+  TEST_ASSERT_EQUAL_UINT32(2000, intervalNextDeadline(1000, 1000, 1005)); // late dispatch
+  TEST_ASSERT_EQUAL_UINT32(6500, intervalNextDeadline(1000, 1000, 5500)); // whole periods missed
+  TEST_ASSERT_EQUAL_UINT32(900, intervalNextDeadline(0xFFFFFFFFu - 99, 1000, 0xFFFFFFFFu - 50)); // wraps
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_time_is_strict);
+  RUN_TEST(test_times_stay_sorted);
+  RUN_TEST(test_fires_each_time_once_a_day);
+  RUN_TEST(test_next_fire_follows_local_offset);
+  RUN_TEST(test_catch_up_after_a_jump_fires_in_order);
+  RUN_TEST(test_catch_up_is_bounded_by_the_window_over_several_days);
+  RUN_TEST(test_rule_repeats_on_its_weekdays_only);
+  RUN_TEST(test_rule_crossed_several_times_fires_once);
+  RUN_TEST(test_times_and_rules_interleave);
+  RUN_TEST(test_first_fire_of_a_later_day);
+  RUN_TEST(test_rule_date_bounds);
+  RUN_TEST(test_dates_round_trip);
+  RUN_TEST(test_interval_deadline_does_not_drift);
+  return UNITY_END();
+}
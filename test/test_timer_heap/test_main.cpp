@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <DiffuserClock.h>
+#include <TimerHeap.h>
+
+enum { EVT_A, EVT_B, EVT_C, EVT_D, EVT_COUNT };
+
+typedef TimerHeap<EVT_COUNT> Timers;
+
+void setUp() {}
+void tearDown() {}
+
+// Pops everything due at now, in order; returns how many were written
+static int drain(Timers &t, uint32_t now, uint8_t *out, int max) {
+  int n = 0;
+  for (uint8_t evt; n < max && (evt = t.popDue(now)) != Timers::NONE;) out[n++] = evt;
+  return n;
+}
+
+void test_pops_in_deadline_order() {
+  SimClock clock;
+  Timers t(clock);
+  t.armIn(EVT_C, 300);
+  t.armIn(EVT_A, 100);
+  t.armIn(EVT_D, 400);
+  t.armIn(EVT_B, 200);
+  TEST_ASSERT_EQUAL(Timers::NONE, t.popDue(clock.millis()));
+  clock.advanceMs(1000);
+  uint8_t order[EVT_COUNT];
+  TEST_ASSERT_EQUAL(4, drain(t, clock.millis(), order, EVT_COUNT));
+  const uint8_t expected[] = {EVT_A, EVT_B, EVT_C, EVT_D};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, order, 4);
+  TEST_ASSERT_EQUAL(0, t.size());
+}
+
+void test_only_due_events_pop() {
+  SimClock clock;
+  Timers t(clock);
+  t.armIn(EVT_A, 100);
+  t.armIn(EVT_B, 200);
+  clock.advanceMs(99);
+  TEST_ASSERT_EQUAL(Timers::NONE, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(1, t.msUntilNext(clock.millis(), 1000));
+  clock.advanceMs(1);
+  TEST_ASSERT_EQUAL(EVT_A, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL(Timers::NONE, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(50, t.msUntilNext(clock.millis(), 50)); // capped
+  TEST_ASSERT_TRUE(t.armed(EVT_B));
+  TEST_ASSERT_FALSE(t.armed(EVT_A));
+}
+
+void test_rearm_and_cancel() {
+  SimClock clock;
+  Timers t(clock);
+  t.armIn(EVT_A, 100);
+  t.armIn(EVT_B, 200);
+  t.armIn(EVT_C, 300);
+  t.armIn(EVT_A, 500); // moves A behind the others
+  t.cancel(EVT_B);
+  t.cancel(EVT_B); // cancelling twice is harmless
+  TEST_ASSERT_EQUAL(2, t.size());
+  TEST_ASSERT_EQUAL_UINT32(500, t.deadline(EVT_A));
+  clock.advanceMs(1000);
+  uint8_t order[EVT_COUNT];
+  TEST_ASSERT_EQUAL(2, drain(t, clock.millis(), order, EVT_COUNT));
+  TEST_ASSERT_EQUAL(EVT_C, order[0]);
+  TEST_ASSERT_EQUAL(EVT_A, order[1]);
+}
+
+void test_orders_across_millis_wrap() {
+  SimClock clock;
+  clock.advanceMs(0xFFFFFFFFull - 100); // 101 ms before millis() wraps
+  Timers t(clock);
+  t.armIn(EVT_B, 300); // past the wrap, numerically small
+  t.armIn(EVT_A, 50);  // before the wrap, numerically large
+  TEST_ASSERT_TRUE(t.deadline(EVT_B) < t.deadline(EVT_A));
+  TEST_ASSERT_EQUAL(Timers::NONE, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(50, t.msUntilNext(clock.millis(), 1000));
+  clock.advanceMs(50);
+  TEST_ASSERT_EQUAL(EVT_A, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL(Timers::NONE, t.popDue(clock.millis()));
+  clock.advanceMs(250); // now past the wrap
+  TEST_ASSERT_TRUE(clock.millis() < 1000);
+  TEST_ASSERT_EQUAL(EVT_B, t.popDue(clock.millis()));
+}
+
+void test_records_lateness() {
+  SimClock clock;
+  Timers t(clock);
+  t.armIn(EVT_A, 100);
+  clock.advanceMs(130);
+  TEST_ASSERT_EQUAL(EVT_A, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(30, t.maxLateMs(EVT_A));
+  t.armIn(EVT_A, 100);
+  clock.advanceMs(110);
+  TEST_ASSERT_EQUAL(EVT_A, t.popDue(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(30, t.maxLateMs(EVT_A)); // keeps the worst
+  TEST_ASSERT_EQUAL_UINT32(1, t.lateUpdates());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pops_in_deadline_order);
+  RUN_TEST(test_only_due_events_pop);
+  RUN_TEST(test_rearm_and_cancel);
+  RUN_TEST(test_orders_across_millis_wrap);
+  RUN_TEST(test_records_lateness);
+  return UNITY_END();
+}
@@ -0,0 +1,105 @@
+#include <unity.h>
+#include <TimeZone.h>
+
+static const int64_t HOUR_MS = 3600000;
+
+// Transition instants of 2026, UTC ms, from the tz database
+static const int64_t BERLIN_DST_START = 1774746000000LL;  // 2026-03-29 01:00 UTC
+static const int64_t BERLIN_DST_END = 1792890000000LL;    // 2026-10-25 01:00 UTC
+static const int64_t NEW_YORK_DST_START = 1772953200000LL; // 2026-03-08 07:00 UTC
+static const int64_t NEW_YORK_DST_END = 1793512800000LL;   // 2026-11-01 06:00 UTC
+static const int64_t SYDNEY_DST_END = 1775318400000LL;    // 2026-04-04 16:00 UTC
+static const int64_t SYDNEY_DST_START = 1791043200000LL;  // 2026-10-03 16:00 UTC
+static const int64_t JAN_1_2026 = 1767225600000LL;
+
+static TzTable load(const char *rule) {
+  PosixTz tz;
+  TEST_ASSERT_TRUE(parsePosixTz(rule, tz));
+  TzTable t;
+  tzTableLoad(t, tz);
+  return t;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_parses_offsets_east_positive() {
+  PosixTz tz;
+  TEST_ASSERT_TRUE(parsePosixTz("CET-1CEST,M3.5.0,M10.5.0/3", tz));
+  TEST_ASSERT_EQUAL(60, tz.stdOffsetMin);
+  TEST_ASSERT_EQUAL(120, tz.dstOffsetMin);
+  TEST_ASSERT_TRUE(tz.hasDst);
+  TEST_ASSERT_EQUAL(3, tz.dstStart.month);
+  TEST_ASSERT_EQUAL(5, tz.dstStart.week);
+  TEST_ASSERT_EQUAL(3 * 3600, tz.dstEnd.timeSec);
+  TEST_ASSERT_TRUE(parsePosixTz("<+0530>-5:30", tz));
+  TEST_ASSERT_EQUAL(330, tz.stdOffsetMin);
+  TEST_ASSERT_FALSE(tz.hasDst);
+}
+
+void test_rejects_malformed_strings_and_keeps_out() {
+  PosixTz tz;
+  TEST_ASSERT_TRUE(parsePosixTz("EST5", tz));
+  static const char *const bad[] = {"", "CE-1", "CET", "CET-1CEST,M3.5.0", "CET-1CEST,M13.5.0,M10.5.0",
+                                    "CET-1CEST,M3.5.0,M10.5.0/3x", "<+05-5"};
+  for (const char *s : bad) {
+    TEST_ASSERT_FALSE(parsePosixTz(s, tz));
+  }
+  TEST_ASSERT_EQUAL(-300, tz.stdOffsetMin);
+}
+
+void test_central_europe_switches_at_one_utc() {
+  TzTable t = load("CET-1CEST,M3.5.0,M10.5.0/3");
+  TEST_ASSERT_EQUAL(60, tzOffsetMinutes(t, JAN_1_2026));
+  TEST_ASSERT_EQUAL(60, tzOffsetMinutes(t, BERLIN_DST_START - 1));
+  TEST_ASSERT_EQUAL(120, tzOffsetMinutes(t, BERLIN_DST_START));
+  TEST_ASSERT_EQUAL(120, tzOffsetMinutes(t, BERLIN_DST_END - 1));
+  TEST_ASSERT_EQUAL(60, tzOffsetMinutes(t, BERLIN_DST_END));
+  TEST_ASSERT_EQUAL_INT64(BERLIN_DST_START, tzNextTransition(t, JAN_1_2026));
+  TEST_ASSERT_EQUAL_INT64(BERLIN_DST_END, tzNextTransition(t, BERLIN_DST_START));
+}
+
+void test_dst_name_without_rules_gets_us_rules() {
+  TzTable t = load("EST5EDT");
+  TEST_ASSERT_EQUAL(-300, tzOffsetMinutes(t, NEW_YORK_DST_START - 1));
+  TEST_ASSERT_EQUAL(-240, tzOffsetMinutes(t, NEW_YORK_DST_START));
+  TEST_ASSERT_EQUAL(-240, tzOffsetMinutes(t, NEW_YORK_DST_END - 1));
+  TEST_ASSERT_EQUAL(-300, tzOffsetMinutes(t, NEW_YORK_DST_END));
+}
+
+void test_southern_zone_ends_dst_first() {
+  TzTable t = load("AEST-10AEDT,M10.1.0,M4.1.0/3");
+  TEST_ASSERT_EQUAL(660, tzOffsetMinutes(t, JAN_1_2026));
+  TEST_ASSERT_EQUAL(660, tzOffsetMinutes(t, SYDNEY_DST_END - 1));
+  TEST_ASSERT_EQUAL(600, tzOffsetMinutes(t, SYDNEY_DST_END));
+  TEST_ASSERT_EQUAL(600, tzOffsetMinutes(t, SYDNEY_DST_START - 1));
+  TEST_ASSERT_EQUAL(660, tzOffsetMinutes(t, SYDNEY_DST_START));
+  TEST_ASSERT_EQUAL_INT64(SYDNEY_DST_END, tzNextTransition(t, JAN_1_2026));
+}
+
+void test_next_transition_crosses_into_a_later_span() {
+  TzTable t = load("CET-1CEST,M3.5.0,M10.5.0/3");
+  tzTableBuild(t, t.tz, 2025); // covers 2025 and 2026
+  int64_t next = tzNextTransition(t, BERLIN_DST_END);
+  TEST_ASSERT_EQUAL_INT64(BERLIN_DST_END + 154 * 24 * HOUR_MS, next); // 2027-03-28 01:00 UTC
+  // Far outside the span the table is rebuilt for that year
+  TEST_ASSERT_EQUAL(120, tzOffsetMinutes(t, BERLIN_DST_START + 4 * 364 * 24 * HOUR_MS + 60 * 24 * HOUR_MS));
+}
+
+void test_zone_without_dst_never_changes() {
+  TzTable t = load("UTC0");
+  TEST_ASSERT_EQUAL(0, tzOffsetMinutes(t, BERLIN_DST_START));
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, tzNextTransition(t, JAN_1_2026));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parses_offsets_east_positive);
+  RUN_TEST(test_rejects_malformed_strings_and_keeps_out);
+  RUN_TEST(test_central_europe_switches_at_one_utc);
+  RUN_TEST(test_dst_name_without_rules_gets_us_rules);
+  RUN_TEST(test_southern_zone_ends_dst_first);
+  RUN_TEST(test_next_transition_crosses_into_a_later_span);
+  RUN_TEST(test_zone_without_dst_never_changes);
+  return UNITY_END();
+}
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Gzip the files in web/ and emit include/web_assets.h as PROGMEM arrays.
+
+Run after editing anything under web/:
+
+    python3 tools/embed_assets.py
+
+Output is deterministic (gzip mtime is fixed) so the ETag only changes when
+the asset content does.
+"""
+import gzip
+import hashlib
+import io
+import os
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SRC_DIR = os.path.join(ROOT, "web")
+OUT_FILE = os.path.join(ROOT, "include", "web_assets.h")
+
+CONTENT_TYPES = {
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".html": "text/html; charset=utf-8",
+    ".svg": "image/svg+xml",
+}
+
+
+def gzip_bytes(data):
+    buf = io.BytesIO()
+    with gzip.GzipFile(fileobj=buf, mode="wb", compresslevel=9, mtime=0) as gz:
+        gz.write(data)
+    return buf.getvalue()
+
+
+def symbol_for(name):
+    return "ASSET_" + "".join(c if c.isalnum() else "_" for c in name).upper()
+
+
+def main():
+    entries = []
+    out = [
+        "// Generated by tools/embed_assets.py from web/ -- do not edit by hand.",
+        "#pragma once",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "struct WebAsset {",
+        "  const char *path;",
+        "  const char *contentType;",
+        "  const char *etag;",
+        "  const uint8_t *data;",
+        "  size_t length;",
+        "};",
+        "",
+    ]
+    for name in sorted(os.listdir(SRC_DIR)):
+        ext = os.path.splitext(name)[1]
+        if ext not in CONTENT_TYPES:
+            continue
+        with open(os.path.join(SRC_DIR, name), "rb") as f:
+            raw = f.read()
+        gz = gzip_bytes(raw)
+        etag = '\\"' + hashlib.sha1(gz).hexdigest()[:16] + '\\"'
+        sym = symbol_for(name)
+        out.append("// %s: %d bytes, %d gzipped" % (name, len(raw), len(gz)))
+        out.append("static const uint8_t %s[] PROGMEM = {" % sym)
+        for i in range(0, len(gz), 16):
+            out.append("  " + ", ".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+        out.append("};")
+        out.append("")
+        entries.append('  {"/static/%s", "%s", "%s", %s, sizeof(%s)},'
+                       % (name, CONTENT_TYPES[ext], etag, sym, sym))
+    out.append("static const WebAsset WEB_ASSETS[] = {")
+    out.extend(entries)
+    out.append("};")
+    out.append("")
+    with open(OUT_FILE, "w") as f:
+        f.write("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,108 @@
+// Refreshes dashboard fields tagged with data-status="<key>". Fields that
+// also carry data-ch="<n>" belong to channel n. Updates arrive live from
+// /api/events; /api/status is polled only while that stream is down.
+(function () {
+  var fields = document.querySelectorAll('[data-status]');
+  if (!fields.length) return;
+  var fmt = {
+    ip: function (s) { return s.ip; },
+    mqttConnected: function (s) { return s.mqttConnected ? 'Connected' : 'Disconnected'; },
+    pin: function (s, c) { return 'GPIO' + c.pin + ' (' + (c.activeHigh ? 'Active HIGH' : 'Active LOW') + ')'; },
+    durationMs: function (s, c) { return c.durationMs + ' ms'; },
+    active: function (s, c) { return c.active ? 'On' : 'Idle'; },
+    pulses: function (s, c) { return c.pulse && c.pulse.count; }
+  };
+
+  function set(key, ch, text) {
+    for (var i = 0; i < fields.length; i++) {
+      var f = fields[i];
+      if (f.getAttribute('data-status') === key && f.getAttribute('data-ch') === ch) f.textContent = text;
+    }
+  }
+
+  function refresh() {
+    if (live) return;
+    fetch('/api/status')
+      .then(function (r) { return r.json(); })
+      .then(function (s) {
+        for (var i = 0; i < fields.length; i++) {
+          var f = fmt[fields[i].getAttribute('data-status')];
+          var ch = fields[i].getAttribute('data-ch');
+          var c = ch === null ? null : (s.channels || [])[+ch];
+          var v = f && (ch === null || c) ? f(s, c) : undefined;
+          if (v !== undefined) fields[i].textContent = v;
+        }
+      })
+      .catch(function () {});
+  }
+
+  // Interval countdowns run locally from the last "interval" event
+  var due = {};
+  function tick() {
+    var now = Date.now();
+    for (var ch in due) {
+      var left = due[ch] === null ? null : Math.max(0, Math.round((due[ch] - now) / 1000));
+      set('intervalNext', ch, left === null ? 'off' : 'in ' + left + ' s');
+    }
+  }
+
+  var live = false;
+  if (window.EventSource) {
+    var es = new EventSource('/api/events');
+    es.onopen = function () { live = true; };
+    es.onerror = function () { live = false; }; // EventSource reconnects by itself
+    es.addEventListener('pulse', function (e) {
+      var d = JSON.parse(e.data);
+      set('active', '' + d.ch, d.active ? 'On' : 'Idle');
+      set('pulses', '' + d.ch, d.pulses);
+    });
+    es.addEventListener('interval', function (e) {
+      var d = JSON.parse(e.data);
+      due[d.ch] = d.enabled && d.nextMs !== null ? Date.now() + d.nextMs : null;
+      tick();
+    });
+    es.addEventListener('link', function (e) {
+      var d = JSON.parse(e.data);
+      set('ip', null, d.wifi ? d.ip : 'Not connected');
+      set('mqttConnected', null, d.mqtt ? 'Connected' : 'Disconnected');
+    });
+    setInterval(tick, 1000);
+  }
+
+  // Manual triggers without reloading the page; the state comes back as events
+  var forms = document.querySelectorAll('form[action="/api/trigger"]');
+  for (var i = 0; i < forms.length; i++) {
+    forms[i].addEventListener('submit', function (e) {
+      if (!live) return;
+      e.preventDefault();
+      fetch('/api/trigger', { method: 'POST', body: new URLSearchParams(new FormData(this)), redirect: 'manual' })
+        .catch(function () {});
+    });
+  }
+
+  setInterval(refresh, 5000);
+})();
+
+// Firmware upload: the file goes as the raw request body, which the device
+// writes to flash as it arrives
+(function () {
+  var forms = document.querySelectorAll('form[data-upload]');
+  for (var i = 0; i < forms.length; i++) {
+    forms[i].addEventListener('submit', function (e) {
+      e.preventDefault();
+      var form = this;
+      var file = form.querySelector('input[type=file]').files[0];
+      var status = form.querySelector('[data-upload-status]');
+      if (!file) return;
+      status.textContent = 'Uploading...';
+      fetch(form.getAttribute('data-upload'), {
+        method: 'POST',
+        body: file,
+        headers: { 'Content-Type': 'application/octet-stream' }
+      })
+        .then(function (r) { return r.text().then(function (t) { status.textContent = t; return r.ok; }); })
+        .then(function (ok) { if (ok) setTimeout(function () { location.reload(); }, 15000); })
+        .catch(function () { status.textContent = 'Upload failed'; });
+    });
+  }
+})();